@@ -0,0 +1,179 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "corpus_generator.h"
+
+#include <algorithm>
+#include <array>
+#include <string_view>
+
+namespace
+{
+
+constexpr std::array<std::string_view, 16> k_Words = {
+   "alpha", "beta", "gamma", "delta", "epsilon", "one", "two", "three",
+   "x1",    "y2",   "a-b",   "c/d",   "e+f",     "The", "end.", "more",
+};
+
+constexpr std::array<std::string_view, 8> k_IdentifierStems = {
+   "section", "subsection", "note", "item", "figure", "table", "quote", "aside",
+};
+
+/*
+ * splitmix64; unlike the standard distributions, the sequence is the same everywhere
+ */
+class Random
+{
+public:
+   explicit Random(uint64_t seed) noexcept : m_state{seed}
+   {
+   }
+
+   uint64_t next() noexcept
+   {
+      uint64_t value = (m_state += 0x9e3779b97f4a7c15ULL);
+      value          = (value ^ (value >> 30U)) * 0xbf58476d1ce4e5b9ULL;
+      value          = (value ^ (value >> 27U)) * 0x94d049bb133111ebULL;
+      return value ^ (value >> 31U);
+   }
+
+   // in [0, bound)
+   size_t below(size_t bound) noexcept
+   {
+      return static_cast<size_t>(next() % bound);
+   }
+
+   // in [1, limit], biased towards limit
+   size_t upTo(size_t limit) noexcept
+   {
+      return (limit <= 1) ? 1 : (limit / 2 + 1 + below(limit - limit / 2));
+   }
+
+private:
+   uint64_t m_state;
+};
+
+class CorpusWriter
+{
+public:
+   CorpusWriter(const samx::CorpusOptions& options, std::string& output) :
+      m_options{options}, m_output{output}, m_random{options.seed}
+   {
+   }
+
+   void writeParagraph(size_t indent)
+   {
+      const auto lines = m_random.upTo(m_options.paragraphLines);
+      for (size_t ii = 0; ii < lines; ++ii)
+      {
+         m_output.append(indent, ' ');
+         writeWords(m_random.upTo(m_options.wordsPerLine));
+         m_output.push_back('\n');
+      }
+
+      m_output.push_back('\n');
+   }
+
+   void writeBlock(size_t indent, size_t depth)
+   {
+      const auto identifier = m_random.below(std::max<size_t>(m_options.identifierCount, 1));
+
+      m_output.append(indent, ' ');
+      m_output.append(k_IdentifierStems[identifier % k_IdentifierStems.size()]);
+      if (identifier >= k_IdentifierStems.size())
+      {
+         m_output.push_back('_');
+         m_output.append(std::to_string(identifier / k_IdentifierStems.size()));
+      }
+      m_output.append(": ");
+      writeWords(m_random.below(4));
+      m_output.push_back('\n');
+
+      if (depth >= m_options.maxDepth)
+      {
+         return;
+      }
+
+      m_output.push_back('\n');
+
+      // every other element is a block, starting with a random one
+      const auto childIndent = indent + m_options.indentStep;
+      const auto parity      = m_random.below(2);
+      for (size_t ii = 0; ii < m_options.fanOut; ++ii)
+      {
+         if ((ii + parity) % 2 == 0)
+         {
+            writeBlock(childIndent, depth + 1);
+         }
+         else
+         {
+            writeParagraph(childIndent);
+         }
+      }
+   }
+
+   void writeTopLevel()
+   {
+      if (m_random.below(4) == 0)
+      {
+         writeParagraph(0);
+      }
+      else
+      {
+         writeBlock(0, 0);
+
+         // separates the block from a following top level element
+         if (m_output.back() != '\n' || m_output[m_output.size() - 2] != '\n')
+         {
+            m_output.push_back('\n');
+         }
+      }
+   }
+
+private:
+   void writeWords(size_t count)
+   {
+      for (size_t ii = 0; ii < count; ++ii)
+      {
+         if (ii > 0)
+         {
+            m_output.push_back(' ');
+         }
+         m_output.append(k_Words[m_random.below(k_Words.size())]);
+      }
+   }
+
+   const samx::CorpusOptions& m_options;
+   std::string&               m_output;
+   Random                     m_random;
+};
+
+} // namespace
+
+std::string samx::generateCorpus(const CorpusOptions& options)
+{
+   std::string output;
+   output.reserve(options.targetSize + options.targetSize / 8);
+
+   CorpusWriter writer{options, output};
+   while (output.size() < options.targetSize)
+   {
+      writer.writeTopLevel();
+   }
+
+   return output;
+}
@@ -0,0 +1,61 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#ifndef SAMX_CORPUS_GENERATOR_H_INCLUDED
+#define SAMX_CORPUS_GENERATOR_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace samx
+{
+
+/*
+ * Shape of a synthetic SAM document.
+ */
+struct CorpusOptions
+{
+   // the document ends with the first top level element past this size
+   size_t targetSize = 1024 * 1024;
+
+   // nesting levels below a top level block
+   size_t maxDepth = 4;
+
+   // elements per block
+   size_t fanOut = 4;
+
+   size_t paragraphLines = 3;
+   size_t wordsPerLine   = 8;
+
+   // distinct block identifiers
+   size_t identifierCount = 8;
+
+   size_t indentStep = 4;
+
+   uint64_t seed = 1;
+};
+
+/*
+ * Generates a valid SAM document. The output depends only on the options, not on the
+ * platform or the standard library.
+ */
+std::string generateCorpus(const CorpusOptions& options);
+
+} // namespace samx
+
+#endif // SAMX_CORPUS_GENERATOR_H_INCLUDED
@@ -0,0 +1,482 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "corpus_generator.h"
+
+#include "binary_document.h"
+#include "document_arena.h"
+#include "document_printer.h"
+#include "document_renderer.h"
+#include "flat_document.h"
+#include "normalizer.h"
+#include "output_sink.h"
+#include "samx_parser.h"
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <functional>
+#include <cstdlib>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <tuple>
+
+/*
+ * Every allocation in the process is counted, so that the benchmarks can report
+ * allocations per MB of input. The replacements are not inlined, so that the compiler
+ * does not pair the inner malloc and free with the outer new and delete.
+ */
+namespace
+{
+std::atomic<size_t> g_allocationCount{0};
+} // namespace
+
+[[gnu::noinline]] void* operator new(size_t size)
+{
+   g_allocationCount.fetch_add(1, std::memory_order_relaxed);
+
+   if (void* pointer = std::malloc(size == 0 ? 1 : size))
+   {
+      return pointer;
+   }
+
+   throw std::bad_alloc{};
+}
+
+[[gnu::noinline]] void* operator new(size_t size, std::align_val_t alignment)
+{
+   g_allocationCount.fetch_add(1, std::memory_order_relaxed);
+
+   const auto align = static_cast<size_t>(alignment);
+   if (void* pointer = std::aligned_alloc(align, (size + align - 1) / align * align))
+   {
+      return pointer;
+   }
+
+   throw std::bad_alloc{};
+}
+
+[[gnu::noinline]] void operator delete(void* pointer) noexcept
+{
+   std::free(pointer);
+}
+
+[[gnu::noinline]] void operator delete(void* pointer, size_t /* size */) noexcept
+{
+   std::free(pointer);
+}
+
+[[gnu::noinline]] void operator delete(void* pointer, std::align_val_t /* alignment */) noexcept
+{
+   std::free(pointer);
+}
+
+[[gnu::noinline]] void operator delete(void* pointer, size_t /* size */, std::align_val_t /* alignment */) noexcept
+{
+   std::free(pointer);
+}
+
+namespace
+{
+
+/*
+ * Benchmark arguments: corpus size in KiB, maximum depth, fan-out, paragraph lines.
+ */
+samx::CorpusOptions getCorpusOptions(const benchmark::State& state)
+{
+   samx::CorpusOptions options;
+   options.targetSize     = static_cast<size_t>(state.range(0)) * 1024;
+   options.maxDepth       = static_cast<size_t>(state.range(1));
+   options.fanOut         = static_cast<size_t>(state.range(2));
+   options.paragraphLines = static_cast<size_t>(state.range(3));
+   return options;
+}
+
+// generated once per shape, outside of the measurements
+const std::string& getCorpus(const benchmark::State& state)
+{
+   static std::map<std::tuple<int64_t, int64_t, int64_t, int64_t>, std::string> corpora;
+
+   auto& corpus = corpora[std::make_tuple(state.range(0), state.range(1), state.range(2), state.range(3))];
+   if (corpus.empty())
+   {
+      corpus = samx::generateCorpus(getCorpusOptions(state));
+   }
+
+   return corpus;
+}
+
+const std::string& getNormalizedCorpus(const benchmark::State& state)
+{
+   static std::map<const std::string*, std::string> normalized;
+
+   const auto& corpus = getCorpus(state);
+
+   auto& text = normalized[&corpus];
+   if (text.empty())
+   {
+      std::ostringstream output;
+      samx::Normalizer   normalizer{output};
+      normalizer.normalize(std::string_view(corpus));
+      text = output.str();
+   }
+
+   return text;
+}
+
+class NullObserver : public samx::IndentationObserver
+{
+public:
+   void indent() override
+   {
+   }
+
+   void deindent() override
+   {
+   }
+
+   void line(std::string_view text) override
+   {
+      benchmark::DoNotOptimize(text.data());
+   }
+
+   void emptyLine() override
+   {
+   }
+};
+
+/*
+ * Touches every node and its text, through either the Document visitor or the
+ * FlatDocument walk.
+ */
+class NodeVisitor
+{
+public:
+   void operator()(const samx::Block& block)
+   {
+      enterBlock(block.getType(), block.getDescription());
+      block.forEachElement(std::ref(*this));
+   }
+
+   void operator()(const samx::Paragraph& para)
+   {
+      ++m_nodeCount;
+      para.forEachSegment([this](std::string_view segment) {
+         m_textSize += segment.size();
+      });
+   }
+
+   void enterBlock(std::string_view type, std::string_view description)
+   {
+      ++m_nodeCount;
+      m_textSize += type.size() + description.size();
+   }
+
+   void leaveBlock() noexcept
+   {
+   }
+
+   void paragraph(std::string_view text)
+   {
+      ++m_nodeCount;
+      m_textSize += text.size();
+   }
+
+   size_t getNodeCount() const noexcept
+   {
+      return m_nodeCount;
+   }
+
+   size_t getTextSize() const noexcept
+   {
+      return m_textSize;
+   }
+
+private:
+   size_t m_nodeCount = 0;
+   size_t m_textSize  = 0;
+};
+
+/*
+ * Reports MB/s and allocations per MB of input for the measured loop.
+ */
+class Measurement
+{
+public:
+   Measurement(benchmark::State& state, size_t inputSize) :
+      m_state{state}, m_inputSize{inputSize}, m_allocationsBefore{g_allocationCount.load()}
+   {
+   }
+
+   Measurement(const Measurement& other) = delete;
+   Measurement(Measurement&& other)      = delete;
+   Measurement& operator=(const Measurement& other) = delete;
+   Measurement& operator=(Measurement&& other) = delete;
+
+   ~Measurement()
+   {
+      const auto allocations = g_allocationCount.load() - m_allocationsBefore;
+      const auto iterations  = static_cast<double>(m_state.iterations());
+      const auto megabytes   = static_cast<double>(m_inputSize) / (1024.0 * 1024.0);
+
+      m_state.SetBytesProcessed(m_state.iterations() * static_cast<int64_t>(m_inputSize));
+      m_state.counters["allocs/MB"] = static_cast<double>(allocations) / iterations / megabytes;
+      m_state.counters["input_MB"]  = megabytes;
+   }
+
+private:
+   benchmark::State& m_state;
+   size_t            m_inputSize;
+   size_t            m_allocationsBefore;
+};
+
+void BM_Normalize(benchmark::State& state)
+{
+   const auto& corpus = getCorpus(state);
+
+   Measurement measurement{state, corpus.size()};
+   for (auto _ : state)
+   {
+      NullObserver     observer;
+      samx::Normalizer normalizer{observer};
+      benchmark::DoNotOptimize(normalizer.normalize(std::string_view(corpus)));
+   }
+}
+
+void BM_NormalizeToText(benchmark::State& state)
+{
+   const auto& corpus = getCorpus(state);
+
+   std::ostringstream output;
+
+   Measurement measurement{state, corpus.size()};
+   for (auto _ : state)
+   {
+      output.str(std::string{});
+
+      samx::Normalizer normalizer{output};
+      benchmark::DoNotOptimize(normalizer.normalize(std::string_view(corpus)));
+   }
+}
+
+void BM_NormalizeToBuffer(benchmark::State& state)
+{
+   const auto& corpus = getCorpus(state);
+
+   std::string      output;
+   samx::BufferSink sink{output};
+
+   Measurement measurement{state, corpus.size()};
+   for (auto _ : state)
+   {
+      output.clear();
+
+      samx::MarkerWriter<samx::BufferSink> writer{sink};
+      samx::Normalizer                     normalizer{writer};
+      benchmark::DoNotOptimize(normalizer.normalize(std::string_view(corpus)));
+   }
+}
+
+void BM_Parse(benchmark::State& state)
+{
+   const auto& normalized = getNormalizedCorpus(state);
+
+   Measurement measurement{state, normalized.size()};
+   for (auto _ : state)
+   {
+      samx::Document doc;
+      benchmark::DoNotOptimize(samx::parse(normalized, doc));
+   }
+}
+
+void BM_ParseReusedArena(benchmark::State& state)
+{
+   const auto& normalized = getNormalizedCorpus(state);
+
+   samx::DocumentArena arena;
+
+   Measurement measurement{state, normalized.size()};
+   for (auto _ : state)
+   {
+      {
+         samx::Document doc{arena};
+         benchmark::DoNotOptimize(samx::parse(normalized, doc));
+      }
+      arena.reset();
+   }
+}
+
+void BM_NormalizeAndParse(benchmark::State& state)
+{
+   const auto& corpus = getCorpus(state);
+
+   Measurement measurement{state, corpus.size()};
+   for (auto _ : state)
+   {
+      const auto doc = samx::normalizeAndParse(std::string_view(corpus));
+      benchmark::DoNotOptimize(doc.getBlockCount());
+   }
+}
+
+void BM_LoadBinary(benchmark::State& state)
+{
+   const auto& corpus = getCorpus(state);
+   const auto  bytes  = samx::toBinary(samx::FlatDocument{samx::normalizeAndParse(std::string_view(corpus))});
+
+   // throughput is relative to the source size, for comparison with BM_NormalizeAndParse
+   Measurement measurement{state, corpus.size()};
+   for (auto _ : state)
+   {
+      const samx::BinaryDocument doc{bytes};
+      benchmark::DoNotOptimize(doc.getNodeCount());
+   }
+}
+
+/*
+ * Traversal of the two representations of the same document; throughput is relative to
+ * the source size, and the storage of each representation is reported per node.
+ */
+void BM_WalkDocument(benchmark::State& state)
+{
+   const auto& corpus = getCorpus(state);
+   const auto  doc    = samx::normalizeAndParse(std::string_view(corpus));
+
+   const auto counters  = doc.getCounters();
+   const auto nodeCount = counters.blocks + counters.paragraphs;
+
+   {
+      Measurement measurement{state, corpus.size()};
+      for (auto _ : state)
+      {
+         NodeVisitor visitor;
+         doc.forEachElement(std::ref(visitor));
+         benchmark::DoNotOptimize(visitor.getTextSize());
+      }
+   }
+
+   state.counters["nodes"]      = static_cast<double>(nodeCount);
+   state.counters["bytes/node"] = static_cast<double>(counters.storageBytes) / static_cast<double>(nodeCount);
+}
+
+void BM_WalkFlatDocument(benchmark::State& state)
+{
+   const auto&              corpus = getCorpus(state);
+   const samx::FlatDocument doc{samx::normalizeAndParse(std::string_view(corpus))};
+
+   {
+      Measurement measurement{state, corpus.size()};
+      for (auto _ : state)
+      {
+         NodeVisitor visitor;
+         doc.walk(visitor);
+         benchmark::DoNotOptimize(visitor.getTextSize());
+      }
+   }
+
+   const auto nodeCount = doc.getNodeCount();
+
+   state.counters["nodes"]      = static_cast<double>(nodeCount);
+   state.counters["bytes/node"] = static_cast<double>(doc.getStorageSize()) / static_cast<double>(nodeCount);
+}
+
+void BM_Print(benchmark::State& state)
+{
+   const auto& corpus = getCorpus(state);
+   const auto  doc    = samx::normalizeAndParse(std::string_view(corpus));
+
+   std::ostringstream output;
+
+   // throughput is relative to the source size, like for the other phases
+   Measurement measurement{state, corpus.size()};
+   for (auto _ : state)
+   {
+      output.str(std::string{});
+      output << doc;
+      benchmark::DoNotOptimize(output.tellp());
+   }
+}
+
+void BM_PrintToBuffer(benchmark::State& state)
+{
+   const auto& corpus = getCorpus(state);
+   const auto  doc    = samx::normalizeAndParse(std::string_view(corpus));
+
+   std::string      output;
+   samx::BufferSink sink{output};
+
+   Measurement measurement{state, corpus.size()};
+   for (auto _ : state)
+   {
+      output.clear();
+      benchmark::DoNotOptimize(samx::printTo(sink, doc));
+   }
+}
+
+void BM_Render(benchmark::State& state, samx::OutputFormat format)
+{
+   const auto& corpus = getCorpus(state);
+   const auto  doc    = samx::normalizeAndParse(std::string_view(corpus));
+
+   std::string      output;
+   samx::BufferSink sink{output};
+
+   // relative to the source size, for comparison with BM_Print
+   Measurement measurement{state, corpus.size()};
+   for (auto _ : state)
+   {
+      output.clear();
+      benchmark::DoNotOptimize(samx::renderTo(sink, doc, format));
+   }
+}
+
+/*
+ * Corpus shapes: {size KiB, depth, fan-out, paragraph lines}
+ */
+void corpusShapes(benchmark::internal::Benchmark* benchmark)
+{
+   benchmark->ArgNames({"KiB", "depth", "fanout", "lines"});
+
+   benchmark->Args({1024, 4, 4, 3});  // mixed
+   benchmark->Args({1024, 1, 16, 3}); // shallow and wide
+   benchmark->Args({1024, 12, 2, 1}); // deep
+   benchmark->Args({1024, 2, 4, 24}); // long paragraphs
+   benchmark->Args({16384, 4, 4, 3}); // larger than the caches
+
+   benchmark->Unit(benchmark::kMillisecond);
+}
+
+} // namespace
+
+BENCHMARK(BM_Normalize)->Apply(corpusShapes);
+BENCHMARK(BM_NormalizeToText)->Apply(corpusShapes);
+BENCHMARK(BM_NormalizeToBuffer)->Apply(corpusShapes);
+BENCHMARK(BM_Parse)->Apply(corpusShapes);
+BENCHMARK(BM_ParseReusedArena)->Apply(corpusShapes);
+BENCHMARK(BM_NormalizeAndParse)->Apply(corpusShapes);
+BENCHMARK(BM_LoadBinary)->Apply(corpusShapes);
+BENCHMARK(BM_WalkDocument)->Apply(corpusShapes);
+BENCHMARK(BM_WalkFlatDocument)->Apply(corpusShapes);
+BENCHMARK(BM_Print)->Apply(corpusShapes);
+BENCHMARK(BM_PrintToBuffer)->Apply(corpusShapes);
+BENCHMARK_CAPTURE(BM_Render, html, samx::OutputFormat::Html)->Apply(corpusShapes);
+BENCHMARK_CAPTURE(BM_Render, xml, samx::OutputFormat::Xml)->Apply(corpusShapes);
+BENCHMARK_CAPTURE(BM_Render, json, samx::OutputFormat::Json)->Apply(corpusShapes);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,83 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "corpus_generator.h"
+
+#include <iostream>
+#include <string>
+#include <string_view>
+
+int main(int argc, char* argv[])
+{
+   samx::CorpusOptions options;
+
+   const struct
+   {
+      std::string_view name;
+      size_t*          value;
+   } sizeOptions[] = {
+      {"--size", &options.targetSize},
+      {"--depth", &options.maxDepth},
+      {"--fan-out", &options.fanOut},
+      {"--paragraph-lines", &options.paragraphLines},
+      {"--words-per-line", &options.wordsPerLine},
+      {"--identifiers", &options.identifierCount},
+      {"--indent", &options.indentStep},
+   };
+
+   for (int ii = 1; ii < argc; ++ii)
+   {
+      const std::string_view arg{argv[ii]};
+
+      bool known = false;
+      if (ii + 1 < argc)
+      {
+         for (const auto& option : sizeOptions)
+         {
+            if (arg == option.name)
+            {
+               *option.value = std::stoul(argv[++ii]);
+               known         = true;
+            }
+         }
+
+         if (arg == "--seed")
+         {
+            options.seed = std::stoull(argv[++ii]);
+            known        = true;
+         }
+      }
+
+      if (!known)
+      {
+         std::cerr << "Error: unknown argument " << arg << '\n';
+         std::cerr << "Usage: samx-gen [--size bytes] [--depth n] [--fan-out n] [--paragraph-lines n]\n"
+                      "                [--words-per-line n] [--identifiers n] [--indent n] [--seed n]\n";
+         return 1;
+      }
+   }
+
+   if (options.indentStep == 0)
+   {
+      std::cerr << "Error: the indent must be positive\n";
+      return 1;
+   }
+
+   std::cout << samx::generateCorpus(options);
+
+   return 0;
+}
@@ -0,0 +1,387 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "binary_document.h"
+#include "command_line.h"
+#include "diagnostics.h"
+#include "document_arena.h"
+#include "flat_document.h"
+#include "include_cache.h"
+#include "mapped_file.h"
+#include "parse_cache.h"
+#include "pipeline.h"
+#include "samx_parser.h"
+#include "thread_pool.h"
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace
+{
+
+const char* const k_Usage =
+   "Usage: samx-batch [-j threads | --pipeline] [--cache directory [--cache-size MiB]] [--files-from list|-] "
+   "input...\n";
+
+struct FileResult
+{
+   bool        valid      = false;
+   size_t      blockCount = 0;
+   size_t      size       = 0;
+   std::string error;
+
+   // indentation errors, as reported by samx::Diagnostics
+   std::string diagnostics;
+};
+
+/*
+ * Regular files are mapped, anything else is read whole; either way the document
+ * references the paragraph text in the source. Documents without errors or insertions
+ * are cached.
+ */
+FileResult validateFile(const std::string&                        path,
+                        samx::DocumentArena&                      arena,
+                        const std::shared_ptr<samx::SymbolTable>& symbols,
+                        samx::IncludeCache&                       includes,
+                        samx::ParseCache*                         cache)
+{
+   FileResult result;
+
+   try
+   {
+      const auto       file   = samx::loadFile(path.c_str());
+      std::string_view source = file.contents;
+
+      result.size = source.size();
+
+      std::string                         cacheKey;
+      std::optional<samx::BinaryDocument> cached;
+      if (cache != nullptr)
+      {
+         cacheKey = samx::ParseCache::makeKey(source);
+         cached   = cache->find(cacheKey);
+      }
+
+      if (cached)
+      {
+         result.blockCount = cached->getBlockCount();
+         result.valid      = true;
+      }
+      else
+      {
+         includes.prefetch(source, samx::getDirectory(path));
+
+         samx::Document doc{arena, symbols};
+         doc.shareSource(file.owner);
+
+         samx::InsertionResolver resolver{doc, includes, path};
+         samx::Diagnostics       diagnostics;
+         samx::normalizeAndParse(source, resolver, nullptr, &diagnostics);
+
+         if (diagnostics.empty())
+         {
+            if ((cache != nullptr) && (resolver.getInsertionCount() == 0))
+            {
+               cache->store(cacheKey, samx::FlatDocument{doc});
+            }
+         }
+         else
+         {
+            std::ostringstream report;
+            diagnostics.report(report);
+            result.diagnostics = report.str();
+         }
+
+         result.blockCount = doc.getBlockCount();
+         result.valid      = true;
+      }
+   }
+   catch (const std::exception& ex)
+   {
+      result.error = ex.what();
+   }
+
+   // the document is gone, its memory is recycled for the next file on this worker
+   arena.reset();
+
+   return result;
+}
+
+/*
+ * Builds the documents of a pipeline run, on its parse thread; the paragraph text is
+ * copied out of the pipeline buffers, into the arena.
+ */
+class BatchConsumer : public samx::PipelineConsumer
+{
+public:
+   BatchConsumer(const std::vector<std::string>&    paths,
+                 std::vector<FileResult>&           results,
+                 std::shared_ptr<samx::SymbolTable> symbols,
+                 samx::IncludeCache&                includes) :
+      m_paths{paths}, m_results{results}, m_symbols{std::move(symbols)}, m_includes{includes}
+   {
+   }
+
+   samx::DocumentHandler& beginFile(size_t index) override
+   {
+      m_document.emplace(m_arena, m_symbols);
+      return m_resolver.emplace(*m_document, m_includes, m_paths[index]);
+   }
+
+   void endFile(size_t index, const samx::Diagnostics& diagnostics, std::string_view error) override
+   {
+      auto& result = m_results[index];
+
+      if (error.empty())
+      {
+         if (!diagnostics.empty())
+         {
+            std::ostringstream report;
+            diagnostics.report(report);
+            result.diagnostics = report.str();
+         }
+
+         result.blockCount = m_document->getBlockCount();
+         result.valid      = true;
+      }
+      else
+      {
+         result.error = error;
+      }
+
+      m_resolver.reset();
+      m_document.reset();
+      m_arena.reset();
+   }
+
+private:
+   const std::vector<std::string>&    m_paths;
+   std::vector<FileResult>&           m_results;
+   std::shared_ptr<samx::SymbolTable> m_symbols;
+   samx::IncludeCache&                m_includes;
+
+   samx::DocumentArena                    m_arena;
+   std::optional<samx::Document>          m_document;
+   std::optional<samx::InsertionResolver> m_resolver;
+};
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+   size_t threadCount = 0;
+   bool   pipeline    = false;
+
+   const char* cacheDirectory = nullptr;
+   uint64_t    cacheSize      = samx::ParseCache::k_DefaultMaxSize;
+
+   std::vector<std::string> paths;
+
+   for (int ii = 1; ii < argc; ++ii)
+   {
+      const std::string_view arg{argv[ii]};
+
+      if ((arg == "-j") && (ii + 1 < argc))
+      {
+         const auto count = samx::parseCount(argv[++ii]);
+         if (!count)
+         {
+            std::cerr << "Error: invalid thread count " << argv[ii] << '\n' << k_Usage;
+            return 1;
+         }
+
+         threadCount = count.value();
+      }
+      else if (arg == "--pipeline")
+      {
+         pipeline = true;
+      }
+      else if ((arg == "--cache") && (ii + 1 < argc))
+      {
+         cacheDirectory = argv[++ii];
+      }
+      else if ((arg == "--cache-size") && (ii + 1 < argc))
+      {
+         // in MiB
+         const auto size = samx::parseCount(argv[++ii]);
+         if (!size || (size.value() > UINT64_MAX / (1024 * 1024)))
+         {
+            std::cerr << "Error: invalid cache size " << argv[ii] << '\n' << k_Usage;
+            return 1;
+         }
+
+         cacheSize = uint64_t{size.value()} * 1024 * 1024;
+      }
+      else if ((arg == "--files-from") && (ii + 1 < argc))
+      {
+         if (!samx::readFileList(argv[++ii], paths))
+         {
+            std::cerr << "Cannot read file list " << argv[ii] << '\n';
+            return 2;
+         }
+      }
+      else
+      {
+         paths.emplace_back(arg);
+      }
+   }
+
+   if (paths.empty())
+   {
+      std::cerr << "Error: input arguments missing\n";
+      std::cerr << k_Usage;
+      return 1;
+   }
+
+   // the pipeline never holds a whole file, which the cache key needs
+   if (pipeline && (cacheDirectory != nullptr))
+   {
+      std::cerr << "Error: --pipeline cannot be used with --cache\n";
+      return 1;
+   }
+
+   const auto startTime = std::chrono::steady_clock::now();
+
+   // shared by all the workers
+   std::unique_ptr<samx::ParseCache> cache;
+   if (cacheDirectory != nullptr)
+   {
+      try
+      {
+         cache = std::make_unique<samx::ParseCache>(cacheDirectory, cacheSize);
+      }
+      catch (const std::system_error& se)
+      {
+         std::cerr << se.what() << '\n';
+         return 2;
+      }
+   }
+
+   samx::ThreadPool pool{threadCount};
+
+   // one arena per worker, reused for all the files it validates
+   std::vector<std::unique_ptr<samx::DocumentArena>> arenas;
+   for (size_t ii = 0; ii < pool.getThreadCount(); ++ii)
+   {
+      arenas.push_back(std::make_unique<samx::DocumentArena>());
+   }
+
+   // fragments inserted by several files are parsed once
+   samx::IncludeCache includes{&pool};
+
+   // block types are stored once for the whole batch
+   const auto symbols = std::make_shared<samx::SymbolTable>();
+
+   std::vector<FileResult> results(paths.size());
+
+   std::optional<samx::PipelineStats> pipelineStats;
+   if (pipeline)
+   {
+      BatchConsumer consumer{paths, results, symbols, includes};
+      pipelineStats = samx::runPipeline(paths, consumer);
+   }
+   else
+   {
+      for (size_t ii = 0; ii < paths.size(); ++ii)
+      {
+         pool.submit([&pool, &arenas, &symbols, &includes, &paths, &results, &cache, ii]() {
+            results[ii] = validateFile(paths[ii], *arenas[pool.getWorkerIndex()], symbols, includes, cache.get());
+         });
+      }
+
+      pool.wait();
+   }
+
+   const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+
+   /*
+    * report in the order the files were given
+    */
+   size_t failed    = 0;
+   size_t totalSize = 0;
+
+   for (size_t ii = 0; ii < paths.size(); ++ii)
+   {
+      const auto& result = results[ii];
+      totalSize += result.size;
+
+      std::istringstream diagnostics{result.diagnostics};
+      for (std::string line; std::getline(diagnostics, line);)
+      {
+         std::cerr << paths[ii] << ": " << line << '\n';
+      }
+
+      if (result.valid)
+      {
+         std::cout << paths[ii] << ": " << result.blockCount << " top level blocks\n";
+      }
+      else
+      {
+         ++failed;
+         std::cout << paths[ii] << ": error: " << result.error << '\n';
+      }
+   }
+
+   // the pipeline does not keep file sizes, only the bytes it read
+   if (pipelineStats)
+   {
+      totalSize = pipelineStats->bytes;
+   }
+
+   const auto megabytes = static_cast<double>(totalSize) / (1024.0 * 1024.0);
+
+   std::cerr << "Validated " << paths.size() << " files (" << failed << " failed), " << megabytes << " MB in "
+             << elapsed.count() << " s: " << (megabytes / elapsed.count()) << " MB/s";
+   if (pipelineStats)
+   {
+      std::cerr << " in a three stage pipeline\n";
+
+      const auto busy = [&pipelineStats](samx::PipelineStats::Duration stage) {
+         return 100.0 * std::chrono::duration<double>(stage).count() /
+                std::chrono::duration<double>(pipelineStats->wall).count();
+      };
+
+      std::cerr << "Pipeline stages busy: read " << busy(pipelineStats->read) << "%, normalize "
+                << busy(pipelineStats->normalize) << "%, parse " << busy(pipelineStats->parse) << "%\n";
+   }
+   else
+   {
+      std::cerr << " on " << pool.getThreadCount() << " threads\n";
+   }
+
+   if (cache)
+   {
+      std::cerr << "Parse cache: " << cache->getHits() << " hits, " << cache->getMisses() << " misses, "
+                << cache->getEvictions() << " evictions\n";
+   }
+
+   if (includes.getLoadCount() > 0)
+   {
+      std::cerr << "Inserted fragments: " << includes.getLoadCount() << " loaded, " << includes.getReuseCount()
+                << " reused\n";
+   }
+
+   return (failed == 0) ? 0 : 3;
+}
@@ -0,0 +1,380 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "binary_document.h"
+
+#include "flat_document.h"
+#include "mapped_file.h"
+#include "output_sink.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace
+{
+
+constexpr char     k_Magic[8]    = {'S', 'A', 'M', 'X', 'D', 'O', 'C', '\0'};
+constexpr uint32_t k_ByteOrder   = 0x01020304;
+constexpr size_t   k_Alignment   = 8;
+constexpr uint32_t k_NoString    = UINT32_MAX;
+constexpr uint64_t k_MaxTextSize = UINT32_MAX;
+
+static_assert(std::is_trivially_copyable_v<samx::BinaryDocument::Header>);
+static_assert(std::is_trivially_copyable_v<samx::BinaryDocument::Node>);
+static_assert(sizeof(samx::BinaryDocument::Header) % k_Alignment == 0);
+
+constexpr uint64_t alignUp(uint64_t offset) noexcept
+{
+   return (offset + k_Alignment - 1) & ~uint64_t{k_Alignment - 1};
+}
+
+template <typename Record, typename Sink>
+void writeRecord(Sink& sink, const Record& record)
+{
+   sink.write(std::string_view(reinterpret_cast<const char*>(&record), sizeof(Record)));
+}
+
+template <typename Sink>
+void writePadding(Sink& sink, uint64_t& offset)
+{
+   for (const auto aligned = alignUp(offset); offset < aligned; ++offset)
+   {
+      sink.put('\0');
+   }
+}
+
+template <typename Sink>
+void serialize(Sink& sink, const samx::FlatDocument& doc)
+{
+   using BinaryDocument = samx::BinaryDocument;
+
+   /*
+    * first pass: distinct block types and their blocks, stored at the start of the text,
+    * and the text size; the string table numbers the types in order of first appearance,
+    * whatever their ids in a SymbolTable shared with other documents
+    */
+   const samx::BlockIndex index{doc};
+
+   std::vector<uint32_t>         strings(index.getTypeCount(), k_NoString);
+   std::vector<samx::SymbolId>   types;
+   std::vector<std::string_view> typeNames;
+
+   uint64_t typesSize  = 0;
+   uint64_t textSize   = 0;
+   uint32_t blockCount = 0;
+   for (const auto& node : doc)
+   {
+      if (node.kind == samx::FlatDocument::NodeKind::Block)
+      {
+         if (strings[node.type] == k_NoString)
+         {
+            strings[node.type] = static_cast<uint32_t>(types.size());
+            types.push_back(node.type);
+            typeNames.push_back(doc.getType(node));
+            typesSize += typeNames.back().size();
+         }
+
+         textSize += doc.getDescription(node).size();
+         ++blockCount;
+      }
+      else
+      {
+         textSize += doc.getText(node).size();
+      }
+   }
+
+   textSize += typesSize;
+   if (textSize > k_MaxTextSize)
+   {
+      throw std::runtime_error(fmt::format("Document too large to serialize: {} bytes of text", textSize));
+   }
+
+   BinaryDocument::Header header = {};
+   std::memcpy(header.magic, k_Magic, sizeof(k_Magic));
+   header.version       = BinaryDocument::k_Version;
+   header.byteOrder     = k_ByteOrder;
+   header.stringCount   = static_cast<uint32_t>(types.size());
+   header.nodeCount     = static_cast<uint32_t>(doc.getNodeCount());
+   header.stringsOffset = sizeof(BinaryDocument::Header);
+   header.nodesOffset   = alignUp(header.stringsOffset + types.size() * sizeof(BinaryDocument::StringRef));
+   header.indexOffset   = alignUp(header.nodesOffset + doc.getNodeCount() * sizeof(BinaryDocument::Node));
+   header.blockCount    = blockCount;
+   header.textOffset    = alignUp(header.indexOffset + (types.size() + 1 + blockCount) * sizeof(uint32_t));
+   header.textSize      = textSize;
+
+   uint64_t offset = 0;
+   writeRecord(sink, header);
+   offset += sizeof(header);
+
+   /*
+    * second pass: the tables, then the text in the same order
+    */
+   uint32_t textOffset = 0;
+   for (const auto name : typeNames)
+   {
+      const auto length = static_cast<uint32_t>(name.size());
+      writeRecord(sink, BinaryDocument::StringRef{textOffset, length});
+      textOffset += length;
+      offset += sizeof(BinaryDocument::StringRef);
+   }
+
+   writePadding(sink, offset);
+
+   for (const auto& node : doc)
+   {
+      const bool isBlock = node.kind == samx::FlatDocument::NodeKind::Block;
+      const auto text    = isBlock ? doc.getDescription(node) : doc.getText(node);
+
+      BinaryDocument::Node record = {};
+      record.kind        = isBlock ? BinaryDocument::NodeKind::Block : BinaryDocument::NodeKind::Paragraph;
+      record.depth       = node.depth;
+      record.parent      = node.parent;
+      record.firstChild  = node.firstChild;
+      record.nextSibling = node.nextSibling;
+      record.type        = isBlock ? strings[node.type] : k_NoString;
+      record.textOffset  = textOffset;
+      record.textLength  = static_cast<uint32_t>(text.size());
+
+      writeRecord(sink, record);
+      textOffset += record.textLength;
+      offset += sizeof(record);
+   }
+
+   writePadding(sink, offset);
+
+   uint32_t typeStart = 0;
+   for (const auto type : types)
+   {
+      writeRecord(sink, typeStart);
+      typeStart += static_cast<uint32_t>(index.getBlocksOfType(type).size());
+   }
+   writeRecord(sink, typeStart);
+
+   for (const auto type : types)
+   {
+      const auto blocks = index.getBlocksOfType(type);
+      sink.write(std::string_view(reinterpret_cast<const char*>(blocks.begin()), blocks.size() * sizeof(uint32_t)));
+   }
+
+   offset += (types.size() + 1 + blockCount) * sizeof(uint32_t);
+   writePadding(sink, offset);
+
+   for (const auto name : typeNames)
+   {
+      sink.write(name);
+   }
+
+   for (const auto& node : doc)
+   {
+      sink.write((node.kind == samx::FlatDocument::NodeKind::Block) ? doc.getDescription(node) : doc.getText(node));
+   }
+}
+
+} // namespace
+
+samx::BinaryDocument::BinaryDocument(std::string_view bytes)
+{
+   if ((bytes.size() < sizeof(Header)) || !hasSignature(bytes))
+   {
+      throw std::runtime_error("Not a binary SAMx document");
+   }
+
+   if ((reinterpret_cast<uintptr_t>(bytes.data()) % k_Alignment) != 0)
+   {
+      throw std::runtime_error("Binary SAMx document is not aligned");
+   }
+
+   m_header = reinterpret_cast<const Header*>(bytes.data());
+
+   if (m_header->byteOrder != k_ByteOrder)
+   {
+      throw std::runtime_error("Binary SAMx document was written with a different byte order");
+   }
+
+   if (m_header->version != k_Version)
+   {
+      throw std::runtime_error(
+         fmt::format("Unsupported binary SAMx document version {}; expected {}", m_header->version, k_Version));
+   }
+
+   validate(bytes.size());
+}
+
+samx::BinaryDocument samx::BinaryDocument::load(const char* path)
+{
+   auto file = std::make_shared<const MappedFile>(path);
+
+   // mappings are page aligned
+   BinaryDocument doc{file->getContents()};
+   doc.m_file = std::move(file);
+
+   return doc;
+}
+
+bool samx::BinaryDocument::hasSignature(std::string_view bytes) noexcept
+{
+   return (bytes.size() >= sizeof(k_Magic)) && (std::memcmp(bytes.data(), k_Magic, sizeof(k_Magic)) == 0);
+}
+
+/*
+ * Checks every offset and link once, so that the accessors and walk need no checks.
+ */
+void samx::BinaryDocument::validate(size_t size)
+{
+   const auto& header = *m_header;
+
+   const auto fits = [size](uint64_t offset, uint64_t count, uint64_t recordSize) {
+      return (offset % k_Alignment == 0) && (offset <= size) && (count <= (size - offset) / recordSize);
+   };
+
+   if (!fits(header.stringsOffset, header.stringCount, sizeof(StringRef)) ||
+       !fits(header.nodesOffset, header.nodeCount, sizeof(Node)) ||
+       !fits(header.indexOffset, uint64_t{header.stringCount} + 1 + header.blockCount, sizeof(uint32_t)) ||
+       !fits(header.textOffset, header.textSize, 1) || (header.textSize > k_MaxTextSize))
+   {
+      throw std::runtime_error("Truncated binary SAMx document");
+   }
+
+   const char* const base = reinterpret_cast<const char*>(m_header);
+
+   m_strings   = reinterpret_cast<const StringRef*>(base + header.stringsOffset);
+   m_nodes     = reinterpret_cast<const Node*>(base + header.nodesOffset);
+   m_typeStart = reinterpret_cast<const uint32_t*>(base + header.indexOffset);
+   m_blocks    = reinterpret_cast<const NodeId*>(m_typeStart + header.stringCount + 1);
+   m_text      = std::string_view(base + header.textOffset, header.textSize);
+
+   const auto inText = [&header](uint64_t offset, uint64_t length) {
+      return (offset <= header.textSize) && (length <= header.textSize - offset);
+   };
+
+   for (uint32_t ii = 0; ii < header.stringCount; ++ii)
+   {
+      if (!inText(m_strings[ii].offset, m_strings[ii].length))
+      {
+         throw std::runtime_error(fmt::format("Corrupt binary SAMx document: string {} out of range", ii));
+      }
+   }
+
+   const auto isLaterNode = [&header](NodeId id, NodeId link) {
+      return (link == k_NoNode) || ((link > id) && (link < header.nodeCount));
+   };
+
+   // as in walk, the parent of each node must be the open block or one of its ancestors
+   NodeId   openBlock  = k_NoNode;
+   uint32_t blockCount = 0;
+
+   for (NodeId id = 0; id < header.nodeCount; ++id)
+   {
+      const auto& node = m_nodes[id];
+
+      while ((openBlock != node.parent) && (openBlock != k_NoNode))
+      {
+         openBlock = m_nodes[openBlock].parent;
+      }
+
+      const bool valid = ((node.kind == NodeKind::Block) ? (node.type < header.stringCount)
+                                                        : (node.kind == NodeKind::Paragraph)) &&
+                         (openBlock == node.parent) && isLaterNode(id, node.firstChild) &&
+                         isLaterNode(id, node.nextSibling) && inText(node.textOffset, node.textLength);
+      if (!valid)
+      {
+         throw std::runtime_error(fmt::format("Corrupt binary SAMx document: node {} is not valid", id));
+      }
+
+      if (node.kind == NodeKind::Block)
+      {
+         openBlock = id;
+         ++blockCount;
+      }
+   }
+
+   /*
+    * every block is listed exactly once, under its type: each list holds distinct blocks of
+    * its type in ascending order, and the lists add up to the number of blocks
+    */
+   if ((m_typeStart[0] != 0) || (m_typeStart[header.stringCount] != header.blockCount) ||
+       (header.blockCount != blockCount))
+   {
+      throw std::runtime_error("Corrupt binary SAMx document: block index does not match the nodes");
+   }
+
+   for (uint32_t type = 0; type < header.stringCount; ++type)
+   {
+      if ((m_typeStart[type] > m_typeStart[type + 1]) || (m_typeStart[type + 1] > header.blockCount))
+      {
+         throw std::runtime_error(fmt::format("Corrupt binary SAMx document: block index of type {} out of range", type));
+      }
+
+      NodeId previous = k_NoNode;
+      for (const auto id : getBlocksOfType(type))
+      {
+         const bool valid = (id < header.nodeCount) && (m_nodes[id].kind == NodeKind::Block) &&
+                            (m_nodes[id].type == type) && ((previous == k_NoNode) || (id > previous));
+         if (!valid)
+         {
+            throw std::runtime_error(fmt::format("Corrupt binary SAMx document: block index of type {} is not valid", type));
+         }
+
+         previous = id;
+      }
+   }
+}
+
+size_t samx::BinaryDocument::getBlockCount() const noexcept
+{
+   size_t count = 0;
+   for (NodeId id = getNodeCount() > 0 ? 0 : k_NoNode; id != k_NoNode; id = m_nodes[id].nextSibling)
+   {
+      ++count;
+   }
+
+   return count;
+}
+
+std::optional<uint32_t> samx::BinaryDocument::findType(std::string_view type) const noexcept
+{
+   // documents use few distinct types; a scan of the string table beats building a map
+   for (uint32_t ii = 0; ii < m_header->stringCount; ++ii)
+   {
+      if (m_text.substr(m_strings[ii].offset, m_strings[ii].length) == type)
+      {
+         return ii;
+      }
+   }
+
+   return std::nullopt;
+}
+
+std::string samx::toBinary(const FlatDocument& doc)
+{
+   std::string bytes;
+   BufferSink  sink{bytes};
+
+   serialize(sink, doc);
+
+   return bytes;
+}
+
+void samx::writeBinary(FileSink& sink, const FlatDocument& doc)
+{
+   serialize(sink, doc);
+}
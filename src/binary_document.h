@@ -0,0 +1,224 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#ifndef SAMX_BINARY_DOCUMENT_H_INCLUDED
+#define SAMX_BINARY_DOCUMENT_H_INCLUDED
+
+#include "block_index.h"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace samx
+{
+
+class FileSink;
+class FlatDocument;
+class MappedFile;
+
+/*
+ * Read-only document over its binary serialization, used in place: nothing is copied or
+ * allocated per node, so a memory-mapped file is ready as soon as it is validated.
+ *
+ * Layout, in native byte order (files from a machine with the other order are rejected):
+ *
+ *    Header
+ *    StringRef[stringCount]   distinct block types, as ranges of the text
+ *    Node[nodeCount]          in document order, linked by index like FlatDocument nodes
+ *    uint32_t[stringCount+1]  start of the blocks of each type in the block table
+ *    NodeId[blockCount]       blocks grouped by type, in document order within a type
+ *    text                     block types, block descriptions and paragraph text
+ *
+ * The tables start at multiples of 8 bytes.
+ */
+class BinaryDocument
+{
+public:
+   using NodeId = uint32_t;
+
+   static constexpr NodeId   k_NoNode  = UINT32_MAX;
+   static constexpr uint32_t k_Version = 2;
+
+   enum class NodeKind : uint8_t
+   {
+      Block,
+      Paragraph,
+   };
+
+   struct Header
+   {
+      char     magic[8];
+      uint32_t version;
+      uint32_t byteOrder;
+      uint32_t stringCount;
+      uint32_t nodeCount;
+      uint64_t stringsOffset;
+      uint64_t nodesOffset;
+      uint64_t textOffset;
+      uint64_t textSize;
+      uint64_t indexOffset;
+      uint32_t blockCount;
+      uint32_t reserved;
+   };
+
+   struct StringRef
+   {
+      uint32_t offset;
+      uint32_t length;
+   };
+
+   struct Node
+   {
+      NodeKind kind;
+      uint8_t  reserved;
+      uint16_t depth;
+
+      NodeId parent;
+      NodeId firstChild;
+      NodeId nextSibling;
+
+      // index of the block type in the string table
+      uint32_t type;
+
+      // paragraph text, or block description
+      uint32_t textOffset;
+      uint32_t textLength;
+   };
+
+   /*
+    * Validates the serialized bytes, which must outlive the document and be aligned to
+    * 8 bytes; throws std::runtime_error if they are not a well formed document.
+    */
+   explicit BinaryDocument(std::string_view bytes);
+
+   // maps the file; throws std::system_error if it cannot be mapped
+   static BinaryDocument load(const char* path);
+
+   static bool hasSignature(std::string_view bytes) noexcept;
+
+   size_t getNodeCount() const noexcept
+   {
+      return m_header->nodeCount;
+   }
+
+   const Node& getNode(NodeId id) const noexcept
+   {
+      return m_nodes[id];
+   }
+
+   std::string_view getType(const Node& node) const noexcept
+   {
+      const auto& type = m_strings[node.type];
+      return m_text.substr(type.offset, type.length);
+   }
+
+   std::string_view getDescription(const Node& node) const noexcept
+   {
+      return m_text.substr(node.textOffset, node.textLength);
+   }
+
+   std::string_view getText(const Node& node) const noexcept
+   {
+      return m_text.substr(node.textOffset, node.textLength);
+   }
+
+   // number of top level elements
+   size_t getBlockCount() const noexcept;
+
+   /*
+    * Block type index, same as BlockIndex.
+    */
+   size_t getTypeCount() const noexcept
+   {
+      return m_header->stringCount;
+   }
+
+   std::optional<uint32_t> findType(std::string_view type) const noexcept;
+
+   NodeSpan getBlocksOfType(uint32_t type) const noexcept
+   {
+      return NodeSpan{m_blocks + m_typeStart[type], m_blocks + m_typeStart[type + 1]};
+   }
+
+   uint32_t getTypeOf(NodeId id) const noexcept
+   {
+      return m_nodes[id].type;
+   }
+
+   /*
+    * Same as FlatDocument::walk.
+    */
+   template <typename Visitor>
+   void walk(Visitor& visitor) const
+   {
+      NodeId openBlock = k_NoNode;
+
+      for (NodeId id = 0; id < getNodeCount(); ++id)
+      {
+         const Node& node = m_nodes[id];
+
+         while (openBlock != node.parent)
+         {
+            visitor.leaveBlock();
+            openBlock = m_nodes[openBlock].parent;
+         }
+
+         if (node.kind == NodeKind::Block)
+         {
+            visitor.enterBlock(getType(node), getDescription(node));
+            openBlock = id;
+         }
+         else
+         {
+            visitor.paragraph(getText(node));
+         }
+      }
+
+      while (openBlock != k_NoNode)
+      {
+         visitor.leaveBlock();
+         openBlock = m_nodes[openBlock].parent;
+      }
+   }
+
+private:
+   void validate(size_t size);
+
+   std::shared_ptr<const MappedFile> m_file;
+
+   const Header*    m_header    = nullptr;
+   const StringRef* m_strings   = nullptr;
+   const Node*      m_nodes     = nullptr;
+   const uint32_t*  m_typeStart = nullptr;
+   const NodeId*    m_blocks    = nullptr;
+   std::string_view m_text;
+};
+
+/*
+ * Serializes a document; block types are stored once.
+ */
+std::string toBinary(const FlatDocument& doc);
+
+// throws std::system_error if writing fails
+void writeBinary(FileSink& sink, const FlatDocument& doc);
+
+} // namespace samx
+
+#endif // SAMX_BINARY_DOCUMENT_H_INCLUDED
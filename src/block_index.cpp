@@ -0,0 +1,96 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "block_index.h"
+
+#include "flat_document.h"
+
+samx::BlockIndex::BlockIndex(const FlatDocument& doc)
+{
+   for (const auto& node : doc)
+   {
+      if (node.kind == FlatDocument::NodeKind::Block)
+      {
+         addBlock(node.type);
+      }
+      else
+      {
+         addParagraph();
+      }
+   }
+
+   finish();
+}
+
+void samx::BlockIndex::addBlock(SymbolId type)
+{
+   if (type >= m_typeStart.size())
+   {
+      m_typeStart.resize(type + 1, 0);
+   }
+
+   m_blocks.push_back(m_nodeCount++);
+   m_blockTypes.push_back(type);
+   ++m_typeStart[type];
+}
+
+void samx::BlockIndex::finish()
+{
+   /*
+    * place the blocks of each type after the blocks of the previous types, keeping the
+    * document order within a type
+    */
+   std::vector<uint32_t> next(m_typeStart.size(), 0);
+
+   uint32_t start = 0;
+   for (size_t type = 0; type < m_typeStart.size(); ++type)
+   {
+      next[type] = start;
+      start += m_typeStart[type];
+   }
+
+   std::vector<uint32_t> grouped(m_blocks.size());
+   for (size_t ii = 0; ii < m_blocks.size(); ++ii)
+   {
+      grouped[next[m_blockTypes[ii]]++] = m_blocks[ii];
+   }
+
+   m_blocks = std::move(grouped);
+   m_blockTypes.clear();
+   m_blockTypes.shrink_to_fit();
+
+   // after placing, the next slot of each type is the start of the following one
+   m_typeStart.assign(1, 0);
+   m_typeStart.insert(m_typeStart.end(), next.cbegin(), next.cend());
+}
+
+void samx::IndexingHandler::onBlockStart(std::string_view type, std::string_view description)
+{
+   const auto id = m_doc.beginBlock(type, description);
+   m_index.addBlock(m_doc.getNode(id).type);
+}
+
+void samx::IndexingHandler::onBlockEnd()
+{
+   m_doc.endBlock();
+}
+
+void samx::IndexingHandler::onParagraph(const std::vector<std::string_view>& segments)
+{
+   m_doc.addParagraphSegments(segments);
+   m_index.addParagraph();
+}
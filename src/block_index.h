@@ -0,0 +1,163 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#ifndef SAMX_BLOCK_INDEX_H_INCLUDED
+#define SAMX_BLOCK_INDEX_H_INCLUDED
+
+#include "document_handler.h"
+#include "symbol_table.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace samx
+{
+
+class FlatDocument;
+
+/*
+ * Contiguous run of node ids.
+ */
+class NodeSpan
+{
+public:
+   NodeSpan() = default;
+
+   NodeSpan(const uint32_t* first, const uint32_t* last) noexcept : m_first{first}, m_last{last}
+   {
+   }
+
+   const uint32_t* begin() const noexcept
+   {
+      return m_first;
+   }
+
+   const uint32_t* end() const noexcept
+   {
+      return m_last;
+   }
+
+   size_t size() const noexcept
+   {
+      return static_cast<size_t>(m_last - m_first);
+   }
+
+   bool empty() const noexcept
+   {
+      return m_first == m_last;
+   }
+
+private:
+   const uint32_t* m_first = nullptr;
+   const uint32_t* m_last  = nullptr;
+};
+
+/*
+ * Secondary index of a FlatDocument: the blocks of each type, in document order. Types
+ * are the SymbolIds of the document's SymbolTable, and their blocks are stored back to
+ * back so that a lookup is one slice.
+ *
+ * The index is built from the nodes in document order, either while the document is
+ * parsed (see IndexingHandler) or from an existing document.
+ */
+class BlockIndex
+{
+public:
+   // empty, to be filled by addBlock and addParagraph, then finish
+   BlockIndex() = default;
+
+   explicit BlockIndex(const FlatDocument& doc);
+
+   BlockIndex(const BlockIndex& other) = delete;
+   BlockIndex(BlockIndex&& other)      = default;
+   ~BlockIndex()                       = default;
+   BlockIndex& operator=(const BlockIndex& other) = delete;
+   BlockIndex& operator=(BlockIndex&& other) = default;
+
+   // the next node is a block of the given type
+   void addBlock(SymbolId type);
+
+   // the next node is a paragraph
+   void addParagraph() noexcept
+   {
+      ++m_nodeCount;
+   }
+
+   // groups the blocks by type, after the last node; the lookups are valid from then on
+   void finish();
+
+   // one more than the highest type with blocks
+   size_t getTypeCount() const noexcept
+   {
+      return m_typeStart.empty() ? 0 : m_typeStart.size() - 1;
+   }
+
+   // empty for the types of the SymbolTable that this document does not use
+   NodeSpan getBlocksOfType(SymbolId type) const noexcept
+   {
+      if (type >= getTypeCount())
+      {
+         return NodeSpan{};
+      }
+
+      return NodeSpan{m_blocks.data() + m_typeStart[type], m_blocks.data() + m_typeStart[type + 1]};
+   }
+
+private:
+   uint32_t m_nodeCount = 0;
+
+   /*
+    * blocks of type t are m_blocks[m_typeStart[t]] up to m_blocks[m_typeStart[t + 1]];
+    * until finish, m_typeStart holds the block count of each type and m_blocks holds the
+    * blocks in document order, with their types in m_blockTypes
+    */
+   std::vector<uint32_t> m_typeStart;
+   std::vector<uint32_t> m_blocks;
+   std::vector<SymbolId> m_blockTypes;
+};
+
+/*
+ * Builds a FlatDocument and its BlockIndex from the parser events, in a single pass,
+ * without building a Document first.
+ */
+class IndexingHandler : public DocumentHandler
+{
+public:
+   IndexingHandler(FlatDocument& doc, BlockIndex& index) noexcept : m_doc{doc}, m_index{index}
+   {
+   }
+
+   void onBlockStart(std::string_view type, std::string_view description) override;
+   void onBlockEnd() override;
+   void onParagraph(const std::vector<std::string_view>& segments) override;
+
+   // after the last event
+   void finish()
+   {
+      m_index.finish();
+   }
+
+private:
+   FlatDocument& m_doc;
+   BlockIndex&   m_index;
+};
+
+} // namespace samx
+
+#endif // SAMX_BLOCK_INDEX_H_INCLUDED
@@ -0,0 +1,65 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "command_line.h"
+
+#include <charconv>
+#include <fstream>
+#include <iostream>
+#include <system_error>
+
+std::optional<size_t> samx::parseCount(std::string_view text) noexcept
+{
+   size_t value = 0;
+
+   const char* const end    = text.data() + text.size();
+   const auto        result = std::from_chars(text.data(), end, value);
+   if ((result.ec != std::errc{}) || (result.ptr != end))
+   {
+      return std::nullopt;
+   }
+
+   return value;
+}
+
+bool samx::readFileList(const char* listPath, std::vector<std::string>& paths)
+{
+   const bool useStandardInput = std::string_view{listPath} == "-";
+
+   std::ifstream listFile;
+   if (!useStandardInput)
+   {
+      listFile.open(listPath);
+   }
+
+   std::istream& input = useStandardInput ? std::cin : listFile;
+   if (!input)
+   {
+      return false;
+   }
+
+   std::string line;
+   while (std::getline(input, line))
+   {
+      if (!line.empty())
+      {
+         paths.push_back(line);
+      }
+   }
+
+   return !input.bad();
+}
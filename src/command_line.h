@@ -0,0 +1,44 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#ifndef SAMX_COMMAND_LINE_H_INCLUDED
+#define SAMX_COMMAND_LINE_H_INCLUDED
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace samx
+{
+
+/*
+ * Parses a decimal count, such as a thread count; returns nullopt if the text is not only
+ * digits or if the value does not fit.
+ */
+std::optional<size_t> parseCount(std::string_view text) noexcept;
+
+/*
+ * Appends the paths listed in a file, one per line, skipping empty lines; "-" reads the
+ * list from the standard input. Returns false if the list cannot be read.
+ */
+bool readFileList(const char* listPath, std::vector<std::string>& paths);
+
+} // namespace samx
+
+#endif // SAMX_COMMAND_LINE_H_INCLUDED
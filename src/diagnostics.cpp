@@ -0,0 +1,55 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "diagnostics.h"
+
+#include <fmt/core.h>
+
+std::string samx::format(const Diagnostic& diagnostic)
+{
+   switch (diagnostic.code)
+   {
+   case DiagnosticCode::NoPreviousIndent:
+      return fmt::format("No previous indent level; current level: {}; observed: {}",
+                         diagnostic.currentIndent,
+                         diagnostic.observedIndent);
+
+   case DiagnosticCode::ExcessiveDeindent:
+      return fmt::format(
+         "Excessive de-indent; current level: {}; observed: {}", diagnostic.currentIndent, diagnostic.observedIndent);
+
+   case DiagnosticCode::MisalignedDeindent:
+      return fmt::format("Excessive de-indent; current level: {}; observed: {}; expected: {}",
+                         diagnostic.currentIndent,
+                         diagnostic.observedIndent,
+                         diagnostic.expectedIndent);
+   }
+
+   return "Unknown error";
+}
+
+void samx::Diagnostics::report(std::ostream& os) const
+{
+   for (const auto& diagnostic : m_records)
+   {
+      os << "Error on line " << diagnostic.line << ": " << format(diagnostic) << '\n';
+   }
+
+   if (m_errorCount > m_records.size())
+   {
+      os << (m_errorCount - m_records.size()) << " more errors not shown\n";
+   }
+}
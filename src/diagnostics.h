@@ -0,0 +1,119 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef SAMX_DIAGNOSTICS_H_INCLUDED
+#define SAMX_DIAGNOSTICS_H_INCLUDED
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace samx
+{
+
+enum class DiagnosticCode
+{
+   // de-indent at the top level
+   NoPreviousIndent,
+
+   // de-indent past all the enclosing levels
+   ExcessiveDeindent,
+
+   // de-indent between two enclosing levels; expectedIndent is the next one out
+   MisalignedDeindent,
+};
+
+/*
+ * An error found in the input; plain data, so that recording it costs no allocation.
+ */
+struct Diagnostic
+{
+   DiagnosticCode code;
+   size_t         line;
+   size_t         currentIndent;
+   size_t         observedIndent;
+   size_t         expectedIndent;
+};
+
+std::string format(const Diagnostic& diagnostic);
+
+/*
+ * Collects the diagnostics for an input. Only the first errorLimit ones are kept, but
+ * all are counted; the text is formatted when they are reported.
+ */
+class Diagnostics
+{
+public:
+   static constexpr size_t k_DefaultErrorLimit = 100;
+
+   explicit Diagnostics(size_t errorLimit = k_DefaultErrorLimit) : m_errorLimit{errorLimit}
+   {
+   }
+
+   void add(const Diagnostic& diagnostic)
+   {
+      ++m_errorCount;
+      if (m_records.size() < m_errorLimit)
+      {
+         m_records.push_back(diagnostic);
+         m_records.back().line += m_lineOffset;
+      }
+   }
+
+   /*
+    * Added to the line of the diagnostics recorded from now on, for inputs that are a part
+    * of a larger source, starting after that many lines.
+    */
+   void setLineOffset(size_t lineOffset) noexcept
+   {
+      m_lineOffset = lineOffset;
+   }
+
+   bool empty() const noexcept
+   {
+      return m_errorCount == 0;
+   }
+
+   size_t getErrorCount() const noexcept
+   {
+      return m_errorCount;
+   }
+
+   const std::vector<Diagnostic>& getRecords() const noexcept
+   {
+      return m_records;
+   }
+
+   void clear() noexcept
+   {
+      m_records.clear();
+      m_errorCount = 0;
+   }
+
+   // one line per kept record, then the number of errors over the limit, if any
+   void report(std::ostream& os) const;
+
+private:
+   size_t                  m_errorLimit;
+   size_t                  m_errorCount = 0;
+   size_t                  m_lineOffset = 0;
+   std::vector<Diagnostic> m_records;
+};
+
+} // namespace samx
+
+#endif // SAMX_DIAGNOSTICS_H_INCLUDED
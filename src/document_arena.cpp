@@ -0,0 +1,66 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "document_arena.h"
+
+samx::DocumentArena::DocumentArena(size_t initialSize)
+{
+   initialize(initialSize);
+}
+
+void samx::DocumentArena::initialize(size_t size)
+{
+   m_pool.reset();
+   m_arena.reset();
+
+   m_buffer.reset(new std::byte[size]);
+   m_bufferSize = size;
+
+   m_arena.emplace(m_buffer.get(), m_bufferSize, &m_overflow);
+   m_pool.emplace(&m_arena.value());
+}
+
+void samx::DocumentArena::reset()
+{
+   const auto overflow = m_overflow.getAllocated();
+
+   m_pool->release();
+   m_arena->release();
+   m_overflow.clear();
+
+   if (overflow > 0)
+   {
+      initialize(m_bufferSize + overflow);
+   }
+}
+
+void* samx::DocumentArena::OverflowCounter::do_allocate(size_t bytes, size_t alignment)
+{
+   void* ptr = std::pmr::new_delete_resource()->allocate(bytes, alignment);
+   m_allocated += bytes;
+   return ptr;
+}
+
+void samx::DocumentArena::OverflowCounter::do_deallocate(void* ptr, size_t bytes, size_t alignment)
+{
+   std::pmr::new_delete_resource()->deallocate(ptr, bytes, alignment);
+}
+
+bool samx::DocumentArena::OverflowCounter::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+   return this == &other;
+}
@@ -0,0 +1,103 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#ifndef SAMX_DOCUMENT_ARENA_H_INCLUDED
+#define SAMX_DOCUMENT_ARENA_H_INCLUDED
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+
+namespace samx
+{
+
+/*
+ * Arena holding the nodes of one or more Documents. Nothing is returned to the system
+ * allocator when individual nodes are destroyed; the memory is released all at once, when
+ * the arena is reset or destroyed.
+ */
+class DocumentArena
+{
+public:
+   static constexpr size_t k_DefaultSize = 64 * 1024;
+
+   explicit DocumentArena(size_t initialSize = k_DefaultSize);
+
+   DocumentArena(const DocumentArena& other) = delete;
+   DocumentArena(DocumentArena&& other)      = delete;
+   ~DocumentArena()                          = default;
+   DocumentArena& operator=(const DocumentArena& other) = delete;
+   DocumentArena& operator=(DocumentArena&& other) = delete;
+
+   std::pmr::memory_resource* getResource() noexcept
+   {
+      return &m_pool.value();
+   }
+
+   /*
+    * Releases everything allocated so far; all Documents using this arena must have been
+    * destroyed. The memory is kept for reuse, and grown to the largest size needed so far
+    * so batch runs settle on a single allocation.
+    */
+   void reset();
+
+   // bytes reserved: the initial buffer plus the chunks added as the arena grew
+   size_t getCapacity() const noexcept
+   {
+      return m_bufferSize + m_overflow.getAllocated();
+   }
+
+private:
+   /*
+    * Forwards to the default resource, keeping track of how much the arena had to grow.
+    */
+   class OverflowCounter : public std::pmr::memory_resource
+   {
+   public:
+      size_t getAllocated() const noexcept
+      {
+         return m_allocated;
+      }
+
+      void clear() noexcept
+      {
+         m_allocated = 0;
+      }
+
+   private:
+      void* do_allocate(size_t bytes, size_t alignment) override;
+      void  do_deallocate(void* ptr, size_t bytes, size_t alignment) override;
+      bool  do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+      size_t m_allocated = 0;
+   };
+
+   void initialize(size_t size);
+
+   std::unique_ptr<std::byte[]>                       m_buffer;
+   size_t                                             m_bufferSize = 0;
+   OverflowCounter                                    m_overflow;
+   std::optional<std::pmr::monotonic_buffer_resource> m_arena;
+
+   // recycles the buffers given up by growing vectors, which the monotonic arena alone would waste
+   std::optional<std::pmr::unsynchronized_pool_resource> m_pool;
+};
+
+} // namespace samx
+
+#endif // SAMX_DOCUMENT_ARENA_H_INCLUDED
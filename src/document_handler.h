@@ -0,0 +1,79 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#ifndef SAMX_DOCUMENT_HANDLER_H_INCLUDED
+#define SAMX_DOCUMENT_HANDLER_H_INCLUDED
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace samx
+{
+
+/*
+ * Receives the elements of a document from the parser, in document order, as they are
+ * recognized: a block is reported by onBlockStart, then its contents, then onBlockEnd.
+ * The parser itself only keeps track of the open blocks, so a handler that does not
+ * build a tree parses in memory bounded by the nesting depth.
+ *
+ * The strings are only valid for the duration of the call, unless the parsed input
+ * outlives the handler.
+ */
+class DocumentHandler
+{
+public:
+   virtual ~DocumentHandler() = default;
+
+   virtual void onBlockStart(std::string_view type, std::string_view description) = 0;
+   virtual void onBlockEnd()                                                      = 0;
+
+   // the paragraph text is made of the segments, separated by a single space
+   virtual void onParagraph(const std::vector<std::string_view>& segments) = 0;
+
+   /*
+    * A block insertion (<<<resource) in place of an element; see InsertionResolver for
+    * handlers that expand them. Other handlers reject them.
+    */
+   virtual void onInsertion(std::string_view resource)
+   {
+      throw std::runtime_error("Failed to parse input: block insertion <<<" + std::string{resource} +
+                               " is not supported here");
+   }
+
+   /*
+    * The text of the elements reported next, up to the end of the insertion being expanded,
+    * belongs to the owner; handlers that reference the text instead of copying it keep the
+    * owner alive. Called by InsertionResolver.
+    */
+   virtual void onInsertedText(std::shared_ptr<const void> /* owner */)
+   {
+   }
+
+protected:
+   DocumentHandler()                             = default;
+   DocumentHandler(const DocumentHandler& other) = default;
+   DocumentHandler(DocumentHandler&& other)      = default;
+   DocumentHandler& operator=(const DocumentHandler& other) = default;
+   DocumentHandler& operator=(DocumentHandler&& other) = default;
+};
+
+} // namespace samx
+
+#endif // SAMX_DOCUMENT_HANDLER_H_INCLUDED
@@ -0,0 +1,177 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#ifndef SAMX_DOCUMENT_PRINTER_H_INCLUDED
+#define SAMX_DOCUMENT_PRINTER_H_INCLUDED
+
+#include "binary_document.h"
+#include "flat_document.h"
+#include "samx_parser.h"
+
+#include <algorithm>
+#include <functional>
+#include <string_view>
+
+namespace samx
+{
+
+/*
+ * Prints documents in the normalized text layout, indenting nested content by three
+ * spaces per level. See output_sink.h for the Sink interface.
+ */
+template <typename Sink>
+class DocumentPrinter
+{
+public:
+   explicit DocumentPrinter(Sink& sink) : m_sink{sink}
+   {
+   }
+
+   size_t getWritten() const noexcept
+   {
+      return m_written;
+   }
+
+   /*
+    * The layout has no prologue or epilogue, and nothing depends on the elements already
+    * printed; these are for the callers of the renderers (see document_renderer.h).
+    */
+   void begin()
+   {
+   }
+
+   void end()
+   {
+   }
+
+   void resume()
+   {
+   }
+
+   void operator()(const Paragraph& para)
+   {
+      printIndent();
+
+      bool first = true;
+      para.forEachSegment([this, &first](std::string_view segment) {
+         if (!first)
+         {
+            put(' ');
+         }
+         write(segment);
+         first = false;
+      });
+
+      write("\n\n");
+   }
+
+   void operator()(const Block& block)
+   {
+      enterBlock(block.getType(), block.getDescription());
+      block.forEachElement(std::ref(*this));
+      leaveBlock();
+   }
+
+   /*
+    * FlatDocument visitor
+    */
+   void paragraph(std::string_view text)
+   {
+      printIndent();
+      write(text);
+      write("\n\n");
+   }
+
+   void enterBlock(std::string_view type, std::string_view description)
+   {
+      printIndent();
+      write(type);
+      put(' ');
+      write(description);
+      write("\n\n");
+      ++m_level;
+   }
+
+   void leaveBlock()
+   {
+      --m_level;
+      put('\n');
+   }
+
+private:
+   static constexpr std::string_view k_Spaces = "                                                                ";
+   static constexpr size_t           k_Indent = 3;
+
+   void printIndent()
+   {
+      // a single write for the usual depths
+      for (size_t remaining = m_level * k_Indent; remaining > 0;)
+      {
+         const auto count = std::min(remaining, k_Spaces.size());
+         write(k_Spaces.substr(0, count));
+         remaining -= count;
+      }
+   }
+
+   void write(std::string_view text)
+   {
+      m_sink.write(text);
+      m_written += text.size();
+   }
+
+   void put(char ch)
+   {
+      m_sink.put(ch);
+      ++m_written;
+   }
+
+   Sink&  m_sink;
+   size_t m_level   = 0;
+   size_t m_written = 0;
+};
+
+/*
+ * Prints the document to the sink, returning the number of bytes written; print and
+ * operator<< are the std::ostream versions.
+ */
+template <typename Sink>
+size_t printTo(Sink& sink, const Document& doc)
+{
+   DocumentPrinter<Sink> printer{sink};
+   doc.forEachElement(std::ref(printer));
+   return printer.getWritten();
+}
+
+template <typename Sink>
+size_t printTo(Sink& sink, const FlatDocument& doc)
+{
+   DocumentPrinter<Sink> printer{sink};
+   doc.walk(printer);
+   return printer.getWritten();
+}
+
+template <typename Sink>
+size_t printTo(Sink& sink, const BinaryDocument& doc)
+{
+   DocumentPrinter<Sink> printer{sink};
+   doc.walk(printer);
+   return printer.getWritten();
+}
+
+} // namespace samx
+
+#endif // SAMX_DOCUMENT_PRINTER_H_INCLUDED
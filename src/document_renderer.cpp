@@ -0,0 +1,175 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "document_renderer.h"
+
+#include "thread_pool.h"
+
+#include <cstdio>
+#include <numeric>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+samx::EscapeTable makeMarkupEscapes() noexcept
+{
+   samx::EscapeTable table;
+   table.set('&', "&amp;");
+   table.set('<', "&lt;");
+   table.set('>', "&gt;");
+   table.set('"', "&quot;");
+   table.set('\'', "&#39;");
+   return table;
+}
+
+samx::EscapeTable makeJsonEscapes() noexcept
+{
+   samx::EscapeTable table;
+
+   for (int ch = 0; ch < 0x20; ++ch)
+   {
+      char replacement[8];
+      std::snprintf(replacement, sizeof(replacement), "\\u%04x", ch);
+      table.set(static_cast<char>(ch), replacement);
+   }
+
+   table.set('\b', "\\b");
+   table.set('\f', "\\f");
+   table.set('\n', "\\n");
+   table.set('\r', "\\r");
+   table.set('\t', "\\t");
+   table.set('"', "\\\"");
+   table.set('\\', "\\\\");
+   return table;
+}
+
+// enough chunks that a few large elements do not leave the other threads idle
+constexpr size_t k_ChunksPerThread = 4;
+
+/*
+ * Renders the count top level elements starting at first, as part of the whole document.
+ */
+template <template <typename> class Renderer>
+void renderElements(std::string& buffer, const samx::Document& doc, size_t first, size_t count)
+{
+   samx::BufferSink           sink{buffer};
+   Renderer<samx::BufferSink> renderer{sink};
+
+   if (first == 0)
+   {
+      renderer.begin();
+   }
+   else
+   {
+      renderer.resume();
+   }
+
+   doc.forEachElement(first, count, std::ref(renderer));
+
+   if (first + count == doc.getBlockCount())
+   {
+      renderer.end();
+   }
+}
+
+using ElementRenderer = void (*)(std::string& buffer, const samx::Document& doc, size_t first, size_t count);
+
+ElementRenderer getElementRenderer(samx::OutputFormat format) noexcept
+{
+   switch (format)
+   {
+   case samx::OutputFormat::Text:
+      break;
+
+   case samx::OutputFormat::Html:
+      return renderElements<samx::HtmlRenderer>;
+
+   case samx::OutputFormat::Xml:
+      return renderElements<samx::XmlRenderer>;
+
+   case samx::OutputFormat::Json:
+      return renderElements<samx::JsonRenderer>;
+   }
+
+   return renderElements<samx::DocumentPrinter>;
+}
+
+} // namespace
+
+const samx::EscapeTable samx::k_MarkupEscapes = makeMarkupEscapes();
+
+const samx::EscapeTable samx::k_JsonEscapes = makeJsonEscapes();
+
+std::optional<samx::OutputFormat> samx::parseOutputFormat(std::string_view name) noexcept
+{
+   if (name == "text")
+   {
+      return OutputFormat::Text;
+   }
+
+   if (name == "html")
+   {
+      return OutputFormat::Html;
+   }
+
+   if (name == "xml")
+   {
+      return OutputFormat::Xml;
+   }
+
+   if (name == "json")
+   {
+      return OutputFormat::Json;
+   }
+
+   return std::nullopt;
+}
+
+size_t samx::renderParallel(FileSink& sink, const Document& doc, OutputFormat format, ThreadPool& pool)
+{
+   if (pool.getThreadCount() < 2)
+   {
+      // nothing to gain from holding the output
+      return renderTo(sink, doc, format);
+   }
+
+   const auto render = getElementRenderer(format);
+
+   const size_t elementCount = doc.getBlockCount();
+   const size_t chunkCount   = std::max<size_t>(1, std::min(elementCount, pool.getThreadCount() * k_ChunksPerThread));
+
+   std::vector<std::string> buffers(chunkCount);
+
+   for (size_t ii = 0; ii < chunkCount; ++ii)
+   {
+      const size_t first = elementCount * ii / chunkCount;
+      const size_t last  = elementCount * (ii + 1) / chunkCount;
+
+      pool.submit([render, &buffers, &doc, ii, first, last]() { render(buffers[ii], doc, first, last - first); });
+   }
+
+   pool.wait();
+
+   sink.writeBuffers(buffers);
+
+   return std::accumulate(
+      buffers.cbegin(), buffers.cend(), size_t{0}, [](size_t total, const std::string& buffer) {
+         return total + buffer.size();
+      });
+}
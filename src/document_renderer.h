@@ -0,0 +1,517 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#ifndef SAMX_DOCUMENT_RENDERER_H_INCLUDED
+#define SAMX_DOCUMENT_RENDERER_H_INCLUDED
+
+#include "binary_document.h"
+#include "document_printer.h"
+#include "flat_document.h"
+#include "output_sink.h"
+#include "samx_parser.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace samx
+{
+
+class ThreadPool;
+
+/*
+ * Output formats of validate; Text is the DocumentPrinter layout.
+ */
+enum class OutputFormat
+{
+   Text,
+   Html,
+   Xml,
+   Json,
+};
+
+// "text", "html", "xml" or "json"
+std::optional<OutputFormat> parseOutputFormat(std::string_view name) noexcept;
+
+/*
+ * The replacement of each byte, empty for the bytes that are written as they are.
+ */
+class EscapeTable
+{
+public:
+   static constexpr size_t k_MaxReplacement = 7;
+
+   void set(char ch, std::string_view replacement) noexcept
+   {
+      const auto index = static_cast<uint8_t>(ch);
+      m_lengths[index] = static_cast<uint8_t>(std::min(replacement.size(), k_MaxReplacement));
+      std::copy_n(replacement.data(), m_lengths[index], m_replacements[index].data());
+   }
+
+   // the first byte with a replacement, or end
+   const char* findSpecial(const char* begin, const char* end) const noexcept
+   {
+      const uint8_t* lengths = m_lengths.data();
+      const auto     length  = [lengths](const char* ch) {
+         return lengths[static_cast<uint8_t>(*ch)];
+      };
+
+      // one branch per 8 bytes while there is nothing to replace, which is the usual case
+      while ((end - begin >= 8) && ((length(begin) | length(begin + 1) | length(begin + 2) | length(begin + 3) |
+                                     length(begin + 4) | length(begin + 5) | length(begin + 6) |
+                                     length(begin + 7)) == 0))
+      {
+         begin += 8;
+      }
+
+      while ((begin != end) && (length(begin) == 0))
+      {
+         ++begin;
+      }
+
+      return begin;
+   }
+
+   std::string_view getReplacement(char ch) const noexcept
+   {
+      const auto index = static_cast<uint8_t>(ch);
+      return {m_replacements[index].data(), m_lengths[index]};
+   }
+
+private:
+   std::array<uint8_t, 256>                            m_lengths{};
+   std::array<std::array<char, k_MaxReplacement>, 256> m_replacements{};
+};
+
+// text and attribute values
+extern const EscapeTable k_MarkupEscapes;
+
+// string contents
+extern const EscapeTable k_JsonEscapes;
+
+/*
+ * Output shared by the renderers: counts the bytes written, and escapes text with a
+ * single lookup per byte, writing the runs of plain bytes at once.
+ */
+template <typename Sink>
+class RendererOutput
+{
+public:
+   RendererOutput(Sink& sink, const EscapeTable& escapes) : m_sink{sink}, m_escapes{escapes}
+   {
+   }
+
+   size_t getWritten() const noexcept
+   {
+      return m_written;
+   }
+
+   void write(std::string_view text)
+   {
+      m_sink.write(text);
+      m_written += text.size();
+   }
+
+   void put(char ch)
+   {
+      m_sink.put(ch);
+      ++m_written;
+   }
+
+   void writeEscaped(std::string_view text)
+   {
+      const char* runStart = text.data();
+      const char* end      = text.data() + text.size();
+
+      for (;;)
+      {
+         const char* special = m_escapes.findSpecial(runStart, end);
+         write(std::string_view(runStart, static_cast<size_t>(special - runStart)));
+         if (special == end)
+         {
+            break;
+         }
+
+         write(m_escapes.getReplacement(*special));
+         runStart = special + 1;
+      }
+   }
+
+   // the segments of a paragraph, separated by a single space
+   void writeEscaped(const Paragraph& para)
+   {
+      bool first = true;
+      para.forEachSegment([this, &first](std::string_view segment) {
+         if (!first)
+         {
+            put(' ');
+         }
+         writeEscaped(segment);
+         first = false;
+      });
+   }
+
+private:
+   Sink&              m_sink;
+   const EscapeTable& m_escapes;
+   size_t             m_written = 0;
+};
+
+// the block type without its ':'
+inline std::string_view getBlockName(std::string_view type) noexcept
+{
+   if (!type.empty() && (type.back() == ':'))
+   {
+      type.remove_suffix(1);
+   }
+
+   return type;
+}
+
+/*
+ * The renderers are visitors for the three document kinds, like DocumentPrinter, with a
+ * begin and an end call around the document; resume replaces begin when rendering the
+ * elements that follow others at the top level. Block types are identifiers, so they
+ * are written without escaping.
+ */
+
+/*
+ * A block is a section whose class is its type, with the description as a heading of its
+ * depth; paragraphs are p elements.
+ */
+template <typename Sink>
+class HtmlRenderer
+{
+public:
+   explicit HtmlRenderer(Sink& sink) : m_out{sink, k_MarkupEscapes}
+   {
+   }
+
+   size_t getWritten() const noexcept
+   {
+      return m_out.getWritten();
+   }
+
+   void begin()
+   {
+      m_out.write("<!DOCTYPE html>\n<html>\n<body>\n");
+   }
+
+   void end()
+   {
+      m_out.write("</body>\n</html>\n");
+   }
+
+   void resume()
+   {
+   }
+
+   void operator()(const Paragraph& para)
+   {
+      m_out.write("<p>");
+      m_out.writeEscaped(para);
+      m_out.write("</p>\n");
+   }
+
+   void operator()(const Block& block)
+   {
+      enterBlock(block.getType(), block.getDescription());
+      block.forEachElement(std::ref(*this));
+      leaveBlock();
+   }
+
+   void paragraph(std::string_view text)
+   {
+      m_out.write("<p>");
+      m_out.writeEscaped(text);
+      m_out.write("</p>\n");
+   }
+
+   void enterBlock(std::string_view type, std::string_view description)
+   {
+      ++m_level;
+
+      m_out.write("<section class=\"");
+      m_out.write(getBlockName(type));
+      m_out.write("\">\n");
+
+      if (!description.empty())
+      {
+         const char heading = static_cast<char>('0' + std::min<size_t>(m_level, 6));
+
+         m_out.write("<h");
+         m_out.put(heading);
+         m_out.put('>');
+         m_out.writeEscaped(description);
+         m_out.write("</h");
+         m_out.put(heading);
+         m_out.write(">\n");
+      }
+   }
+
+   void leaveBlock()
+   {
+      --m_level;
+      m_out.write("</section>\n");
+   }
+
+private:
+   RendererOutput<Sink> m_out;
+   size_t               m_level = 0;
+};
+
+/*
+ * The layout of the SAM tools: a block is an element named after its type, with the
+ * description as its title element; paragraphs are p elements. A doc element holds the
+ * top level elements.
+ */
+template <typename Sink>
+class XmlRenderer
+{
+public:
+   explicit XmlRenderer(Sink& sink) : m_out{sink, k_MarkupEscapes}
+   {
+   }
+
+   size_t getWritten() const noexcept
+   {
+      return m_out.getWritten();
+   }
+
+   void begin()
+   {
+      m_out.write("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<doc>\n");
+   }
+
+   void end()
+   {
+      m_out.write("</doc>\n");
+   }
+
+   void resume()
+   {
+   }
+
+   void operator()(const Paragraph& para)
+   {
+      m_out.write("<p>");
+      m_out.writeEscaped(para);
+      m_out.write("</p>\n");
+   }
+
+   void operator()(const Block& block)
+   {
+      enterBlock(block.getType(), block.getDescription());
+      block.forEachElement(std::ref(*this));
+      leaveBlock(block.getType());
+   }
+
+   void paragraph(std::string_view text)
+   {
+      m_out.write("<p>");
+      m_out.writeEscaped(text);
+      m_out.write("</p>\n");
+   }
+
+   void enterBlock(std::string_view type, std::string_view description)
+   {
+      m_openBlocks.push_back(type);
+
+      m_out.put('<');
+      m_out.write(getBlockName(type));
+      m_out.write(">\n");
+
+      if (!description.empty())
+      {
+         m_out.write("<title>");
+         m_out.writeEscaped(description);
+         m_out.write("</title>\n");
+      }
+   }
+
+   // the flat documents do not repeat the type
+   void leaveBlock()
+   {
+      leaveBlock(m_openBlocks.back());
+   }
+
+private:
+   void leaveBlock(std::string_view type)
+   {
+      m_openBlocks.pop_back();
+
+      m_out.write("</");
+      m_out.write(getBlockName(type));
+      m_out.write(">\n");
+   }
+
+   RendererOutput<Sink>          m_out;
+   std::vector<std::string_view> m_openBlocks;
+};
+
+/*
+ * {"elements": [...]} where a block is {"type": ..., "description": ..., "elements": [...]}
+ * and a paragraph is {"paragraph": ...}; written on a single line.
+ */
+template <typename Sink>
+class JsonRenderer
+{
+public:
+   explicit JsonRenderer(Sink& sink) : m_out{sink, k_JsonEscapes}
+   {
+   }
+
+   size_t getWritten() const noexcept
+   {
+      return m_out.getWritten();
+   }
+
+   void begin()
+   {
+      m_out.write("{\"elements\":[");
+   }
+
+   void end()
+   {
+      m_out.write("]}\n");
+   }
+
+   void resume()
+   {
+      m_first = false;
+   }
+
+   void operator()(const Paragraph& para)
+   {
+      separate();
+      m_out.write("{\"paragraph\":\"");
+      m_out.writeEscaped(para);
+      m_out.write("\"}");
+   }
+
+   void operator()(const Block& block)
+   {
+      enterBlock(block.getType(), block.getDescription());
+      block.forEachElement(std::ref(*this));
+      leaveBlock();
+   }
+
+   void paragraph(std::string_view text)
+   {
+      separate();
+      m_out.write("{\"paragraph\":\"");
+      m_out.writeEscaped(text);
+      m_out.write("\"}");
+   }
+
+   void enterBlock(std::string_view type, std::string_view description)
+   {
+      separate();
+      m_out.write("{\"type\":\"");
+      m_out.write(getBlockName(type));
+      m_out.write("\",\"description\":\"");
+      m_out.writeEscaped(description);
+      m_out.write("\",\"elements\":[");
+
+      m_first = true;
+   }
+
+   void leaveBlock()
+   {
+      m_out.write("]}");
+      m_first = false;
+   }
+
+private:
+   void separate()
+   {
+      if (!m_first)
+      {
+         m_out.put(',');
+      }
+
+      m_first = false;
+   }
+
+   RendererOutput<Sink> m_out;
+
+   // no element written yet in the current array
+   bool m_first = true;
+};
+
+/*
+ * Renders the document to the sink, returning the number of bytes written.
+ */
+template <template <typename> class Renderer, typename Sink>
+size_t renderWith(Sink& sink, const Document& doc)
+{
+   Renderer<Sink> renderer{sink};
+   renderer.begin();
+   doc.forEachElement(std::ref(renderer));
+   renderer.end();
+   return renderer.getWritten();
+}
+
+template <template <typename> class Renderer, typename Sink, typename WalkableDocument>
+size_t renderWith(Sink& sink, const WalkableDocument& doc)
+{
+   Renderer<Sink> renderer{sink};
+   renderer.begin();
+   doc.walk(renderer);
+   renderer.end();
+   return renderer.getWritten();
+}
+
+/*
+ * Same as above, in the given format; Text is the same as printTo.
+ */
+template <typename Sink, typename AnyDocument>
+size_t renderTo(Sink& sink, const AnyDocument& doc, OutputFormat format)
+{
+   switch (format)
+   {
+   case OutputFormat::Text:
+      break;
+
+   case OutputFormat::Html:
+      return renderWith<HtmlRenderer>(sink, doc);
+
+   case OutputFormat::Xml:
+      return renderWith<XmlRenderer>(sink, doc);
+
+   case OutputFormat::Json:
+      return renderWith<JsonRenderer>(sink, doc);
+   }
+
+   return renderWith<DocumentPrinter>(sink, doc);
+}
+
+/*
+ * Same as renderTo, with the top level elements split in chunks that are rendered on the
+ * pool, each into its own buffer; the buffers are then written in order. The output is the
+ * same, but held in memory until the end; with a single thread, the document is rendered
+ * directly to the sink.
+ */
+size_t renderParallel(FileSink& sink, const Document& doc, OutputFormat format, ThreadPool& pool);
+
+} // namespace samx
+
+#endif // SAMX_DOCUMENT_RENDERER_H_INCLUDED
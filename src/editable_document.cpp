@@ -0,0 +1,209 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "editable_document.h"
+
+#include "line_scanner.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+samx::EditableDocument::EditableDocument(std::string source) :
+   m_arena{std::make_unique<DocumentArena>()}, m_source{std::move(source)}
+{
+   parseAll();
+}
+
+bool samx::EditableDocument::isSectionStart(size_t lineOffset, size_t previousLineOffset) const noexcept
+{
+   const char first = m_source[lineOffset];
+   if ((first == ' ') || (first == '\n'))
+   {
+      return false;
+   }
+
+   // the previous line, without its new line, must be empty after the indentation
+   const char* const previousLine = m_source.data() + previousLineOffset;
+   const char* const previousEnd  = m_source.data() + lineOffset - 1;
+
+   return getBestLineScanner().countLeadingSpaces(previousLine, previousEnd) ==
+          static_cast<size_t>(previousEnd - previousLine);
+}
+
+size_t samx::EditableDocument::parseSections(size_t                offset,
+                                             size_t                line,
+                                             size_t                resyncOffset,
+                                             Document&             doc,
+                                             std::vector<Section>& sections,
+                                             Diagnostics&          diagnostics) const
+{
+   const auto& scanner = getBestLineScanner();
+
+   const char* const sourceBegin = m_source.data();
+   const char* const sourceEnd   = sourceBegin + m_source.size();
+
+   const auto parseSection = [this, &doc, &sections, &diagnostics](size_t begin, size_t end, size_t firstLine) {
+      const auto elementCount = doc.getBlockCount();
+
+      // the Normalizer numbers the lines of the section from 1
+      diagnostics.setLineOffset(firstLine - 1);
+      normalizeAndParse(std::string_view(m_source).substr(begin, end - begin), doc, nullptr, &diagnostics);
+
+      sections.push_back(Section{begin, firstLine, doc.getBlockCount() - elementCount});
+   };
+
+   size_t sectionOffset = offset;
+   size_t sectionLine   = line;
+   size_t lineOffset    = offset;
+   size_t lineNumber    = line;
+
+   while (true)
+   {
+      const char* const lineEnd = scanner.findNewLine(sourceBegin + lineOffset, sourceEnd);
+      if (lineEnd + 1 >= sourceEnd)
+      {
+         break;
+      }
+
+      const auto previousLineOffset = lineOffset;
+      lineOffset                    = static_cast<size_t>(lineEnd + 1 - sourceBegin);
+      ++lineNumber;
+
+      if (isSectionStart(lineOffset, previousLineOffset))
+      {
+         parseSection(sectionOffset, lineOffset, sectionLine);
+         sectionOffset = lineOffset;
+         sectionLine   = lineNumber;
+
+         if (previousLineOffset > resyncOffset)
+         {
+            return lineOffset;
+         }
+      }
+   }
+
+   parseSection(sectionOffset, m_source.size(), sectionLine);
+
+   return m_source.size();
+}
+
+void samx::EditableDocument::parseAll()
+{
+   m_document.reset();
+   m_arena->reset();
+   m_document.emplace(*m_arena);
+
+   m_sections.clear();
+   m_diagnostics.clear();
+   m_valid        = false;
+   m_reparsedSize = m_source.size();
+
+   parseSections(0, 1, std::numeric_limits<size_t>::max(), *m_document, m_sections, m_diagnostics);
+
+   m_valid = true;
+}
+
+void samx::EditableDocument::applyEdit(size_t offset, size_t length, std::string_view replacement)
+{
+   if ((offset > m_source.size()) || (length > m_source.size() - offset))
+   {
+      throw std::out_of_range("Edit is outside of the source");
+   }
+
+   // later sections move by as many lines as the edit adds
+   const auto sourceBegin  = m_source.cbegin() + static_cast<std::ptrdiff_t>(offset);
+   const auto removedLines = std::count(sourceBegin, sourceBegin + static_cast<std::ptrdiff_t>(length), '\n');
+   const auto addedLines   = std::count(replacement.cbegin(), replacement.cend(), '\n');
+
+   m_source.replace(offset, length, replacement);
+
+   if (!m_valid)
+   {
+      parseAll();
+      return;
+   }
+
+   /*
+    * Whether a line starts a section depends on the line and on the previous one, so an
+    * edit starting at the beginning of a line may join that line to the previous section.
+    */
+   const size_t anchor = (offset > 0) ? (offset - 1) : 0;
+
+   const auto firstIter =
+      std::prev(std::upper_bound(m_sections.cbegin(), m_sections.cend(), anchor, [](size_t value, const Section& section) {
+         return value < section.offset;
+      }));
+   const auto first = std::distance(m_sections.cbegin(), firstIter);
+
+   Document             replacementDoc{*m_arena, m_document->shareSymbols()};
+   std::vector<Section> sections;
+
+   m_diagnostics.clear();
+
+   size_t stop = 0;
+   try
+   {
+      stop = parseSections(
+         firstIter->offset, firstIter->line, offset + replacement.size(), replacementDoc, sections, m_diagnostics);
+   }
+   catch (...)
+   {
+      m_valid = false;
+      throw;
+   }
+
+   m_reparsedSize = stop - firstIter->offset;
+
+   // sections from the stop on are kept, shifted by the edit
+   auto last = std::distance(m_sections.cbegin(), m_sections.cend());
+   if (stop < m_source.size())
+   {
+      const auto oldStop  = stop - replacement.size() + length;
+      const auto lastIter = std::lower_bound(
+         m_sections.cbegin(), m_sections.cend(), oldStop, [](const Section& section, size_t value) {
+            return section.offset < value;
+         });
+
+      assert((lastIter != m_sections.cend()) && (lastIter->offset == oldStop));
+      last = std::distance(m_sections.cbegin(), lastIter);
+   }
+
+   const auto countElements = [](size_t partial, const Section& section) {
+      return partial + section.elementCount;
+   };
+
+   const auto sectionsBegin = m_sections.begin();
+   const auto firstElement  = std::accumulate(sectionsBegin, std::next(sectionsBegin, first), size_t{0}, countElements);
+   const auto replacedCount = std::accumulate(
+      std::next(sectionsBegin, first), std::next(sectionsBegin, last), size_t{0}, countElements);
+
+   m_document->replaceElements(firstElement, replacedCount, std::move(replacementDoc));
+
+   std::for_each(std::next(sectionsBegin, last),
+                 m_sections.end(),
+                 [&replacement, length, addedLines, removedLines](Section& section) {
+                    section.offset = section.offset + replacement.size() - length;
+                    section.line   = section.line + static_cast<size_t>(addedLines) - static_cast<size_t>(removedLines);
+                 });
+
+   m_sections.erase(std::next(sectionsBegin, first), std::next(sectionsBegin, last));
+   m_sections.insert(std::next(m_sections.begin(), first), sections.cbegin(), sections.cend());
+}
@@ -0,0 +1,135 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#ifndef SAMX_EDITABLE_DOCUMENT_H_INCLUDED
+#define SAMX_EDITABLE_DOCUMENT_H_INCLUDED
+
+#include "diagnostics.h"
+#include "document_arena.h"
+#include "samx_parser.h"
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace samx
+{
+
+/*
+ * A document kept in sync with its source while the source is edited.
+ *
+ * The source is split into sections at top level lines that follow an empty line; such a
+ * line starts a top level element and the Normalizer has no indentation state there, so
+ * each section can be normalized and parsed on its own. An edit only re-parses the
+ * sections it touches, and the elements parsed from the other sections are kept.
+ */
+class EditableDocument
+{
+public:
+   // throws std::runtime_error if the source is not valid
+   explicit EditableDocument(std::string source);
+
+   EditableDocument(const EditableDocument& other) = delete;
+   EditableDocument(EditableDocument&& other)      = delete;
+   ~EditableDocument()                             = default;
+   EditableDocument& operator=(const EditableDocument& other) = delete;
+   EditableDocument& operator=(EditableDocument&& other) = delete;
+
+   /*
+    * Replaces length bytes of the source, starting at offset, and updates the document.
+    * Throws std::out_of_range if the range is not in the source, and std::runtime_error if
+    * the edited source is not valid; the source is edited regardless, and it is parsed again
+    * in full on the next edit.
+    */
+   void applyEdit(size_t offset, size_t length, std::string_view replacement);
+
+   std::string_view getSource() const noexcept
+   {
+      return m_source;
+   }
+
+   // only up to date if the last edit succeeded
+   const Document& getDocument() const noexcept
+   {
+      return *m_document;
+   }
+
+   bool isValid() const noexcept
+   {
+      return m_valid;
+   }
+
+   // bytes parsed by the last update
+   size_t getReparsedSize() const noexcept
+   {
+      return m_reparsedSize;
+   }
+
+   /*
+    * Indentation errors found by the last update, in the sections it parsed; the lines are
+    * numbered from the start of the source, as for a full parse.
+    */
+   const Diagnostics& getDiagnostics() const noexcept
+   {
+      return m_diagnostics;
+   }
+
+private:
+   struct Section
+   {
+      size_t offset;
+
+      // number of the first line of the section, from 1
+      size_t line;
+
+      // top level elements parsed from the section
+      size_t elementCount;
+   };
+
+   void parseAll();
+
+   /*
+    * Parses the sections of the source starting at offset, on the given line, into the
+    * document, until the end of the source or until a section start whose previous line
+    * starts after resyncOffset, as the sections from there on are not affected by an edit
+    * ending at resyncOffset. Returns the offset where parsing stopped.
+    */
+   size_t parseSections(size_t                offset,
+                        size_t                line,
+                        size_t                resyncOffset,
+                        Document&             doc,
+                        std::vector<Section>& sections,
+                        Diagnostics&          diagnostics) const;
+
+   bool isSectionStart(size_t lineOffset, size_t previousLineOffset) const noexcept;
+
+   // declared first, so it is destroyed after the document
+   std::unique_ptr<DocumentArena> m_arena;
+
+   std::string             m_source;
+   std::optional<Document> m_document;
+   std::vector<Section>    m_sections;
+   Diagnostics             m_diagnostics;
+   bool                    m_valid        = false;
+   size_t                  m_reparsedSize = 0;
+};
+
+} // namespace samx
+
+#endif // SAMX_EDITABLE_DOCUMENT_H_INCLUDED
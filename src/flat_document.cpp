@@ -0,0 +1,179 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "flat_document.h"
+
+#include "samx_parser.h"
+
+#include <fmt/core.h>
+
+#include <cassert>
+#include <stdexcept>
+#include <utility>
+
+namespace
+{
+
+/*
+ * Copies a Document tree into a FlatDocument.
+ */
+class FlatDocumentBuilder
+{
+public:
+   explicit FlatDocumentBuilder(samx::FlatDocument& flat) : m_flat{flat}
+   {
+   }
+
+   void operator()(const samx::Paragraph& para)
+   {
+      m_segments.clear();
+      para.forEachSegment([this](std::string_view segment) {
+         m_segments.push_back(segment);
+      });
+
+      m_flat.addParagraphSegments(m_segments);
+   }
+
+   void operator()(const samx::Block& block)
+   {
+      m_flat.beginBlock(block.getTypeSymbol(), block.getDescription());
+      block.forEachElement(*this);
+      m_flat.endBlock();
+   }
+
+private:
+   samx::FlatDocument&           m_flat;
+   std::vector<std::string_view> m_segments;
+};
+
+} // namespace
+
+samx::FlatDocument::FlatDocument() : FlatDocument{std::make_shared<SymbolTable>()}
+{
+}
+
+samx::FlatDocument::FlatDocument(std::shared_ptr<SymbolTable> symbols) : m_symbols{std::move(symbols)}
+{
+}
+
+samx::FlatDocument::FlatDocument(const Document& doc) : FlatDocument{doc.shareSymbols()}
+{
+   FlatDocumentBuilder builder{*this};
+   doc.forEachElement(builder);
+}
+
+uint32_t samx::FlatDocument::reserveNode(size_t textLength) const
+{
+   if (textLength > UINT32_MAX - m_text.size())
+   {
+      throw std::runtime_error(fmt::format("Document too large: more than {} bytes of text", UINT32_MAX));
+   }
+
+   if (m_nodes.size() >= k_NoNode)
+   {
+      throw std::runtime_error(fmt::format("Document too large: more than {} nodes", k_NoNode - 1));
+   }
+
+   if ((m_openBlock != k_NoNode) && (m_nodes[m_openBlock].depth == UINT16_MAX))
+   {
+      throw std::runtime_error(fmt::format("Document too deep: blocks nested more than {} levels", UINT16_MAX));
+   }
+
+   return static_cast<uint32_t>(m_text.size());
+}
+
+samx::FlatDocument::NodeId
+samx::FlatDocument::appendNode(NodeKind kind, uint32_t textOffset, uint32_t textLength)
+{
+   const auto id = static_cast<NodeId>(m_nodes.size());
+
+   Node node = {};
+   node.kind        = kind;
+   node.depth       = (m_openBlock == k_NoNode) ? 0 : static_cast<uint16_t>(m_nodes[m_openBlock].depth + 1);
+   node.parent      = m_openBlock;
+   node.firstChild  = k_NoNode;
+   node.nextSibling = k_NoNode;
+   node.textOffset  = textOffset;
+   node.textLength  = textLength;
+
+   if (m_lastChild != k_NoNode)
+   {
+      m_nodes[m_lastChild].nextSibling = id;
+   }
+   else if (m_openBlock != k_NoNode)
+   {
+      m_nodes[m_openBlock].firstChild = id;
+   }
+
+   m_nodes.push_back(node);
+   m_lastChild = id;
+
+   return id;
+}
+
+samx::FlatDocument::NodeId samx::FlatDocument::beginBlock(std::string_view type, std::string_view description)
+{
+   if ((m_lastType == nullptr) || (m_lastType->name != type))
+   {
+      m_lastType = &m_symbols->intern(type);
+   }
+
+   return beginBlock(*m_lastType, description);
+}
+
+samx::FlatDocument::NodeId samx::FlatDocument::beginBlock(const Symbol& type, std::string_view description)
+{
+   const auto offset = reserveNode(description.size());
+   m_text.append(description);
+
+   if (type.id >= m_types.size())
+   {
+      m_types.resize(type.id + 1, nullptr);
+   }
+   m_types[type.id] = &type;
+
+   const auto id = appendNode(NodeKind::Block, offset, static_cast<uint32_t>(description.size()));
+
+   m_nodes[id].type = type.id;
+
+   m_openBlock = id;
+   m_lastChild = k_NoNode;
+
+   return id;
+}
+
+void samx::FlatDocument::endBlock()
+{
+   assert(m_openBlock != k_NoNode);
+
+   m_lastChild = m_openBlock;
+   m_openBlock = m_nodes[m_openBlock].parent;
+}
+
+void samx::FlatDocument::addParagraph(std::string_view text)
+{
+   const auto offset = reserveNode(text.size());
+   m_text.append(text);
+
+   appendNode(NodeKind::Paragraph, offset, static_cast<uint32_t>(text.size()));
+}
+
+size_t samx::FlatDocument::getBlockCount() const noexcept
+{
+   const auto topLevel = getTopLevel();
+   return static_cast<size_t>(std::distance(topLevel.begin(), topLevel.end()));
+}
@@ -0,0 +1,326 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#ifndef SAMX_FLAT_DOCUMENT_H_INCLUDED
+#define SAMX_FLAT_DOCUMENT_H_INCLUDED
+
+#include "symbol_table.h"
+
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace samx
+{
+
+class Document;
+
+/*
+ * Alternative Document representation: all nodes live in a single array, in document
+ * order, linked by indices; all text lives in a single buffer. Block types are interned in
+ * a SymbolTable, which may be shared with a Document or with other flat documents, and
+ * each block stores the id of its type.
+ */
+class FlatDocument
+{
+public:
+   using NodeId = uint32_t;
+
+   static constexpr NodeId k_NoNode = UINT32_MAX;
+
+   enum class NodeKind : uint8_t
+   {
+      Block,
+      Paragraph,
+   };
+
+   struct Node
+   {
+      NodeKind kind;
+      uint16_t depth;
+
+      NodeId parent;
+      NodeId firstChild;
+      NodeId nextSibling;
+
+      // paragraph text, or block description
+      uint32_t textOffset;
+      uint32_t textLength;
+
+      // blocks only
+      SymbolId type;
+   };
+
+   /*
+    * Iterates over the children of a node, following the sibling links.
+    */
+   class SiblingIterator
+   {
+   public:
+      using iterator_category = std::forward_iterator_tag;
+      using value_type        = Node;
+      using difference_type   = std::ptrdiff_t;
+      using pointer           = const Node*;
+      using reference         = const Node&;
+
+      SiblingIterator(const FlatDocument& doc, NodeId id) noexcept : m_doc{&doc}, m_id{id}
+      {
+      }
+
+      reference operator*() const noexcept
+      {
+         return m_doc->getNode(m_id);
+      }
+
+      pointer operator->() const noexcept
+      {
+         return &m_doc->getNode(m_id);
+      }
+
+      SiblingIterator& operator++() noexcept
+      {
+         m_id = m_doc->getNode(m_id).nextSibling;
+         return *this;
+      }
+
+      SiblingIterator operator++(int) noexcept
+      {
+         SiblingIterator previous{*this};
+         ++*this;
+         return previous;
+      }
+
+      NodeId getId() const noexcept
+      {
+         return m_id;
+      }
+
+      bool operator==(const SiblingIterator& other) const noexcept
+      {
+         return m_id == other.m_id;
+      }
+
+      bool operator!=(const SiblingIterator& other) const noexcept
+      {
+         return m_id != other.m_id;
+      }
+
+   private:
+      const FlatDocument* m_doc;
+      NodeId              m_id;
+   };
+
+   class SiblingRange
+   {
+   public:
+      SiblingRange(const FlatDocument& doc, NodeId first) noexcept : m_doc{doc}, m_first{first}
+      {
+      }
+
+      SiblingIterator begin() const noexcept
+      {
+         return SiblingIterator{m_doc, m_first};
+      }
+
+      SiblingIterator end() const noexcept
+      {
+         return SiblingIterator{m_doc, k_NoNode};
+      }
+
+   private:
+      const FlatDocument& m_doc;
+      NodeId              m_first;
+   };
+
+   // with a SymbolTable of its own
+   FlatDocument();
+
+   explicit FlatDocument(std::shared_ptr<SymbolTable> symbols);
+
+   // shares the SymbolTable of the document
+   explicit FlatDocument(const Document& doc);
+
+   /*
+    * Incremental construction, in document order. Throws std::runtime_error if the text
+    * exceeds 4 GiB, the nodes 2^32 - 1 or the nesting 65535 levels. The type is interned
+    * in the document's SymbolTable, or already belongs to it.
+    */
+   NodeId beginBlock(std::string_view type, std::string_view description);
+   NodeId beginBlock(const Symbol& type, std::string_view description);
+   void endBlock();
+   void addParagraph(std::string_view text);
+
+   // a paragraph made of several segments, separated by a single space
+   template <typename Segments>
+   void addParagraphSegments(const Segments& segments)
+   {
+      size_t length = 0;
+      for (std::string_view segment : segments)
+      {
+         length += (length == 0) ? segment.size() : segment.size() + 1;
+      }
+
+      const auto offset = reserveNode(length);
+      for (std::string_view segment : segments)
+      {
+         if (m_text.size() != offset)
+         {
+            m_text.push_back(' ');
+         }
+         m_text.append(segment);
+      }
+
+      appendNode(NodeKind::Paragraph, offset, static_cast<uint32_t>(m_text.size() - offset));
+   }
+
+   size_t getNodeCount() const noexcept
+   {
+      return m_nodes.size();
+   }
+
+   const Node& getNode(NodeId id) const noexcept
+   {
+      return m_nodes[id];
+   }
+
+   // nodes in document order
+   std::vector<Node>::const_iterator begin() const noexcept
+   {
+      return m_nodes.cbegin();
+   }
+
+   std::vector<Node>::const_iterator end() const noexcept
+   {
+      return m_nodes.cend();
+   }
+
+   SiblingRange getTopLevel() const noexcept
+   {
+      return SiblingRange{*this, m_nodes.empty() ? k_NoNode : 0};
+   }
+
+   SiblingRange getChildren(NodeId id) const noexcept
+   {
+      return SiblingRange{*this, m_nodes[id].firstChild};
+   }
+
+   size_t getBlockCount() const noexcept;
+
+   const SymbolTable& getSymbols() const noexcept
+   {
+      return *m_symbols;
+   }
+
+   const std::shared_ptr<SymbolTable>& shareSymbols() const noexcept
+   {
+      return m_symbols;
+   }
+
+   std::string_view getText(const Node& node) const noexcept
+   {
+      return std::string_view(m_text).substr(node.textOffset, node.textLength);
+   }
+
+   std::string_view getType(const Node& node) const noexcept
+   {
+      return m_types[node.type]->name;
+   }
+
+   std::string_view getDescription(const Node& node) const noexcept
+   {
+      return getText(node);
+   }
+
+   // bytes used by the node table, the text buffer and the type lookup
+   size_t getStorageSize() const noexcept
+   {
+      return m_nodes.capacity() * sizeof(Node) + m_text.capacity() + m_types.capacity() * sizeof(const Symbol*);
+   }
+
+   /*
+    * Walks the document without recursion, calling visitor.enterBlock(type, description),
+    * visitor.leaveBlock() and visitor.paragraph(text).
+    */
+   template <typename Visitor>
+   void walk(Visitor& visitor) const
+   {
+      NodeId openBlock = k_NoNode;
+
+      for (NodeId id = 0; id < m_nodes.size(); ++id)
+      {
+         const Node& node = m_nodes[id];
+
+         while (openBlock != node.parent)
+         {
+            visitor.leaveBlock();
+            openBlock = m_nodes[openBlock].parent;
+         }
+
+         if (node.kind == NodeKind::Block)
+         {
+            visitor.enterBlock(getType(node), getDescription(node));
+            openBlock = id;
+         }
+         else
+         {
+            visitor.paragraph(getText(node));
+         }
+      }
+
+      while (openBlock != k_NoNode)
+      {
+         visitor.leaveBlock();
+         openBlock = m_nodes[openBlock].parent;
+      }
+   }
+
+private:
+   // offset of the next node's text, after checking that the node and its text still fit
+   uint32_t reserveNode(size_t textLength) const;
+
+   NodeId appendNode(NodeKind kind, uint32_t textOffset, uint32_t textLength);
+
+   std::shared_ptr<SymbolTable> m_symbols;
+
+   std::vector<Node> m_nodes;
+   std::string       m_text;
+
+   // the symbols of the types used by this document, by id, so that getType takes no lock
+   std::vector<const Symbol*> m_types;
+
+   // siblings tend to share their type, which then needs no lookup
+   const Symbol* m_lastType = nullptr;
+
+   // the block currently receiving children, and the last child added to it
+   NodeId m_openBlock = k_NoNode;
+   NodeId m_lastChild = k_NoNode;
+};
+
+} // namespace samx
+
+std::ostream& operator<<(std::ostream& os, const samx::FlatDocument& doc);
+
+namespace samx
+{
+size_t print(std::ostream& os, const FlatDocument& doc);
+} // namespace samx
+
+#endif // SAMX_FLAT_DOCUMENT_H_INCLUDED
@@ -0,0 +1,591 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "include_cache.h"
+
+#include "diagnostics.h"
+#include "flat_document.h"
+#include "mapped_file.h"
+#include "samx_parser.h"
+#include "thread_pool.h"
+
+#include <fmt/core.h>
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace
+{
+
+/*
+ * Builds a fragment.
+ */
+class FlatDocumentHandler : public samx::DocumentHandler
+{
+public:
+   explicit FlatDocumentHandler(samx::FlatDocument& doc) : m_doc{doc}
+   {
+   }
+
+   void onBlockStart(std::string_view type, std::string_view description) override
+   {
+      m_doc.beginBlock(type, description);
+   }
+
+   void onBlockEnd() override
+   {
+      m_doc.endBlock();
+   }
+
+   void onParagraph(const std::vector<std::string_view>& segments) override
+   {
+      m_doc.addParagraphSegments(segments);
+   }
+
+private:
+   samx::FlatDocument& m_doc;
+};
+
+/*
+ * Reports the elements of a fragment to a handler, as if they were parsed in place.
+ */
+class FragmentReplay
+{
+public:
+   explicit FragmentReplay(samx::DocumentHandler& handler) : m_handler{handler}
+   {
+   }
+
+   void enterBlock(std::string_view type, std::string_view description)
+   {
+      m_handler.onBlockStart(type, description);
+   }
+
+   void leaveBlock()
+   {
+      m_handler.onBlockEnd();
+   }
+
+   void paragraph(std::string_view text)
+   {
+      m_segments.assign(1, text);
+      m_handler.onParagraph(m_segments);
+   }
+
+private:
+   samx::DocumentHandler&        m_handler;
+   std::vector<std::string_view> m_segments;
+};
+
+// fragments are identified by their canonical path
+std::string getCanonicalPath(const std::string& path)
+{
+   char canonical[PATH_MAX];
+   if (realpath(path.c_str(), canonical) == nullptr)
+   {
+      throw std::runtime_error(fmt::format("Cannot open inserted file {}: {}", path, std::strerror(errno)));
+   }
+
+   return canonical;
+}
+
+/*
+ * Resource names of the insertion lines, found by a plain scan: a line that the
+ * grammar rejects is at worst loaded for nothing.
+ */
+std::vector<std::string_view> findInsertions(std::string_view source)
+{
+   std::vector<std::string_view> resources;
+
+   for (size_t pos = source.find("<<<"); pos != std::string_view::npos; pos = source.find("<<<", pos + 3))
+   {
+      size_t end = pos + 3;
+      if ((end < source.size()) && samx::isIdentifierFirst(source[end]))
+      {
+         while ((end < source.size()) && samx::isIdentifierOther(source[end]))
+         {
+            ++end;
+         }
+
+         resources.push_back(source.substr(pos + 3, end - pos - 3));
+      }
+   }
+
+   return resources;
+}
+
+std::string getFragmentPath(const std::string& directory, std::string_view resource)
+{
+   return fmt::format("{}/{}.sam", directory, resource);
+}
+
+/*
+ * The file a fragment was read from, as it was then; a file that is rewritten in place
+ * normally changes its modification time, its size or both.
+ */
+struct FileVersion
+{
+   std::string path;
+   int64_t     modified = -1;
+   int64_t     size     = -1;
+
+   bool operator==(const FileVersion& other) const noexcept
+   {
+      return (modified == other.modified) && (size == other.size) && (path == other.path);
+   }
+
+   bool operator!=(const FileVersion& other) const noexcept
+   {
+      return !(*this == other);
+   }
+};
+
+// a missing file has neither modification time nor size, until it appears
+FileVersion getFileVersion(const std::string& path)
+{
+   FileVersion version{path};
+
+   struct stat fileStat = {};
+   if (stat(path.c_str(), &fileStat) == 0)
+   {
+      version.modified = int64_t{fileStat.st_mtim.tv_sec} * 1'000'000'000 + fileStat.st_mtim.tv_nsec;
+      version.size     = fileStat.st_size;
+   }
+
+   return version;
+}
+
+} // namespace
+
+struct samx::IncludeCache::State : std::enable_shared_from_this<State>
+{
+   enum class Status
+   {
+      Loading,
+      Loaded,
+      Failed,
+   };
+
+   struct Fragment
+   {
+      Status                              status = Status::Loading;
+      std::shared_ptr<const FlatDocument> document;
+      std::string                         error;
+
+      // with changes reloaded: the fragment's file and those it inserts, directly or not
+      std::shared_ptr<const std::vector<FileVersion>> sources;
+   };
+
+   State(ThreadPool* threadPool, Changes changesPolicy) : pool{threadPool}, changes{changesPolicy}
+   {
+   }
+
+   /*
+    * With wait false, returns nullptr instead of waiting for a fragment that is being
+    * loaded, or rethrowing its error.
+    */
+   std::shared_ptr<const FlatDocument> get(const std::string& path, const std::string& includer, bool wait);
+
+   std::shared_ptr<const FlatDocument> load(const std::string& path);
+
+   void prefetch(std::string_view source, const std::string& directory);
+
+   // forgets the fragment if any of its files changed; they are examined without the lock
+   void forgetIfChanged(const std::string& key);
+
+   // the includer, being loaded, depends on the file, or on the files of the fragment it inserts
+   void addSource(const std::string& includer, const std::string& path);
+   void addSources(const std::string& includer, const Fragment& fragment);
+
+   // true if the includer is, directly or not, waiting for the given fragment
+   bool isWaitingFor(const std::string& path, const std::string& includer) const;
+
+   std::string describeCycle(const std::string& path, const std::string& includer) const;
+
+   ThreadPool* const pool;
+   const Changes     changes;
+
+   // the block types of all the fragments
+   const std::shared_ptr<SymbolTable> symbols = std::make_shared<SymbolTable>();
+
+   std::mutex              mutex;
+   std::condition_variable loaded;
+
+   std::unordered_map<std::string, Fragment> fragments;
+
+   // the fragment that the loader of a fragment currently needs
+   std::unordered_map<std::string, std::string> waitsFor;
+
+   // with changes reloaded: files of the fragments inserted so far by those being loaded
+   std::unordered_map<std::string, std::vector<FileVersion>> insertedSources;
+
+   std::atomic<size_t> loadCount{0};
+   std::atomic<size_t> reuseCount{0};
+};
+
+std::shared_ptr<const samx::FlatDocument>
+samx::IncludeCache::State::get(const std::string& path, const std::string& includer, bool wait)
+{
+   std::string key;
+   try
+   {
+      key = getCanonicalPath(path);
+   }
+   catch (const std::runtime_error& /* re */)
+   {
+      // the includer is loaded again once the file appears
+      const std::lock_guard<std::mutex> lock{mutex};
+      addSource(includer, path);
+      throw;
+   }
+
+   if (changes == Changes::Reloaded)
+   {
+      forgetIfChanged(key);
+   }
+
+   std::unique_lock<std::mutex> lock{mutex};
+
+   for (;;)
+   {
+      const auto found = fragments.find(key);
+
+      if (found == fragments.end())
+      {
+         // loaded by this thread
+         fragments.emplace(key, Fragment{});
+         if (!includer.empty())
+         {
+            waitsFor[includer] = key;
+         }
+
+         lock.unlock();
+
+         // taken before reading, so that a change made meanwhile causes another load
+         std::vector<FileVersion> sources;
+         if (changes == Changes::Reloaded)
+         {
+            sources.push_back(getFileVersion(key));
+         }
+
+         std::shared_ptr<const FlatDocument> document;
+         std::string                         error;
+         try
+         {
+            document = load(key);
+         }
+         catch (const std::exception& ex)
+         {
+            error = ex.what();
+         }
+
+         lock.lock();
+
+         waitsFor.erase(includer);
+
+         const auto inserted = insertedSources.find(key);
+         if (inserted != insertedSources.end())
+         {
+            sources.insert(sources.end(), inserted->second.begin(), inserted->second.end());
+            insertedSources.erase(inserted);
+         }
+
+         auto& fragment = fragments[key];
+         fragment.status   = document ? Status::Loaded : Status::Failed;
+         fragment.document = document;
+         fragment.error    = error;
+         fragment.sources  = std::make_shared<const std::vector<FileVersion>>(std::move(sources));
+
+         ++loadCount;
+         loaded.notify_all();
+
+         addSources(includer, fragment);
+
+         if (!document && wait)
+         {
+            throw std::runtime_error(error);
+         }
+
+         return document;
+      }
+
+      const auto& fragment = found->second;
+
+      if (fragment.status == Status::Loaded)
+      {
+         ++reuseCount;
+         addSources(includer, fragment);
+         return fragment.document;
+      }
+
+      if (!wait)
+      {
+         return nullptr;
+      }
+
+      if (fragment.status == Status::Failed)
+      {
+         addSources(includer, fragment);
+         throw std::runtime_error(fragment.error);
+      }
+
+      // being loaded, by another thread or by one of the includers up the chain
+      if (isWaitingFor(key, includer))
+      {
+         addSource(includer, key);
+         throw std::runtime_error(describeCycle(key, includer));
+      }
+
+      if (!includer.empty())
+      {
+         waitsFor[includer] = key;
+      }
+
+      loaded.wait(lock);
+
+      waitsFor.erase(includer);
+   }
+}
+
+void samx::IncludeCache::State::forgetIfChanged(const std::string& key)
+{
+   std::shared_ptr<const std::vector<FileVersion>> sources;
+   {
+      const std::lock_guard<std::mutex> lock{mutex};
+
+      const auto found = fragments.find(key);
+      if ((found == fragments.end()) || (found->second.status == Status::Loading))
+      {
+         return;
+      }
+
+      sources = found->second.sources;
+   }
+
+   const bool changed = std::any_of(sources->begin(), sources->end(), [](const FileVersion& source) {
+      return getFileVersion(source.path) != source;
+   });
+
+   if (changed)
+   {
+      // unless another thread replaced it meanwhile; documents keep the old version alive
+      const std::lock_guard<std::mutex> lock{mutex};
+
+      const auto found = fragments.find(key);
+      if ((found != fragments.end()) && (found->second.sources == sources))
+      {
+         fragments.erase(found);
+      }
+   }
+}
+
+void samx::IncludeCache::State::addSource(const std::string& includer, const std::string& path)
+{
+   if ((changes == Changes::Reloaded) && !includer.empty())
+   {
+      insertedSources[includer].push_back(getFileVersion(path));
+   }
+}
+
+void samx::IncludeCache::State::addSources(const std::string& includer, const Fragment& fragment)
+{
+   if ((changes == Changes::Reloaded) && !includer.empty())
+   {
+      auto& sources = insertedSources[includer];
+      sources.insert(sources.end(), fragment.sources->begin(), fragment.sources->end());
+   }
+}
+
+bool samx::IncludeCache::State::isWaitingFor(const std::string& path, const std::string& includer) const
+{
+   if (includer.empty())
+   {
+      // documents that are not fragments cannot be inserted, so nothing waits for them
+      return false;
+   }
+
+   // follows the chain from the fragment's loader; the chain never loops, as no wait that
+   // would close a loop is ever started
+   const std::string* node = &path;
+   for (;;)
+   {
+      if (*node == includer)
+      {
+         return true;
+      }
+
+      const auto next = waitsFor.find(*node);
+      if (next == waitsFor.end())
+      {
+         return false;
+      }
+
+      node = &next->second;
+   }
+}
+
+std::string samx::IncludeCache::State::describeCycle(const std::string& path, const std::string& includer) const
+{
+   std::string cycle = includer;
+
+   for (const std::string* node = &path;; node = &waitsFor.at(*node))
+   {
+      cycle += " -> " + *node;
+      if (*node == includer)
+      {
+         break;
+      }
+   }
+
+   return "Block insertion cycle: " + cycle;
+}
+
+std::shared_ptr<const samx::FlatDocument> samx::IncludeCache::State::load(const std::string& path)
+{
+   try
+   {
+      const MappedFile file{path.c_str()};
+
+      const auto source    = file.getContents();
+      const auto directory = getDirectory(path);
+
+      prefetch(source, directory);
+
+      auto                document = std::make_shared<FlatDocument>(symbols);
+      FlatDocumentHandler builder{*document};
+
+      IncludeCache      handle{shared_from_this()};
+      InsertionResolver resolver{builder, handle, path, path};
+
+      Diagnostics diagnostics;
+      normalizeAndParse(source, resolver, nullptr, &diagnostics);
+
+      if (!diagnostics.empty())
+      {
+         const auto& first = diagnostics.getRecords().front();
+         throw std::runtime_error(fmt::format("Error on line {}: {}", first.line, format(first)));
+      }
+
+      return document;
+   }
+   catch (const std::runtime_error& re)
+   {
+      throw std::runtime_error(fmt::format("In {}: {}", path, re.what()));
+   }
+}
+
+void samx::IncludeCache::State::prefetch(std::string_view source, const std::string& directory)
+{
+   if (pool == nullptr)
+   {
+      return;
+   }
+
+   std::unordered_set<std::string_view> seen;
+   for (const auto resource : findInsertions(source))
+   {
+      if (!seen.insert(resource).second)
+      {
+         continue;
+      }
+
+      pool->submit([state = shared_from_this(), path = getFragmentPath(directory, resource)]() {
+         try
+         {
+            state->get(path, {}, false);
+         }
+         catch (const std::exception& /* ex */)
+         {
+            // reported to the documents that insert it; the pool would rethrow it to
+            // whichever unrelated caller waits on it next
+         }
+      });
+   }
+}
+
+samx::IncludeCache::IncludeCache(ThreadPool* pool, Changes changes) : m_state{std::make_shared<State>(pool, changes)}
+{
+}
+
+samx::IncludeCache::IncludeCache(std::shared_ptr<State> state) : m_state{std::move(state)}
+{
+}
+
+samx::IncludeCache::~IncludeCache() = default;
+
+std::shared_ptr<const samx::FlatDocument> samx::IncludeCache::get(const std::string& path, const std::string& includer)
+{
+   return m_state->get(path, includer, true);
+}
+
+void samx::IncludeCache::prefetch(std::string_view source, const std::string& directory)
+{
+   m_state->prefetch(source, directory);
+}
+
+size_t samx::IncludeCache::getLoadCount() const noexcept
+{
+   return m_state->loadCount;
+}
+
+size_t samx::IncludeCache::getReuseCount() const noexcept
+{
+   return m_state->reuseCount;
+}
+
+samx::InsertionResolver::InsertionResolver(DocumentHandler& target,
+                                           IncludeCache&    cache,
+                                           std::string_view documentPath,
+                                           std::string      includer) :
+   m_target{target}, m_cache{cache}, m_directory{getDirectory(documentPath)}, m_includer{std::move(includer)}
+{
+}
+
+void samx::InsertionResolver::onInsertion(std::string_view resource)
+{
+   ++m_insertionCount;
+
+   const auto fragment = m_cache.get(getFragmentPath(m_directory, resource), m_includer);
+
+   m_target.onInsertedText(fragment);
+
+   FragmentReplay replay{m_target};
+   fragment->walk(replay);
+}
+
+std::string samx::getDirectory(std::string_view path)
+{
+   const auto slash = path.rfind('/');
+   if (slash == std::string_view::npos)
+   {
+      return ".";
+   }
+
+   return std::string{(slash == 0) ? path.substr(0, 1) : path.substr(0, slash)};
+}
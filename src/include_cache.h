@@ -0,0 +1,155 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#ifndef SAMX_INCLUDE_CACHE_H_INCLUDED
+#define SAMX_INCLUDE_CACHE_H_INCLUDED
+
+#include "document_handler.h"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace samx
+{
+
+class FlatDocument;
+class ThreadPool;
+
+/*
+ * Fragments inserted with <<<name, each read and parsed once, then shared by all the
+ * documents that insert them, from any thread. A fragment is the file name.sam in the
+ * directory of the document that inserts it.
+ *
+ * A long running process can have fragments reloaded when they change: each lookup then
+ * checks the modification time and size of the fragment's file and of those of the
+ * fragments it inserts, and parses the fragment again if any changed, also after a
+ * failure. Documents keep the version they were built from.
+ *
+ * A fragment is loaded by the first thread that needs it; the others wait for it. With a
+ * pool, the insertions found in a source are loaded ahead, concurrently. Insertion cycles,
+ * including ones spanning several threads, fail the fragments involved instead of waiting.
+ */
+class IncludeCache
+{
+public:
+   // whether fragments are loaded again when their files change
+   enum class Changes
+   {
+      Ignored,
+      Reloaded,
+   };
+
+   // the pool, if any, must outlive the cache
+   explicit IncludeCache(ThreadPool* pool = nullptr, Changes changes = Changes::Ignored);
+
+   IncludeCache(const IncludeCache& other) = delete;
+   IncludeCache(IncludeCache&& other)      = delete;
+   ~IncludeCache();
+   IncludeCache& operator=(const IncludeCache& other) = delete;
+   IncludeCache& operator=(IncludeCache&& other) = delete;
+
+   /*
+    * Returns the parsed fragment; includer is the path of the fragment that inserts it, or
+    * empty for other documents. Throws std::runtime_error if the fragment cannot be read or
+    * parsed, or inserts itself; the error is kept, and thrown again for later requests,
+    * until the files involved change if changes are reloaded.
+    */
+   std::shared_ptr<const FlatDocument> get(const std::string& path, const std::string& includer);
+
+   /*
+    * Starts loading, on the pool, the fragments inserted by the source; does nothing
+    * without a pool.
+    */
+   void prefetch(std::string_view source, const std::string& directory);
+
+   // fragments read and parsed
+   size_t getLoadCount() const noexcept;
+
+   // requests served by an already loaded fragment
+   size_t getReuseCount() const noexcept;
+
+private:
+   // shared with the loading tasks, which may outlive the cache
+   struct State;
+
+   explicit IncludeCache(std::shared_ptr<State> state);
+
+   std::shared_ptr<State> m_state;
+};
+
+/*
+ * Forwards the elements of a document to another handler, replacing the insertions with
+ * the elements of the inserted fragments. The handler is given each fragment as the owner
+ * of its text, so documents that reference the text outlive the cache and any later
+ * version of the fragment.
+ */
+class InsertionResolver : public DocumentHandler
+{
+public:
+   /*
+    * Fragments are looked up in the directory of the given document path; includer is the
+    * canonical path of the document if it is itself a fragment.
+    */
+   InsertionResolver(DocumentHandler&  target,
+                     IncludeCache&     cache,
+                     std::string_view  documentPath,
+                     std::string       includer = {});
+
+   void onBlockStart(std::string_view type, std::string_view description) override
+   {
+      m_target.onBlockStart(type, description);
+   }
+
+   void onBlockEnd() override
+   {
+      m_target.onBlockEnd();
+   }
+
+   void onParagraph(const std::vector<std::string_view>& segments) override
+   {
+      m_target.onParagraph(segments);
+   }
+
+   void onInsertion(std::string_view resource) override;
+
+   void onInsertedText(std::shared_ptr<const void> owner) override
+   {
+      m_target.onInsertedText(std::move(owner));
+   }
+
+   // documents with insertions depend on other files, and should not be cached on their own
+   size_t getInsertionCount() const noexcept
+   {
+      return m_insertionCount;
+   }
+
+private:
+   DocumentHandler& m_target;
+   IncludeCache&    m_cache;
+   std::string      m_directory;
+   std::string      m_includer;
+   size_t           m_insertionCount = 0;
+};
+
+// directory part of a path, or "." if there is none
+std::string getDirectory(std::string_view path);
+
+} // namespace samx
+
+#endif // SAMX_INCLUDE_CACHE_H_INCLUDED
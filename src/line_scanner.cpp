@@ -0,0 +1,211 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "line_scanner.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SAMX_SCAN_X86
+#include <immintrin.h>
+#endif
+
+namespace
+{
+
+/*
+ * Reference implementation
+ */
+const char* findNewLineScalar(const char* begin, const char* end)
+{
+   const char* pos = begin;
+   while ((pos < end) && (*pos != '\n'))
+   {
+      ++pos;
+   }
+
+   return pos;
+}
+
+size_t countLeadingSpacesScalar(const char* begin, const char* end)
+{
+   const char* pos = begin;
+   while ((pos < end) && (*pos == ' '))
+   {
+      ++pos;
+   }
+
+   return static_cast<size_t>(pos - begin);
+}
+
+constexpr samx::LineScanner k_scalarScanner{samx::ScanKernel::Scalar, findNewLineScalar, countLeadingSpacesScalar};
+
+#ifdef SAMX_SCAN_X86
+
+/*
+ * Each kernel compares a whole register against the target character and turns the
+ * result into a bit mask, one bit per byte; the tail shorter than a register is
+ * handled by the scalar loop.
+ */
+template <typename Vector>
+const Vector* asVector(const char* pos) noexcept
+{
+   return static_cast<const Vector*>(static_cast<const void*>(pos));
+}
+
+const char* findNewLineSSE2(const char* begin, const char* end)
+{
+   constexpr ptrdiff_t k_width = 16;
+   const __m128i       newLine = _mm_set1_epi8('\n');
+   const char*         pos     = begin;
+
+   while (end - pos >= k_width)
+   {
+      const __m128i chunk = _mm_loadu_si128(asVector<__m128i>(pos));
+      const auto    mask  = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newLine)));
+      if (mask != 0)
+      {
+         return pos + __builtin_ctz(mask);
+      }
+      pos += k_width;
+   }
+
+   return findNewLineScalar(pos, end);
+}
+
+size_t countLeadingSpacesSSE2(const char* begin, const char* end)
+{
+   constexpr ptrdiff_t k_width = 16;
+   const __m128i       space   = _mm_set1_epi8(' ');
+   const char*         pos     = begin;
+
+   while (end - pos >= k_width)
+   {
+      const __m128i chunk = _mm_loadu_si128(asVector<__m128i>(pos));
+      const auto    mask  = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, space))) ^ 0xffffU;
+      if (mask != 0)
+      {
+         return static_cast<size_t>(pos - begin) + static_cast<size_t>(__builtin_ctz(mask));
+      }
+      pos += k_width;
+   }
+
+   return static_cast<size_t>(pos - begin) + countLeadingSpacesScalar(pos, end);
+}
+
+constexpr samx::LineScanner k_sse2Scanner{samx::ScanKernel::SSE2, findNewLineSSE2, countLeadingSpacesSSE2};
+
+__attribute__((target("avx2"))) const char* findNewLineAVX2(const char* begin, const char* end)
+{
+   constexpr ptrdiff_t k_width = 32;
+   const __m256i       newLine = _mm256_set1_epi8('\n');
+   const char*         pos     = begin;
+
+   while (end - pos >= k_width)
+   {
+      const __m256i chunk = _mm256_loadu_si256(asVector<__m256i>(pos));
+      const auto    mask  = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, newLine)));
+      if (mask != 0)
+      {
+         return pos + __builtin_ctz(mask);
+      }
+      pos += k_width;
+   }
+
+   return findNewLineSSE2(pos, end);
+}
+
+__attribute__((target("avx2"))) size_t countLeadingSpacesAVX2(const char* begin, const char* end)
+{
+   constexpr ptrdiff_t k_width = 32;
+   const __m256i       space   = _mm256_set1_epi8(' ');
+   const char*         pos     = begin;
+
+   while (end - pos >= k_width)
+   {
+      const __m256i chunk = _mm256_loadu_si256(asVector<__m256i>(pos));
+      const auto    mask  = ~static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, space)));
+      if (mask != 0)
+      {
+         return static_cast<size_t>(pos - begin) + static_cast<size_t>(__builtin_ctz(mask));
+      }
+      pos += k_width;
+   }
+
+   return static_cast<size_t>(pos - begin) + countLeadingSpacesSSE2(pos, end);
+}
+
+constexpr samx::LineScanner k_avx2Scanner{samx::ScanKernel::AVX2, findNewLineAVX2, countLeadingSpacesAVX2};
+
+bool hasAVX2() noexcept
+{
+   return __builtin_cpu_supports("avx2") != 0;
+}
+
+#endif // SAMX_SCAN_X86
+
+} // namespace
+
+const samx::LineScanner& samx::getLineScanner(ScanKernel kernel) noexcept
+{
+   switch (kernel)
+   {
+   case ScanKernel::Scalar:
+      return k_scalarScanner;
+
+   case ScanKernel::SSE2:
+#ifdef SAMX_SCAN_X86
+      return k_sse2Scanner;
+#else
+      break;
+#endif
+
+   case ScanKernel::AVX2:
+#ifdef SAMX_SCAN_X86
+      if (hasAVX2())
+      {
+         return k_avx2Scanner;
+      }
+#endif
+      break;
+   }
+
+   return getBestLineScanner();
+}
+
+const samx::LineScanner& samx::getBestLineScanner() noexcept
+{
+#ifdef SAMX_SCAN_X86
+   static const LineScanner& best = hasAVX2() ? k_avx2Scanner : k_sse2Scanner;
+   return best;
+#else
+   return k_scalarScanner;
+#endif
+}
+
+const char* samx::getKernelName(ScanKernel kernel) noexcept
+{
+   switch (kernel)
+   {
+   case ScanKernel::Scalar:
+      return "scalar";
+   case ScanKernel::SSE2:
+      return "sse2";
+   case ScanKernel::AVX2:
+      return "avx2";
+   }
+
+   return "unknown";
+}
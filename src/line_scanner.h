@@ -0,0 +1,62 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#ifndef SAMX_LINE_SCANNER_H_INCLUDED
+#define SAMX_LINE_SCANNER_H_INCLUDED
+
+#include <cstddef>
+
+namespace samx
+{
+
+enum class ScanKernel
+{
+   Scalar,
+   SSE2,
+   AVX2,
+};
+
+/*
+ * Byte scanning primitives used by the Normalizer to split lines and measure indentation.
+ */
+struct LineScanner
+{
+   ScanKernel kernel;
+
+   // returns the position of the first '\n' in [begin, end), or end
+   const char* (*findNewLine)(const char* begin, const char* end);
+
+   // returns the number of ' ' at the start of [begin, end)
+   size_t (*countLeadingSpaces)(const char* begin, const char* end);
+};
+
+/*
+ * Returns the scanner for the requested kernel, or the best one supported by this CPU
+ * if the requested kernel is not available.
+ */
+const LineScanner& getLineScanner(ScanKernel kernel) noexcept;
+
+/*
+ * Returns the fastest scanner supported by this CPU.
+ */
+const LineScanner& getBestLineScanner() noexcept;
+
+const char* getKernelName(ScanKernel kernel) noexcept;
+
+} // namespace samx
+
+#endif // SAMX_LINE_SCANNER_H_INCLUDED
@@ -0,0 +1,109 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+samx::MappedFile::MappedFile(const char* path)
+{
+   const int fd = open(path, O_RDONLY | O_CLOEXEC);
+   if (fd < 0)
+   {
+      throw std::system_error(errno, std::generic_category(), std::string("Cannot open ") + path);
+   }
+
+   struct stat fileStat = {};
+   if (fstat(fd, &fileStat) != 0)
+   {
+      const int error = errno;
+      close(fd);
+      throw std::system_error(error, std::generic_category(), std::string("Cannot stat ") + path);
+   }
+
+   m_size = static_cast<size_t>(fileStat.st_size);
+
+   // empty files cannot be mapped
+   if (m_size > 0)
+   {
+      void* address = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (address == MAP_FAILED)
+      {
+         const int error = errno;
+         close(fd);
+         throw std::system_error(error, std::generic_category(), std::string("Cannot map ") + path);
+      }
+
+      m_address = address;
+      madvise(m_address, m_size, MADV_SEQUENTIAL);
+   }
+
+   close(fd);
+}
+
+samx::MappedFile::~MappedFile()
+{
+   if (m_address != nullptr)
+   {
+      munmap(m_address, m_size);
+   }
+}
+
+bool samx::MappedFile::isRegularFile(const char* path) noexcept
+{
+   struct stat fileStat = {};
+   return (stat(path, &fileStat) == 0) && S_ISREG(fileStat.st_mode);
+}
+
+samx::LoadedFile samx::loadFile(const char* path)
+{
+   LoadedFile file;
+
+   if (MappedFile::isRegularFile(path))
+   {
+      auto mappedFile = std::make_shared<const MappedFile>(path);
+      file.contents   = mappedFile->getContents();
+      file.owner      = std::move(mappedFile);
+   }
+   else
+   {
+      std::ifstream input{path};
+      if (!input)
+      {
+         throw std::runtime_error("Cannot open input file");
+      }
+
+      std::ostringstream buffer;
+      buffer << input.rdbuf();
+
+      auto contents = std::make_shared<const std::string>(buffer.str());
+      file.contents = *contents;
+      file.owner    = std::move(contents);
+   }
+
+   return file;
+}
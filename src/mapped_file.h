@@ -0,0 +1,74 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#ifndef SAMX_MAPPED_FILE_H_INCLUDED
+#define SAMX_MAPPED_FILE_H_INCLUDED
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+
+namespace samx
+{
+
+/*
+ * Read-only memory mapping of a whole file.
+ */
+class MappedFile
+{
+public:
+   // throws std::system_error if the file cannot be opened or mapped
+   explicit MappedFile(const char* path);
+
+   MappedFile(const MappedFile& other) = delete;
+   MappedFile(MappedFile&& other)      = delete;
+   ~MappedFile();
+   MappedFile& operator=(const MappedFile& other) = delete;
+   MappedFile& operator=(MappedFile&& other) = delete;
+
+   std::string_view getContents() const noexcept
+   {
+      return std::string_view(static_cast<const char*>(m_address), m_size);
+   }
+
+   // pipes, character devices and such cannot be mapped and have to be read as streams
+   static bool isRegularFile(const char* path) noexcept;
+
+private:
+   void*  m_address = nullptr;
+   size_t m_size    = 0;
+};
+
+/*
+ * Contents of a whole file, kept alive by their owner.
+ */
+struct LoadedFile
+{
+   std::shared_ptr<const void> owner;
+   std::string_view            contents;
+};
+
+/*
+ * Regular files are mapped; anything else, such as a pipe, is read into memory. Throws
+ * std::system_error if the file cannot be mapped, and std::runtime_error if it cannot be
+ * read.
+ */
+LoadedFile loadFile(const char* path);
+
+} // namespace samx
+
+#endif // SAMX_MAPPED_FILE_H_INCLUDED
@@ -16,23 +16,21 @@
 
 #include "normalizer.h"
 
-#include <fmt/core.h>
-
 #include <algorithm>
 #include <cassert>
 #include <fstream>
 #include <ios>
 #include <iostream>
 #include <iterator>
-#include <sstream>
 
-std::optional<std::string> samx::Normalizer::Accumulator::pushLine(size_t indent, const char* base, size_t length)
+std::optional<samx::Diagnostic>
+samx::Normalizer::Accumulator::pushLine(size_t indent, const char* base, size_t length)
 {
    if (length == 0)
    {
       if (!lastLineWasEmpty)
       {
-         output.put('\n');
+         observer.emptyLine();
       }
 
       lastLineWasEmpty = true;
@@ -51,69 +49,53 @@ std::optional<std::string> samx::Normalizer::Accumulator::pushLine(size_t indent
       indents.push_back(currentIndent);
       currentIndent = indent;
 
-      output.write(k_indentMarker.data(), k_indentMarker.size());
+      ++counters.indents;
+      observer.indent();
    }
    else
    {
       if (indents.empty())
       {
-         return fmt::format("No previous indent level; current level: {}; observed: {}", currentIndent, indent);
+         return Diagnostic{DiagnosticCode::NoPreviousIndent, 0, currentIndent, indent, 0};
       }
 
-      std::ostringstream detail;
-      detail << "This indent: " << indent << " current: " << currentIndent << " history: ";
-      std::ostream_iterator<int> outIter{detail, ", "};
-      std::copy(indents.cbegin(), indents.cend(), outIter);
-
       if (indent == indents.back())
       {
          // shortcut; most indents go back just one level
          currentIndent = indent;
-         output.write(k_deindentMarker.data(), k_deindentMarker.size());
+         ++counters.deindents;
+         observer.deindent();
          indents.pop_back();
       }
       else
       {
          const auto iter = std::lower_bound(indents.cbegin(), indents.cend(), indent);
-         assert(iter != indents.cbegin());
 
          if (iter == indents.cend())
          {
-            std::cerr << detail.str() << '\n';
-
-            return fmt::format("Excessive de-indent; current level: {}; observed: {}", currentIndent, indent);
+            return Diagnostic{DiagnosticCode::ExcessiveDeindent, 0, currentIndent, indent, 0};
          }
 
          if (*iter != indent)
          {
-            return fmt::format(
-               "Excessive de-indent; current level: {}; observed: {}; expected: {}", currentIndent, indent, *iter);
+            return Diagnostic{DiagnosticCode::MisalignedDeindent, 0, currentIndent, indent, *iter};
          }
 
          const auto deindentLevels = std::distance(iter, indents.cend());
 
+         counters.deindents += static_cast<size_t>(deindentLevels);
          for (ssize_t ii = 0; ii < deindentLevels; ++ii)
          {
-            output.write(k_deindentMarker.data(), k_deindentMarker.size());
+            observer.deindent();
          }
 
          indents.erase(iter, indents.end());
-         assert(!indents.empty());
 
          currentIndent = indent;
       }
    }
 
-   auto reindent = k_Indent * indents.size();
-   if (reindent > k_MaxIndent)
-   {
-      reindent = k_MaxIndent;
-   }
-
-   output.write(spaces.data(), static_cast<std::streamsize>(reindent));
-
-   output.write(base, static_cast<std::streamsize>(length));
-   output.put('\n');
+   observer.line(std::string_view(base, length));
 
    return std::nullopt;
 }
@@ -123,19 +105,81 @@ void samx::Normalizer::Accumulator::flush()
    pushLine(0, nullptr, 0);
 
    const auto deindent = indents.size();
+   counters.deindents += deindent;
    for (size_t ii = 0; ii < deindent; ++ii)
    {
-      output.write(k_deindentMarker.data(), k_deindentMarker.size());
+      observer.deindent();
    }
 }
 
 void samx::Normalizer::pushLine(size_t lineNumber, size_t indent, const char* base, size_t length)
 {
-   const auto err = m_accumulator.pushLine(indent, base, length);
+   auto& counters = m_accumulator.counters;
+   ++counters.lines;
+   if (length == 0)
+   {
+      ++counters.emptyLines;
+   }
+
+   auto err = m_accumulator.pushLine(indent, base, length);
    if (err)
    {
-      std::cerr << "Error on line " << lineNumber << ": " << err.value() << '\n';
+      err->line = lineNumber;
+      m_diagnostics->add(err.value());
+   }
+}
+
+void samx::Normalizer::pushRawLine(size_t lineNumber, const char* begin, const char* end)
+{
+   /*
+    * determine the line indent
+    */
+   const auto        indent = m_scanner->countLeadingSpaces(begin, end);
+   const char* const text   = std::next(begin, static_cast<ptrdiff_t>(indent));
+
+   pushLine(lineNumber, indent, text, static_cast<size_t>(end - text));
+}
+
+const char* samx::Normalizer::pushLines(const char* begin, const char* end, size_t& lineNumber)
+{
+   const char* pos = begin;
+
+   while (pos < end)
+   {
+      const char* const lineEnd = m_scanner->findNewLine(pos, end);
+      if (lineEnd == end)
+      {
+         break;
+      }
+
+      pushRawLine(lineNumber, pos, lineEnd);
+
+      // skip over the new line
+      pos = std::next(lineEnd);
+      ++lineNumber;
+   }
+
+   return pos;
+}
+
+size_t samx::Normalizer::normalize(std::string_view input)
+{
+   m_accumulator.counters.bytes += input.size();
+
+   size_t lineNumber = 1;
+
+   const char* const end = std::next(input.data(), static_cast<ptrdiff_t>(input.size()));
+   const char* const pos = pushLines(input.data(), end, lineNumber);
+
+   if (pos < end)
+   {
+      // last line, without a trailing new line
+      pushRawLine(lineNumber, pos, end);
    }
+
+   m_accumulator.flush();
+
+   return input.size();
 }
 
 size_t samx::Normalizer::normalize(std::istream& input)
@@ -148,97 +192,51 @@ size_t samx::Normalizer::normalize(std::istream& input)
 
    size_t lineNumber = 1;
 
-   while (!input.eof())
+   bool lastBuffer = false;
+
+   while (!lastBuffer)
    {
+      if (lastPartialLineLength == buffer.size())
+      {
+         // a single line does not fit in the buffer
+         buffer.resize(buffer.size() * 2);
+      }
+
       /*
-       * fill buffer
+       * fill buffer, after the partial line carried over from the previous one
        */
-
+      const auto available = buffer.size() - lastPartialLineLength;
       input.read(std::next(buffer.data(), static_cast<ptrdiff_t>(lastPartialLineLength)),
-                 static_cast<std::streamsize>(k_BufferSize - lastPartialLineLength));
-      lastPartialLineLength = 0;
-      const auto ssize      = input.gcount();
-      if (ssize <= 0)
-      {
-         // TODO(florin): indicate error?
-         break;
-      }
+                 static_cast<std::streamsize>(available));
+      const auto ssize = input.gcount();
 
-      const auto size = static_cast<size_t>(ssize);
+      const auto size = static_cast<size_t>(std::max(ssize, std::streamsize{0}));
 
-      const bool lastBuffer = size < (k_BufferSize - lastPartialLineLength);
+      lastBuffer = size < available;
       count += size;
+      m_accumulator.counters.bytes += size;
 
       /*
        * process buffer
        */
-      std::size_t pos = 0;
-
-      while (pos < size)
-      {
-         unsigned indent = 0;
-
-         /*
-          * determine the line indent
-          */
-         while ((pos < size) && (buffer[pos] == ' '))
-         {
-            ++pos;
-            ++indent;
-         }
+      const char* const end = std::next(buffer.data(), static_cast<ptrdiff_t>(lastPartialLineLength + size));
+      const char* const pos = pushLines(buffer.data(), end, lineNumber);
 
-         if (pos == size)
-         {
-            if (lastBuffer)
-            {
-               // empty line on last buffer
-               pushLine(lineNumber, indent, nullptr, 0);
-            }
-            else
-            {
-               // this line might continue in the next buffer
-               std::fill_n(buffer.begin(), indent, ' ');
-               lastPartialLineLength = indent;
-            }
-
-            continue;
-         }
+      lastPartialLineLength = 0;
 
-         const auto lineStart = pos;
-         while ((pos < size) && (buffer[pos] != '\n'))
+      if (pos < end)
+      {
+         if (lastBuffer)
          {
-            ++pos;
+            // last line, without a trailing new line
+            pushRawLine(lineNumber, pos, end);
          }
-
-         if (pos == size)
+         else
          {
-            if (lastBuffer)
-            {
-               pushLine(lineNumber, indent, &buffer[lineStart], pos - lineStart);
-            }
-            else
-            {
-               /*
-                * this line might continue in the next buffer
-                */
-
-               // copy indent
-               std::fill_n(buffer.begin(), indent, ' ');
-               // copy partial line
-               std::copy_n(std::next(buffer.begin(), indent),
-                           pos - lineStart,
-                           std::next(buffer.begin(), static_cast<ptrdiff_t>(lineStart)));
-               lastPartialLineLength = indent + static_cast<size_t>(pos - lineStart);
-            }
-
-            continue;
+            // this line continues in the next buffer
+            lastPartialLineLength = static_cast<size_t>(end - pos);
+            std::copy(pos, end, buffer.data());
          }
-
-         pushLine(lineNumber, indent, &buffer[lineStart], pos - lineStart);
-
-         // skip over the new line
-         ++pos;
-         ++lineNumber;
       }
    }
 
@@ -17,53 +17,209 @@
 #ifndef SAMX_NORMALIZER_H_INCLUDED
 #define SAMX_NORMALIZER_H_INCLUDED
 
+#include "diagnostics.h"
+#include "line_scanner.h"
+#include "output_sink.h"
+
+#include <algorithm>
 #include <array>
+#include <cassert>
 #include <iosfwd>
+#include <memory>
 #include <optional>
+#include <string>
+#include <string_view>
 #include <vector>
 
 namespace samx
 {
 
+/*
+ * Receives the structure discovered by the Normalizer: changes in indentation and the
+ * contents of each line, stripped of its leading indentation.
+ */
+class IndentationObserver
+{
+public:
+   IndentationObserver()                                 = default;
+   IndentationObserver(const IndentationObserver& other) = delete;
+   IndentationObserver(IndentationObserver&& other)      = delete;
+   virtual ~IndentationObserver()                        = default;
+   IndentationObserver& operator=(const IndentationObserver& other) = delete;
+   IndentationObserver& operator=(IndentationObserver&& other) = delete;
+
+   virtual void indent()   = 0;
+   virtual void deindent() = 0;
+
+   // text is only valid for the duration of the call
+   virtual void line(std::string_view text) = 0;
+
+   // consecutive empty lines are reported only once
+   virtual void emptyLine() = 0;
+};
+
+/*
+ * Writes the normalized text: nested content is re-indented by a fixed amount and
+ * enclosed between {{ and }} markers. See output_sink.h for the Sink interface.
+ */
+template <typename Sink>
+class MarkerWriter : public IndentationObserver
+{
+public:
+   explicit MarkerWriter(Sink& sink) : m_sink{sink}, m_spaces(/* __n = */ k_MaxIndent, /* __value = */ ' ')
+   {
+   }
+
+   void indent() override
+   {
+      ++m_depth;
+      m_sink.write(k_indentMarker);
+   }
+
+   void deindent() override
+   {
+      assert(m_depth > 0);
+      --m_depth;
+      m_sink.write(k_deindentMarker);
+   }
+
+   void line(std::string_view text) override
+   {
+      const auto reindent = std::min(k_Indent * m_depth, k_MaxIndent);
+
+      m_sink.write(std::string_view(m_spaces.data(), reindent));
+      m_sink.write(text);
+      m_sink.put('\n');
+   }
+
+   void emptyLine() override
+   {
+      m_sink.put('\n');
+   }
+
+   static constexpr size_t k_Indent    = 4;
+   static constexpr size_t k_MaxIndent = 1024;
+
+private:
+   static constexpr std::string_view k_indentMarker   = "{{\n";
+   static constexpr std::string_view k_deindentMarker = "}}\n";
+
+   Sink&             m_sink;
+   std::vector<char> m_spaces;
+   size_t            m_depth = 0;
+};
+
+/*
+ * Counted as the input is normalized, across all normalize calls.
+ */
+struct NormalizerCounters
+{
+   size_t bytes = 0;
+
+   // all input lines, including the empty ones
+   size_t lines      = 0;
+   size_t emptyLines = 0;
+
+   // indentation events, one per level
+   size_t indents   = 0;
+   size_t deindents = 0;
+};
+
 class Normalizer
 {
 public:
-   explicit Normalizer(std::ostream& output) : m_accumulator{output}
+   explicit Normalizer(std::ostream& output) :
+      m_streamWriter{std::make_unique<StreamWriter>(output)}, m_accumulator{m_streamWriter->writer}
+   {
+   }
+
+   // for example a MarkerWriter over a faster sink than std::ostream
+   explicit Normalizer(IndentationObserver& observer) : m_accumulator{observer}
    {
    }
 
+   Normalizer(const Normalizer& other) = delete;
+   Normalizer(Normalizer&& other)      = delete;
+   ~Normalizer()                       = default;
+   Normalizer& operator=(const Normalizer& other) = delete;
+   Normalizer& operator=(Normalizer&& other) = delete;
+
    size_t normalize(std::istream& input);
 
+   /*
+    * Normalizes a contiguous input, such as a memory-mapped file; the lines are
+    * handed out as views into the input, without copying.
+    */
+   size_t normalize(std::string_view input);
+
+   // the fastest kernel supported by the CPU is used by default
+   void setScanKernel(ScanKernel kernel) noexcept
+   {
+      m_scanner = &getLineScanner(kernel);
+   }
+
+   const NormalizerCounters& getCounters() const noexcept
+   {
+      return m_accumulator.counters;
+   }
+
+   /*
+    * Errors are recorded in the given collector, which must outlive the normalizer, instead
+    * of in its own; nothing is written to the standard streams.
+    */
+   void setDiagnostics(Diagnostics& diagnostics) noexcept
+   {
+      m_diagnostics = &diagnostics;
+   }
+
+   const Diagnostics& getDiagnostics() const noexcept
+   {
+      return *m_diagnostics;
+   }
+
 private:
    static constexpr size_t k_BufferSize = 64 * 1024;
    static constexpr size_t k_MaxIndent  = 1024;
 
    struct Accumulator
    {
-      static constexpr size_t k_Indent = 4;
-
-      explicit Accumulator(std::ostream& out) : output{out}, spaces(/* __n = */ k_MaxIndent, /* __value = */ ' ')
+      explicit Accumulator(IndentationObserver& obs) : observer{obs}
       {
          indents.reserve(k_MaxIndent);
       }
 
-      std::ostream&       output;
-      std::vector<size_t> indents;
-      size_t              currentIndent    = 0;
-      bool                lastLineWasEmpty = false;
+      IndentationObserver& observer;
+      std::vector<size_t>  indents;
+      size_t               currentIndent    = 0;
+      bool                 lastLineWasEmpty = false;
+      NormalizerCounters   counters;
 
-      std::optional<std::string> pushLine(size_t indent, const char* base, size_t length);
+      // the line of the returned diagnostic is not set
+      std::optional<Diagnostic> pushLine(size_t indent, const char* base, size_t length);
       void flush();
-
-      static constexpr std::array<char, 3> k_indentMarker   = {'{', '{', '\n'};
-      static constexpr std::array<char, 3> k_deindentMarker = {'}', '}', '\n'};
-
-      std::vector<char> spaces;
    };
 
    void pushLine(size_t lineNumber, size_t indent, const char* base, size_t length);
+   void pushRawLine(size_t lineNumber, const char* begin, const char* end);
+
+   // returns the start of the trailing incomplete line, or end
+   const char* pushLines(const char* begin, const char* end, size_t& lineNumber);
+
+   struct StreamWriter
+   {
+      explicit StreamWriter(std::ostream& output) : sink{output}, writer{sink}
+      {
+      }
+
+      StreamSink               sink;
+      MarkerWriter<StreamSink> writer;
+   };
 
-   Accumulator m_accumulator;
+   std::unique_ptr<StreamWriter> m_streamWriter;
+   Accumulator                   m_accumulator;
+   const LineScanner*            m_scanner = &getBestLineScanner();
+   Diagnostics                   m_ownDiagnostics;
+   Diagnostics*                  m_diagnostics = &m_ownDiagnostics;
 };
 
 } // namespace samx
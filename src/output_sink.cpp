@@ -0,0 +1,148 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "output_sink.h"
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <climits>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace
+{
+/*
+ * Writes all the buffers, resuming after partial writes and interrupts.
+ */
+void writeAll(int fd, iovec* first, int count)
+{
+   while (count > 0)
+   {
+      const ssize_t written = writev(fd, first, count);
+      if (written < 0)
+      {
+         if (errno == EINTR)
+         {
+            continue;
+         }
+
+         throw std::system_error(errno, std::generic_category(), "Cannot write output");
+      }
+
+      auto remaining = static_cast<size_t>(written);
+      while ((count > 0) && (remaining >= first->iov_len))
+      {
+         remaining -= first->iov_len;
+         ++first;
+         --count;
+      }
+
+      if (count > 0)
+      {
+         first->iov_base = static_cast<char*>(first->iov_base) + remaining;
+         first->iov_len -= remaining;
+      }
+   }
+}
+} // namespace
+
+samx::FileSink::FileSink(int fd) : m_buffer{std::make_unique<char[]>(k_BufferSize)}, m_fd{fd}, m_ownsDescriptor{false}
+{
+}
+
+samx::FileSink::FileSink(const char* path) :
+   m_buffer{std::make_unique<char[]>(k_BufferSize)},
+   m_fd{open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)},
+   m_ownsDescriptor{true}
+{
+   if (m_fd < 0)
+   {
+      throw std::system_error(errno, std::generic_category(), std::string("Cannot open ") + path);
+   }
+}
+
+samx::FileSink::~FileSink()
+{
+   try
+   {
+      flush();
+   }
+   catch (const std::system_error& /* se */)
+   {
+      // reported by an explicit flush
+   }
+
+   if (m_ownsDescriptor)
+   {
+      close(m_fd);
+   }
+}
+
+void samx::FileSink::flush()
+{
+   if (m_used == 0)
+   {
+      return;
+   }
+
+   iovec buffer = {m_buffer.get(), m_used};
+
+   // the buffer is considered written even on error, so that it is not written again
+   m_used = 0;
+   writeAll(m_fd, &buffer, 1);
+}
+
+void samx::FileSink::writeBuffers(const std::vector<std::string>& buffers)
+{
+   std::vector<iovec> pieces;
+   pieces.reserve(buffers.size() + 1);
+
+   if (m_used > 0)
+   {
+      pieces.push_back(iovec{m_buffer.get(), m_used});
+      m_used = 0;
+   }
+
+   for (const auto& buffer : buffers)
+   {
+      if (!buffer.empty())
+      {
+         pieces.push_back(iovec{const_cast<char*>(buffer.data()), buffer.size()});
+      }
+   }
+
+   for (size_t first = 0; first < pieces.size(); first += IOV_MAX)
+   {
+      const auto count = std::min<size_t>(pieces.size() - first, IOV_MAX);
+      writeAll(m_fd, pieces.data() + first, static_cast<int>(count));
+   }
+}
+
+void samx::FileSink::writeThrough(std::string_view text)
+{
+   std::array<iovec, 2> buffers = {iovec{m_buffer.get(), m_used},
+                                   iovec{const_cast<char*>(text.data()), text.size()}};
+
+   m_used = 0;
+   writeAll(m_fd, buffers.data(), static_cast<int>(buffers.size()));
+}
@@ -0,0 +1,154 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#ifndef SAMX_OUTPUT_SINK_H_INCLUDED
+#define SAMX_OUTPUT_SINK_H_INCLUDED
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace samx
+{
+
+/*
+ * Output sinks, taken as template parameters by the writers (MarkerWriter, DocumentPrinter)
+ * so that the calls are resolved at compile time. A sink provides:
+ *
+ *    void write(std::string_view text);
+ *    void put(char ch);
+ */
+
+/*
+ * Appends to a string, which the caller can reserve ahead.
+ */
+class BufferSink
+{
+public:
+   explicit BufferSink(std::string& buffer) : m_buffer{buffer}
+   {
+   }
+
+   void write(std::string_view text)
+   {
+      m_buffer.append(text.data(), text.size());
+   }
+
+   void put(char ch)
+   {
+      m_buffer.push_back(ch);
+   }
+
+private:
+   std::string& m_buffer;
+};
+
+/*
+ * Writes through a std::ostream; kept for compatibility with the stream interfaces.
+ */
+class StreamSink
+{
+public:
+   explicit StreamSink(std::ostream& os) : m_os{os}
+   {
+   }
+
+   void write(std::string_view text)
+   {
+      m_os.write(text.data(), static_cast<std::streamsize>(text.size()));
+   }
+
+   void put(char ch)
+   {
+      m_os.put(ch);
+   }
+
+private:
+   std::ostream& m_os;
+};
+
+/*
+ * Writes to a file descriptor, through a large buffer; writes that do not fit in the buffer
+ * are sent along with it in a single writev call. Throws std::system_error if writing fails.
+ *
+ * The destructor flushes, but cannot report errors; call flush first to get them.
+ */
+class FileSink
+{
+public:
+   static constexpr size_t k_BufferSize = 256 * 1024;
+
+   // the descriptor is not closed
+   explicit FileSink(int fd);
+
+   // creates or truncates the file; throws std::system_error if it cannot be opened
+   explicit FileSink(const char* path);
+
+   FileSink(const FileSink& other) = delete;
+   FileSink(FileSink&& other)      = delete;
+   ~FileSink();
+   FileSink& operator=(const FileSink& other) = delete;
+   FileSink& operator=(FileSink&& other) = delete;
+
+   void write(std::string_view text)
+   {
+      if (text.size() <= k_BufferSize - m_used)
+      {
+         std::memcpy(m_buffer.get() + m_used, text.data(), text.size());
+         m_used += text.size();
+      }
+      else
+      {
+         writeThrough(text);
+      }
+   }
+
+   void put(char ch)
+   {
+      if (m_used == k_BufferSize)
+      {
+         flush();
+      }
+
+      m_buffer[m_used] = ch;
+      ++m_used;
+   }
+
+   void flush();
+
+   /*
+    * Writes the buffers in order after the pending output, without copying them, in as few
+    * writev calls as the system allows.
+    */
+   void writeBuffers(const std::vector<std::string>& buffers);
+
+private:
+   void writeThrough(std::string_view text);
+
+   std::unique_ptr<char[]> m_buffer;
+   size_t                  m_used = 0;
+   int                     m_fd;
+   bool                    m_ownsDescriptor;
+};
+
+} // namespace samx
+
+#endif // SAMX_OUTPUT_SINK_H_INCLUDED
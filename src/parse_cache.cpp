@@ -0,0 +1,276 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "parse_cache.h"
+
+#include "flat_document.h"
+#include "output_sink.h"
+#include "samx_parser.h"
+
+#include <fmt/core.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <system_error>
+#include <vector>
+
+namespace
+{
+
+constexpr std::string_view k_EntrySuffix     = ".samxb";
+constexpr std::string_view k_TemporarySuffix = ".tmp";
+
+// a temporary file this old was left by a writer that crashed or was killed
+constexpr time_t k_AbandonedSeconds = 10 * 60;
+
+constexpr uint64_t k_Multiplier1 = 0x9e3779b97f4a7c15ULL;
+constexpr uint64_t k_Multiplier2 = 0xbf58476d1ce4e5b9ULL;
+
+uint64_t mix(uint64_t value) noexcept
+{
+   value ^= value >> 31;
+   value *= 0x94d049bb133111ebULL;
+   value ^= value >> 29;
+   return value;
+}
+
+/*
+ * Two independent 64 bit lanes over 8 byte words; fast enough to be negligible next to
+ * parsing, and wide enough that collisions can be ignored.
+ */
+std::pair<uint64_t, uint64_t> hashContent(std::string_view bytes, uint64_t seed) noexcept
+{
+   uint64_t first  = seed ^ bytes.size();
+   uint64_t second = mix(seed) ^ (bytes.size() * k_Multiplier1);
+
+   size_t pos = 0;
+   for (; pos + sizeof(uint64_t) <= bytes.size(); pos += sizeof(uint64_t))
+   {
+      uint64_t word = 0;
+      std::memcpy(&word, bytes.data() + pos, sizeof(word));
+
+      first  = (first ^ word) * k_Multiplier1;
+      first ^= first >> 32;
+      second = (second + word) * k_Multiplier2;
+      second ^= second >> 29;
+   }
+
+   uint64_t tail = 0;
+   if (pos < bytes.size())
+   {
+      std::memcpy(&tail, bytes.data() + pos, bytes.size() - pos);
+   }
+
+   return {mix(first ^ tail), mix(second + tail)};
+}
+
+struct Entry
+{
+   std::string name;
+   uint64_t    size;
+   timespec    lastUse;
+};
+
+bool isOlder(const Entry& left, const Entry& right) noexcept
+{
+   return (left.lastUse.tv_sec != right.lastUse.tv_sec) ? (left.lastUse.tv_sec < right.lastUse.tv_sec)
+                                                        : (left.lastUse.tv_nsec < right.lastUse.tv_nsec);
+}
+
+bool hasSuffix(std::string_view name, std::string_view suffix) noexcept
+{
+   return (name.size() > suffix.size()) && (name.substr(name.size() - suffix.size()) == suffix);
+}
+
+} // namespace
+
+samx::ParseCache::ParseCache(std::string directory, uint64_t maxSize) :
+   m_directory{std::move(directory)}, m_maxSize{maxSize}
+{
+   if ((mkdir(m_directory.c_str(), 0777) != 0) && (errno != EEXIST))
+   {
+      throw std::system_error(errno, std::generic_category(), "Cannot create cache directory " + m_directory);
+   }
+
+   evict();
+}
+
+std::string samx::ParseCache::makeKey(std::string_view source)
+{
+   const auto hash = hashContent(source, (uint64_t{k_GrammarVersion} << 32) | BinaryDocument::k_Version);
+
+   return fmt::format("{:016x}{:016x}", hash.first, hash.second);
+}
+
+std::string samx::ParseCache::getEntryPath(const std::string& key) const
+{
+   return m_directory + '/' + key + std::string{k_EntrySuffix};
+}
+
+std::optional<samx::BinaryDocument> samx::ParseCache::find(const std::string& key)
+{
+   const auto path = getEntryPath(key);
+
+   try
+   {
+      auto doc = BinaryDocument::load(path.c_str());
+
+      // the modification time records the last use, for eviction
+      utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+
+      ++m_hits;
+      return doc;
+   }
+   catch (const std::system_error& /* se */)
+   {
+      // not cached
+   }
+   catch (const std::runtime_error& /* re */)
+   {
+      // written by an incompatible version, or damaged
+      unlink(path.c_str());
+   }
+
+   ++m_misses;
+   return std::nullopt;
+}
+
+bool samx::ParseCache::store(const std::string& key, const FlatDocument& doc)
+{
+   static std::atomic<unsigned> temporaryCounter{0};
+
+   const auto path          = getEntryPath(key);
+   const auto temporaryPath = fmt::format("{}/{}.{}-{}.tmp", m_directory, key, getpid(), temporaryCounter++);
+
+   uint64_t size = 0;
+
+   try
+   {
+      FileSink sink{temporaryPath.c_str()};
+      writeBinary(sink, doc);
+      sink.flush();
+
+      struct stat entryStat = {};
+      if (stat(temporaryPath.c_str(), &entryStat) == 0)
+      {
+         size = static_cast<uint64_t>(entryStat.st_size);
+      }
+   }
+   catch (const std::runtime_error& /* re */)
+   {
+      unlink(temporaryPath.c_str());
+      return false;
+   }
+
+   // replaces an entry stored concurrently for the same source, which has the same contents
+   if (rename(temporaryPath.c_str(), path.c_str()) != 0)
+   {
+      unlink(temporaryPath.c_str());
+      return false;
+   }
+
+   ++m_stores;
+
+   if ((m_size += size) > m_maxSize)
+   {
+      evict();
+   }
+
+   return true;
+}
+
+void samx::ParseCache::evict()
+{
+   const std::lock_guard<std::mutex> lock{m_evictionMutex};
+
+   DIR* directory = opendir(m_directory.c_str());
+   if (directory == nullptr)
+   {
+      return;
+   }
+
+   std::vector<Entry> entries;
+   uint64_t           totalSize = 0;
+
+   const auto now = time(nullptr);
+
+   while (const dirent* dirEntry = readdir(directory))
+   {
+      const std::string_view name{dirEntry->d_name};
+
+      const bool isEntry     = hasSuffix(name, k_EntrySuffix);
+      const bool isTemporary = !isEntry && hasSuffix(name, k_TemporarySuffix);
+      if (!isEntry && !isTemporary)
+      {
+         continue;
+      }
+
+      struct stat entryStat = {};
+      if (fstatat(dirfd(directory), dirEntry->d_name, &entryStat, 0) != 0)
+      {
+         continue;
+      }
+
+      if (!isEntry)
+      {
+         // entries being written count toward the limit, those abandoned are removed
+         if ((now - entryStat.st_mtim.tv_sec > k_AbandonedSeconds) &&
+             ((unlinkat(dirfd(directory), dirEntry->d_name, 0) == 0) || (errno == ENOENT)))
+         {
+            continue;
+         }
+
+         totalSize += static_cast<uint64_t>(entryStat.st_size);
+         continue;
+      }
+
+      entries.push_back(Entry{std::string{name}, static_cast<uint64_t>(entryStat.st_size), entryStat.st_mtim});
+      totalSize += static_cast<uint64_t>(entryStat.st_size);
+   }
+
+   if (totalSize > m_maxSize)
+   {
+      std::sort(entries.begin(), entries.end(), isOlder);
+
+      const uint64_t target = m_maxSize / 4 * 3;
+      for (const auto& entry : entries)
+      {
+         if (totalSize <= target)
+         {
+            break;
+         }
+
+         // another process may have removed it already
+         if ((unlinkat(dirfd(directory), entry.name.c_str(), 0) == 0) || (errno == ENOENT))
+         {
+            totalSize -= entry.size;
+            ++m_evictions;
+         }
+      }
+   }
+
+   closedir(directory);
+
+   m_size = totalSize;
+}
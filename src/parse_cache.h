@@ -0,0 +1,115 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#ifndef SAMX_PARSE_CACHE_H_INCLUDED
+#define SAMX_PARSE_CACHE_H_INCLUDED
+
+#include "binary_document.h"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace samx
+{
+
+class FlatDocument;
+
+/*
+ * Directory of parsed documents, in the BinaryDocument format, named after a hash of the
+ * source and the grammar and format versions. Safe to share between threads and between
+ * processes: entries are written to a temporary file and renamed into place, and a loaded
+ * entry stays mapped even if it is evicted meanwhile.
+ *
+ * When the entries exceed the size limit, the least recently used ones are removed until
+ * they fit in three quarters of it. Temporary files count toward the limit; those left by
+ * a writer that died are removed on the next scan once they are ten minutes old.
+ */
+class ParseCache
+{
+public:
+   static constexpr uint64_t k_DefaultMaxSize = 256 * 1024 * 1024;
+
+   // creates the directory if needed; throws std::system_error if it cannot
+   explicit ParseCache(std::string directory, uint64_t maxSize = k_DefaultMaxSize);
+
+   ParseCache(const ParseCache& other) = delete;
+   ParseCache(ParseCache&& other)      = delete;
+   ~ParseCache()                       = default;
+   ParseCache& operator=(const ParseCache& other) = delete;
+   ParseCache& operator=(ParseCache&& other) = delete;
+
+   // entry name for a source
+   static std::string makeKey(std::string_view source);
+
+   /*
+    * Returns the cached document, if any; unreadable entries count as misses and are
+    * removed.
+    */
+   std::optional<BinaryDocument> find(const std::string& key);
+
+   /*
+    * Returns false if the entry could not be written; the cache is then left as it was.
+    */
+   bool store(const std::string& key, const FlatDocument& doc);
+
+   size_t getHits() const noexcept
+   {
+      return m_hits;
+   }
+
+   size_t getMisses() const noexcept
+   {
+      return m_misses;
+   }
+
+   size_t getStores() const noexcept
+   {
+      return m_stores;
+   }
+
+   size_t getEvictions() const noexcept
+   {
+      return m_evictions;
+   }
+
+private:
+   std::string getEntryPath(const std::string& key) const;
+
+   // scans the directory, and removes entries if over the limit
+   void evict();
+
+   std::string m_directory;
+   uint64_t    m_maxSize;
+
+   std::atomic<size_t> m_hits{0};
+   std::atomic<size_t> m_misses{0};
+   std::atomic<size_t> m_stores{0};
+   std::atomic<size_t> m_evictions{0};
+
+   // size of the entries as of the last scan, plus the entries stored since
+   std::atomic<uint64_t> m_size{0};
+
+   std::mutex m_evictionMutex;
+};
+
+} // namespace samx
+
+#endif // SAMX_PARSE_CACHE_H_INCLUDED
@@ -0,0 +1,386 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "path_query.h"
+
+#include "binary_document.h"
+#include "block_index.h"
+#include "flat_document.h"
+
+#include <fmt/core.h>
+
+#include <cctype>
+#include <optional>
+#include <stdexcept>
+
+namespace
+{
+
+constexpr uint32_t k_AnyType = UINT32_MAX;
+
+/*
+ * Reads the query text, reporting errors with their offset.
+ */
+class QueryReader
+{
+public:
+   explicit QueryReader(std::string_view text) noexcept : m_text{text}
+   {
+   }
+
+   bool atEnd() const noexcept
+   {
+      return m_position == m_text.size();
+   }
+
+   char peek() const noexcept
+   {
+      return atEnd() ? '\0' : m_text[m_position];
+   }
+
+   bool consume(std::string_view token) noexcept
+   {
+      if (m_text.substr(m_position, token.size()) != token)
+      {
+         return false;
+      }
+
+      m_position += token.size();
+      return true;
+   }
+
+   void expect(std::string_view token)
+   {
+      if (!consume(token))
+      {
+         fail(fmt::format("expected '{}'", token));
+      }
+   }
+
+   std::string_view readIdentifier()
+   {
+      const auto start = m_position;
+      while (!atEnd() && ((std::isalnum(static_cast<unsigned char>(peek())) != 0) || (peek() == '_')))
+      {
+         ++m_position;
+      }
+
+      const auto identifier = m_text.substr(start, m_position - start);
+      if (identifier.empty() || (std::isdigit(static_cast<unsigned char>(identifier.front())) != 0))
+      {
+         m_position = start;
+         fail("expected a block type or '*'");
+      }
+
+      return identifier;
+   }
+
+   std::string readString()
+   {
+      expect("\"");
+
+      std::string value;
+      while (!consume("\""))
+      {
+         if (atEnd())
+         {
+            fail("unterminated string");
+         }
+
+         if (consume("\\") && atEnd())
+         {
+            fail("unterminated string");
+         }
+
+         value.push_back(m_text[m_position++]);
+      }
+
+      return value;
+   }
+
+   [[noreturn]] void fail(std::string_view reason) const
+   {
+      throw std::runtime_error(fmt::format("Invalid query '{}' at offset {}: {}", m_text, m_position, reason));
+   }
+
+private:
+   std::string_view m_text;
+   size_t           m_position = 0;
+};
+
+/*
+ * Uniform access to the nodes and block index of both document representations.
+ */
+class FlatIndex
+{
+public:
+   FlatIndex(const samx::FlatDocument& doc, const samx::BlockIndex& index) noexcept : m_doc{doc}, m_index{index}
+   {
+   }
+
+   size_t getNodeCount() const noexcept
+   {
+      return m_doc.getNodeCount();
+   }
+
+   bool isBlock(uint32_t id) const noexcept
+   {
+      return m_doc.getNode(id).kind == samx::FlatDocument::NodeKind::Block;
+   }
+
+   uint32_t getParent(uint32_t id) const noexcept
+   {
+      return m_doc.getNode(id).parent;
+   }
+
+   std::string_view getDescription(uint32_t id) const noexcept
+   {
+      return m_doc.getDescription(m_doc.getNode(id));
+   }
+
+   // the id of the type in the document's SymbolTable
+   std::optional<uint32_t> findType(std::string_view type) const
+   {
+      const auto* symbol = m_doc.getSymbols().find(type);
+      if (symbol == nullptr)
+      {
+         return std::nullopt;
+      }
+
+      return symbol->id;
+   }
+
+   samx::NodeSpan getBlocksOfType(uint32_t type) const noexcept
+   {
+      return m_index.getBlocksOfType(type);
+   }
+
+   uint32_t getTypeOf(uint32_t id) const noexcept
+   {
+      return m_doc.getNode(id).type;
+   }
+
+private:
+   const samx::FlatDocument& m_doc;
+   const samx::BlockIndex&   m_index;
+};
+
+class BinaryIndex
+{
+public:
+   explicit BinaryIndex(const samx::BinaryDocument& doc) noexcept : m_doc{doc}
+   {
+   }
+
+   size_t getNodeCount() const noexcept
+   {
+      return m_doc.getNodeCount();
+   }
+
+   bool isBlock(uint32_t id) const noexcept
+   {
+      return m_doc.getNode(id).kind == samx::BinaryDocument::NodeKind::Block;
+   }
+
+   uint32_t getParent(uint32_t id) const noexcept
+   {
+      return m_doc.getNode(id).parent;
+   }
+
+   std::string_view getDescription(uint32_t id) const noexcept
+   {
+      return m_doc.getDescription(m_doc.getNode(id));
+   }
+
+   std::optional<uint32_t> findType(std::string_view type) const noexcept
+   {
+      return m_doc.findType(type);
+   }
+
+   samx::NodeSpan getBlocksOfType(uint32_t type) const noexcept
+   {
+      return m_doc.getBlocksOfType(type);
+   }
+
+   uint32_t getTypeOf(uint32_t id) const noexcept
+   {
+      return m_doc.getTypeOf(id);
+   }
+
+private:
+   const samx::BinaryDocument& m_doc;
+};
+
+} // namespace
+
+samx::PathQuery::PathQuery(std::string_view text) : m_text{text}
+{
+   QueryReader reader{text};
+
+   // a leading '//' is the same as no prefix
+   m_anchored = !reader.consume("//") && reader.consume("/");
+
+   Axis axis = Axis::Descendant;
+
+   do
+   {
+      Step step;
+      step.axis = axis;
+
+      if (!reader.consume("*"))
+      {
+         step.type = reader.readIdentifier();
+         step.type.push_back(':');
+      }
+
+      if (reader.consume("["))
+      {
+         reader.expect("description");
+         if (reader.consume("~="))
+         {
+            step.predicate = Predicate::Contains;
+         }
+         else
+         {
+            reader.expect("=");
+            step.predicate = Predicate::Equals;
+         }
+
+         step.description = reader.readString();
+         reader.expect("]");
+      }
+
+      m_steps.push_back(std::move(step));
+
+      if (reader.atEnd())
+      {
+         break;
+      }
+
+      if (reader.consume("//"))
+      {
+         axis = Axis::Descendant;
+      }
+      else
+      {
+         reader.expect("/");
+         axis = Axis::Child;
+      }
+   } while (true);
+}
+
+template <typename Index>
+std::vector<uint32_t> samx::PathQuery::evaluateWith(const Index& index) const
+{
+   // a type missing from the document matches nothing
+   std::vector<uint32_t> types;
+   types.reserve(m_steps.size());
+   for (const auto& step : m_steps)
+   {
+      if (step.type.empty())
+      {
+         types.push_back(k_AnyType);
+      }
+      else if (const auto type = index.findType(step.type))
+      {
+         types.push_back(*type);
+      }
+      else
+      {
+         return {};
+      }
+   }
+
+   std::vector<uint32_t> result;
+
+   const auto last = m_steps.size() - 1;
+   if (types[last] != k_AnyType)
+   {
+      for (const auto id : index.getBlocksOfType(types[last]))
+      {
+         if (matches(index, types, last, id))
+         {
+            result.push_back(id);
+         }
+      }
+   }
+   else
+   {
+      for (uint32_t id = 0; id < index.getNodeCount(); ++id)
+      {
+         if (index.isBlock(id) && matches(index, types, last, id))
+         {
+            result.push_back(id);
+         }
+      }
+   }
+
+   return result;
+}
+
+template <typename Index>
+bool samx::PathQuery::matches(const Index& index, const std::vector<uint32_t>& types, size_t step, uint32_t id) const
+{
+   if ((types[step] != k_AnyType) && (index.getTypeOf(id) != types[step]))
+   {
+      return false;
+   }
+
+   const auto& current = m_steps[step];
+   if (current.predicate != Predicate::None)
+   {
+      const auto description = index.getDescription(id);
+      const bool found       = (current.predicate == Predicate::Equals)
+                                  ? (description == current.description)
+                                  : (description.find(current.description) != std::string_view::npos);
+      if (!found)
+      {
+         return false;
+      }
+   }
+
+   const auto parent = index.getParent(id);
+   if (step == 0)
+   {
+      return !m_anchored || (parent == FlatDocument::k_NoNode);
+   }
+
+   if (current.axis == Axis::Child)
+   {
+      return (parent != FlatDocument::k_NoNode) && matches(index, types, step - 1, parent);
+   }
+
+   for (auto ancestor = parent; ancestor != FlatDocument::k_NoNode; ancestor = index.getParent(ancestor))
+   {
+      if (matches(index, types, step - 1, ancestor))
+      {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+std::vector<uint32_t> samx::PathQuery::evaluate(const FlatDocument& doc, const BlockIndex& index) const
+{
+   return evaluateWith(FlatIndex{doc, index});
+}
+
+std::vector<uint32_t> samx::PathQuery::evaluate(const BinaryDocument& doc) const
+{
+   return evaluateWith(BinaryIndex{doc});
+}
@@ -0,0 +1,111 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#ifndef SAMX_PATH_QUERY_H_INCLUDED
+#define SAMX_PATH_QUERY_H_INCLUDED
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace samx
+{
+
+class BinaryDocument;
+class BlockIndex;
+class FlatDocument;
+
+/*
+ * Selects blocks by their path, for example:
+ *
+ *    section/subsection[description~="Two"]
+ *
+ * Grammar:
+ *
+ *    query     := ['/' | '//'] step (('/' | '//') step)*
+ *    step      := (identifier | '*') [predicate]
+ *    predicate := '[' 'description' ('=' | '~=') string ']'
+ *    string    := '"' characters, with \" and \\ escaped '"'
+ *
+ * 'a/b' selects the b blocks whose parent is an a block, 'a//b' those with an a ancestor.
+ * A leading '/' restricts the first step to top level blocks; otherwise it matches at any
+ * depth. '=' compares the whole description, '~=' searches it for the string.
+ *
+ * The query is compiled once and can be evaluated against many documents. Evaluation
+ * starts from the indexed blocks of the last step's type and walks up the parent links
+ * of each, so its cost follows the number of blocks of that type rather than the size of
+ * the document; a trailing '*' has to consider every block. The step types are looked up
+ * once per evaluation, in the SymbolTable of a flat document or the string table of a
+ * binary one, and the blocks are then compared by type id.
+ */
+class PathQuery
+{
+public:
+   // throws std::runtime_error pointing at the first syntax error
+   explicit PathQuery(std::string_view text);
+
+   // matching blocks, in document order
+   std::vector<uint32_t> evaluate(const FlatDocument& doc, const BlockIndex& index) const;
+   std::vector<uint32_t> evaluate(const BinaryDocument& doc) const;
+
+   const std::string& getText() const noexcept
+   {
+      return m_text;
+   }
+
+private:
+   enum class Axis : uint8_t
+   {
+      Child,
+      Descendant,
+   };
+
+   enum class Predicate : uint8_t
+   {
+      None,
+      Equals,
+      Contains,
+   };
+
+   struct Step
+   {
+      // how the step relates to the previous one
+      Axis axis = Axis::Descendant;
+
+      // block type with its ':', or empty for any type
+      std::string type;
+
+      Predicate   predicate = Predicate::None;
+      std::string description;
+   };
+
+   template <typename Index>
+   std::vector<uint32_t> evaluateWith(const Index& index) const;
+
+   // whether the block matches the steps up to and including the given one
+   template <typename Index>
+   bool matches(const Index& index, const std::vector<uint32_t>& types, size_t step, uint32_t id) const;
+
+   std::string       m_text;
+   std::vector<Step> m_steps;
+   bool              m_anchored = false;
+};
+
+} // namespace samx
+
+#endif // SAMX_PATH_QUERY_H_INCLUDED
@@ -0,0 +1,527 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "pipeline.h"
+
+#include "diagnostics.h"
+#include "document_handler.h"
+#include "normalizer.h"
+#include "samx_parser.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <istream>
+#include <optional>
+#include <streambuf>
+#include <system_error>
+
+namespace
+{
+
+using Duration = samx::PipelineStats::Duration;
+
+constexpr size_t k_ReadSize       = 256 * 1024;
+constexpr size_t k_ReadBuffers    = 8;
+constexpr size_t k_EventChunkSize = 64 * 1024;
+constexpr size_t k_EventChunks    = 16;
+
+/*
+ * Chunks never span files; the last chunk of a file may be empty, and carries the error
+ * that ended the file, if any.
+ */
+struct ReadChunk
+{
+   std::vector<char> data;
+   size_t            size = 0;
+   size_t            file = 0;
+   bool              last = false;
+   std::string       error;
+};
+
+struct EventChunk
+{
+   std::string events;
+   size_t      file = 0;
+   bool        last = false;
+   std::string error;
+};
+
+enum class EventKind : char
+{
+   Indent    = 'I',
+   Deindent  = 'D',
+   EmptyLine = 'E',
+   Line      = 'L',
+};
+
+/*
+ * Each stage receives chunks from the one before, and gives them back once used.
+ */
+struct Queues
+{
+   samx::BoundedQueue<ReadChunk> read{k_ReadBuffers};
+   samx::BoundedQueue<ReadChunk> freeRead{k_ReadBuffers};
+
+   samx::BoundedQueue<EventChunk> events{k_EventChunks};
+   samx::BoundedQueue<EventChunk> freeEvents{k_EventChunks};
+};
+
+/*
+ * Reads the files in order, opening the next one ahead and asking the kernel to start
+ * reading it while the current one is read.
+ */
+class Reader
+{
+public:
+   Reader(const std::vector<std::string>& paths, Queues& queues) : m_paths{paths}, m_queues{queues}
+   {
+   }
+
+   void run()
+   {
+      int nextFd = (m_paths.empty()) ? -1 : openInput(0);
+
+      for (size_t file = 0; file < m_paths.size(); ++file)
+      {
+         const int fd = nextFd;
+
+         nextFd = (file + 1 < m_paths.size()) ? openInput(file + 1) : -1;
+
+         if (fd < 0)
+         {
+            sendError(file, std::system_error(-fd, std::generic_category(), "Cannot open input file").what());
+            continue;
+         }
+
+         readFile(file, fd);
+
+         if (fd != STDIN_FILENO)
+         {
+            close(fd);
+         }
+      }
+   }
+
+   Duration getWaited() const noexcept
+   {
+      return m_waited;
+   }
+
+   size_t getBytes() const noexcept
+   {
+      return m_bytes;
+   }
+
+private:
+   // returns the negated errno on failure
+   int openInput(size_t file) const
+   {
+      if (m_paths[file] == "-")
+      {
+         return STDIN_FILENO;
+      }
+
+      const int fd = open(m_paths[file].c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0)
+      {
+         return -errno;
+      }
+
+      posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+      posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+
+      return fd;
+   }
+
+   void readFile(size_t file, int fd)
+   {
+      for (bool last = false; !last;)
+      {
+         auto chunk = m_queues.freeRead.pop(m_waited);
+         chunk.data.resize(k_ReadSize);
+         chunk.size = 0;
+         chunk.file = file;
+         chunk.error.clear();
+
+         // fill the buffer, so that the other stages see few chunks
+         while (chunk.size < chunk.data.size())
+         {
+            const ssize_t count = read(fd, chunk.data.data() + chunk.size, chunk.data.size() - chunk.size);
+            if (count > 0)
+            {
+               chunk.size += static_cast<size_t>(count);
+            }
+            else if ((count < 0) && (errno == EINTR))
+            {
+               continue;
+            }
+            else
+            {
+               if (count < 0)
+               {
+                  chunk.error = std::system_error(errno, std::generic_category(), "Cannot read input file").what();
+               }
+
+               last = true;
+               break;
+            }
+         }
+
+         m_bytes += chunk.size;
+         chunk.last = last;
+         m_queues.read.push(std::move(chunk), m_waited);
+      }
+   }
+
+   void sendError(size_t file, std::string error)
+   {
+      auto chunk  = m_queues.freeRead.pop(m_waited);
+      chunk.size  = 0;
+      chunk.file  = file;
+      chunk.last  = true;
+      chunk.error = std::move(error);
+      m_queues.read.push(std::move(chunk), m_waited);
+   }
+
+   const std::vector<std::string>& m_paths;
+   Queues&                         m_queues;
+
+   Duration m_waited{};
+   size_t   m_bytes = 0;
+};
+
+/*
+ * Presents the chunks of one file as a stream, for Normalizer::normalize.
+ */
+class ChunkStreamBuffer : public std::streambuf
+{
+public:
+   ChunkStreamBuffer(Queues& queues, Duration& waited) : m_queues{queues}, m_waited{waited}
+   {
+   }
+
+   ChunkStreamBuffer(const ChunkStreamBuffer& other) = delete;
+   ChunkStreamBuffer(ChunkStreamBuffer&& other)      = delete;
+   ChunkStreamBuffer& operator=(const ChunkStreamBuffer& other) = delete;
+   ChunkStreamBuffer& operator=(ChunkStreamBuffer&& other) = delete;
+
+   ~ChunkStreamBuffer() override
+   {
+      release();
+   }
+
+   // consumes the rest of the file, returning the error that ended it, if any
+   std::string finish()
+   {
+      while (!m_done)
+      {
+         underflow();
+      }
+
+      release();
+      return std::move(m_error);
+   }
+
+protected:
+   int_type underflow() override
+   {
+      while (!m_done)
+      {
+         release();
+
+         m_current = m_queues.read.pop(m_waited);
+         m_done    = m_current->last;
+         m_error   = std::move(m_current->error);
+
+         if (m_current->size > 0)
+         {
+            char* data = m_current->data.data();
+            setg(data, data, data + m_current->size);
+            return traits_type::to_int_type(*data);
+         }
+      }
+
+      return traits_type::eof();
+   }
+
+private:
+   void release()
+   {
+      if (m_current)
+      {
+         setg(nullptr, nullptr, nullptr);
+         m_queues.freeRead.push(std::move(*m_current), m_waited);
+         m_current.reset();
+      }
+   }
+
+   Queues&                  m_queues;
+   Duration&                m_waited;
+   std::optional<ReadChunk> m_current;
+   bool                     m_done = false;
+   std::string              m_error;
+};
+
+/*
+ * Records the normalizer events in chunks, for the parse stage.
+ */
+class EventWriter : public samx::IndentationObserver
+{
+public:
+   EventWriter(Queues& queues, Duration& waited, size_t file) : m_queues{queues}, m_waited{waited}, m_file{file}
+   {
+      start();
+   }
+
+   void indent() override
+   {
+      add(EventKind::Indent);
+   }
+
+   void deindent() override
+   {
+      add(EventKind::Deindent);
+   }
+
+   void line(std::string_view text) override
+   {
+      const auto length = static_cast<uint32_t>(text.size());
+
+      m_chunk.events.push_back(static_cast<char>(EventKind::Line));
+      m_chunk.events.append(reinterpret_cast<const char*>(&length), sizeof(length));
+      m_chunk.events.append(text);
+      flushIfFull();
+   }
+
+   void emptyLine() override
+   {
+      add(EventKind::EmptyLine);
+   }
+
+   void finish(std::string error)
+   {
+      m_chunk.last  = true;
+      m_chunk.error = std::move(error);
+      m_queues.events.push(std::move(m_chunk), m_waited);
+   }
+
+private:
+   void start()
+   {
+      m_chunk      = m_queues.freeEvents.pop(m_waited);
+      m_chunk.file = m_file;
+      m_chunk.last = false;
+      m_chunk.events.clear();
+      m_chunk.error.clear();
+   }
+
+   void add(EventKind kind)
+   {
+      m_chunk.events.push_back(static_cast<char>(kind));
+      flushIfFull();
+   }
+
+   void flushIfFull()
+   {
+      if (m_chunk.events.size() >= k_EventChunkSize)
+      {
+         m_queues.events.push(std::move(m_chunk), m_waited);
+         start();
+      }
+   }
+
+   Queues&    m_queues;
+   Duration&  m_waited;
+   size_t     m_file;
+   EventChunk m_chunk;
+};
+
+void normalizeFiles(size_t fileCount, Queues& queues, std::vector<samx::Diagnostics>& diagnostics, Duration& waited)
+{
+   for (size_t file = 0; file < fileCount; ++file)
+   {
+      ChunkStreamBuffer buffer{queues, waited};
+      EventWriter       writer{queues, waited, file};
+
+      std::string error;
+      try
+      {
+         std::istream input{&buffer};
+
+         samx::Normalizer normalizer{writer};
+         normalizer.setDiagnostics(diagnostics[file]);
+         normalizer.normalize(input);
+      }
+      catch (const std::exception& ex)
+      {
+         error = ex.what();
+      }
+
+      // a read error is reported rather than its consequences
+      auto readError = buffer.finish();
+      writer.finish(readError.empty() ? std::move(error) : std::move(readError));
+   }
+}
+
+void replay(std::string_view events, samx::IndentationObserver& observer)
+{
+   for (size_t position = 0; position < events.size();)
+   {
+      switch (static_cast<EventKind>(events[position++]))
+      {
+      case EventKind::Indent:
+         observer.indent();
+         break;
+
+      case EventKind::Deindent:
+         observer.deindent();
+         break;
+
+      case EventKind::EmptyLine:
+         observer.emptyLine();
+         break;
+
+      case EventKind::Line:
+      {
+         uint32_t length = 0;
+         std::memcpy(&length, events.data() + position, sizeof(length));
+         position += sizeof(length);
+
+         observer.line(events.substr(position, length));
+         position += length;
+         break;
+      }
+      }
+   }
+}
+
+void parseFiles(size_t                                fileCount,
+                Queues&                               queues,
+                const std::vector<samx::Diagnostics>& diagnostics,
+                samx::PipelineConsumer&               consumer,
+                Duration&                             waited)
+{
+   for (size_t file = 0; file < fileCount; ++file)
+   {
+      std::optional<samx::EventParser> parser;
+      parser.emplace(consumer.beginFile(file));
+
+      std::string error;
+      for (bool last = false; !last;)
+      {
+         auto chunk = queues.events.pop(waited);
+         last       = chunk.last;
+
+         // after an error, the rest of the file is skipped
+         if (error.empty())
+         {
+            try
+            {
+               replay(chunk.events, parser->getObserver());
+
+               if (last && chunk.error.empty())
+               {
+                  parser->finish();
+               }
+            }
+            catch (const std::exception& ex)
+            {
+               error = ex.what();
+            }
+
+            if (last && error.empty())
+            {
+               error = std::move(chunk.error);
+            }
+         }
+
+         queues.freeEvents.push(std::move(chunk), waited);
+      }
+
+      parser.reset();
+      consumer.endFile(file, diagnostics[file], error);
+   }
+}
+
+} // namespace
+
+samx::PipelineStats samx::runPipeline(const std::vector<std::string>& paths, PipelineConsumer& consumer)
+{
+   const auto startTime = std::chrono::steady_clock::now();
+
+   Queues queues;
+
+   // the free queues start full
+   Duration primed{};
+   for (size_t ii = 0; ii < k_ReadBuffers; ++ii)
+   {
+      queues.freeRead.push(ReadChunk{}, primed);
+   }
+   for (size_t ii = 0; ii < k_EventChunks; ++ii)
+   {
+      EventChunk chunk;
+      chunk.events.reserve(k_EventChunkSize + k_ReadSize);
+      queues.freeEvents.push(std::move(chunk), primed);
+   }
+
+   // written by the normalize stage, read by the parse stage once the file is done
+   std::vector<Diagnostics> diagnostics(paths.size());
+
+   Reader   reader{paths, queues};
+   Duration readTime{};
+   Duration normalizeTime{};
+   Duration normalizeWaited{};
+
+   const auto timed = [](Duration& elapsed, auto work) {
+      const auto start = std::chrono::steady_clock::now();
+      work();
+      elapsed = std::chrono::steady_clock::now() - start;
+   };
+
+   std::thread readThread{[&]() {
+      timed(readTime, [&reader]() {
+         reader.run();
+      });
+   }};
+
+   std::thread normalizeThread{[&]() {
+      timed(normalizeTime, [&]() {
+         normalizeFiles(paths.size(), queues, diagnostics, normalizeWaited);
+      });
+   }};
+
+   Duration parseTime{};
+   Duration parseWaited{};
+   timed(parseTime, [&]() {
+      parseFiles(paths.size(), queues, diagnostics, consumer, parseWaited);
+   });
+
+   readThread.join();
+   normalizeThread.join();
+
+   PipelineStats stats;
+   stats.wall      = std::chrono::steady_clock::now() - startTime;
+   stats.read      = readTime - reader.getWaited();
+   stats.normalize = normalizeTime - normalizeWaited;
+   stats.parse     = parseTime - parseWaited;
+   stats.bytes     = reader.getBytes();
+
+   return stats;
+}
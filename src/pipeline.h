@@ -0,0 +1,205 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#ifndef SAMX_PIPELINE_H_INCLUDED
+#define SAMX_PIPELINE_H_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace samx
+{
+
+class Diagnostics;
+class DocumentHandler;
+
+/*
+ * Single producer, single consumer queue of fixed capacity. Both ends only touch their own
+ * index and an atomic load of the other one. A thread that finds the queue full or empty
+ * spins for a while, then sleeps until the other end moves, and reports how long it
+ * waited; the other end only takes the lock to wake it when a thread is sleeping.
+ */
+template <typename Item>
+class BoundedQueue
+{
+public:
+   using Duration = std::chrono::steady_clock::duration;
+
+   // capacity is rounded up to a power of two
+   explicit BoundedQueue(size_t capacity) : m_slots(roundUp(capacity)), m_mask{m_slots.size() - 1}
+   {
+   }
+
+   void push(Item&& item, Duration& waited)
+   {
+      const auto tail = m_tail.load(std::memory_order_relaxed);
+      waitUntil(
+         [this, tail]() {
+            return tail - m_head.load(std::memory_order_acquire) < m_slots.size();
+         },
+         waited);
+
+      m_slots[tail & m_mask] = std::move(item);
+      m_tail.store(tail + 1, std::memory_order_release);
+      wakeUp();
+   }
+
+   Item pop(Duration& waited)
+   {
+      const auto head = m_head.load(std::memory_order_relaxed);
+      waitUntil(
+         [this, head]() {
+            return m_tail.load(std::memory_order_acquire) != head;
+         },
+         waited);
+
+      Item item = std::move(m_slots[head & m_mask]);
+      m_head.store(head + 1, std::memory_order_release);
+      wakeUp();
+
+      return item;
+   }
+
+private:
+   static constexpr size_t k_SpinCount = 256;
+
+   static size_t roundUp(size_t capacity) noexcept
+   {
+      size_t size = 1;
+      while (size < capacity)
+      {
+         size *= 2;
+      }
+
+      return size;
+   }
+
+   template <typename Predicate>
+   void waitUntil(Predicate ready, Duration& waited)
+   {
+      for (size_t ii = 0; ii < k_SpinCount; ++ii)
+      {
+         if (ready())
+         {
+            return;
+         }
+      }
+
+      const auto startTime = std::chrono::steady_clock::now();
+
+      /*
+       * Pairs with the fence in wakeUp: either the check below sees the other end's move,
+       * or the other end sees the sleeper and notifies, which it can only do under the lock
+       * once this thread waits.
+       */
+      m_sleepers.fetch_add(1);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      {
+         std::unique_lock<std::mutex> lock{m_mutex};
+         while (!ready())
+         {
+            m_changed.wait(lock);
+         }
+      }
+      m_sleepers.fetch_sub(1);
+
+      waited += std::chrono::steady_clock::now() - startTime;
+   }
+
+   void wakeUp()
+   {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (m_sleepers.load(std::memory_order_relaxed) > 0)
+      {
+         const std::lock_guard<std::mutex> lock{m_mutex};
+         m_changed.notify_all();
+      }
+   }
+
+   std::vector<Item> m_slots;
+   const size_t      m_mask;
+
+   // next slot to pop, and next slot to push; on separate cache lines
+   alignas(64) std::atomic<size_t> m_head{0};
+   alignas(64) std::atomic<size_t> m_tail{0};
+
+   alignas(64) std::atomic<int> m_sleepers{0};
+   std::mutex              m_mutex;
+   std::condition_variable m_changed;
+};
+
+/*
+ * Receives the files of a pipeline on its parse thread, in order. The callbacks must not
+ * throw, since the other stages would wait for the parse stage forever.
+ */
+class PipelineConsumer
+{
+public:
+   PipelineConsumer()                              = default;
+   PipelineConsumer(const PipelineConsumer& other) = delete;
+   PipelineConsumer(PipelineConsumer&& other)      = delete;
+   virtual ~PipelineConsumer()                     = default;
+   PipelineConsumer& operator=(const PipelineConsumer& other) = delete;
+   PipelineConsumer& operator=(PipelineConsumer&& other) = delete;
+
+   // the handler receiving the elements of the file, until endFile
+   virtual DocumentHandler& beginFile(size_t index) = 0;
+
+   /*
+    * Called after the last element of the file, or after an error; error is empty if the
+    * file was read and parsed. The diagnostics hold the indentation errors of the file.
+    */
+   virtual void endFile(size_t index, const Diagnostics& diagnostics, std::string_view error) = 0;
+};
+
+/*
+ * Time each stage spent working, rather than waiting for the stage before or after it.
+ */
+struct PipelineStats
+{
+   using Duration = std::chrono::steady_clock::duration;
+
+   Duration wall;
+   Duration read;
+   Duration normalize;
+   Duration parse;
+
+   size_t bytes = 0;
+};
+
+/*
+ * Validates files with one thread per stage: a reader fills buffers, reading ahead of the
+ * others; a normalizer turns them into indentation events; a parser feeds the events to
+ * the consumer's handlers. The stages are connected by bounded queues whose buffers go
+ * back to the stage before for reuse, so the files overlap: the next file is read while
+ * the current one is parsed.
+ *
+ * Inputs are paths, or "-" for the standard input. Block insertions are resolved by the
+ * consumer's handlers, on the parse thread.
+ */
+PipelineStats runPipeline(const std::vector<std::string>& paths, PipelineConsumer& consumer);
+
+} // namespace samx
+
+#endif // SAMX_PIPELINE_H_INCLUDED
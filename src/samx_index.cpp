@@ -0,0 +1,256 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "command_line.h"
+#include "include_cache.h"
+#include "mapped_file.h"
+#include "output_sink.h"
+#include "samx_parser.h"
+#include "text_index.h"
+#include "thread_pool.h"
+
+#include <fmt/core.h>
+
+#include <unistd.h>
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace
+{
+
+const char* const k_BuildUsage = "Usage: samx-index build [-j threads] [--files-from list|-] index input...\n";
+const char* const k_QueryUsage = "Usage: samx-index query index query...\n";
+
+struct FileResult
+{
+   std::optional<samx::TextIndexSegment> segment;
+   size_t                                size = 0;
+   std::string                           error;
+};
+
+/*
+ * Parses one file straight into its index segment; no document is built.
+ */
+FileResult indexFile(const std::string& path, samx::IncludeCache& includes)
+{
+   FileResult result;
+
+   try
+   {
+      const auto       file   = samx::loadFile(path.c_str());
+      std::string_view source = file.contents;
+
+      result.size = source.size();
+
+      includes.prefetch(source, samx::getDirectory(path));
+
+      samx::TextIndexSegment  segment{path};
+      samx::InsertionResolver resolver{segment, includes, path};
+      samx::normalizeAndParse(source, resolver, nullptr, nullptr);
+
+      result.segment.emplace(std::move(segment));
+   }
+   catch (const std::exception& ex)
+   {
+      result.error = ex.what();
+   }
+
+   return result;
+}
+
+int build(int argc, char* argv[])
+{
+   size_t threadCount = 0;
+
+   const char*              indexPath = nullptr;
+   std::vector<std::string> paths;
+
+   for (int ii = 0; ii < argc; ++ii)
+   {
+      const std::string_view arg{argv[ii]};
+
+      if ((arg == "-j") && (ii + 1 < argc))
+      {
+         const auto count = samx::parseCount(argv[++ii]);
+         if (!count)
+         {
+            std::cerr << "Error: invalid thread count " << argv[ii] << '\n' << k_BuildUsage;
+            return 1;
+         }
+
+         threadCount = count.value();
+      }
+      else if ((arg == "--files-from") && (ii + 1 < argc))
+      {
+         if (!samx::readFileList(argv[++ii], paths))
+         {
+            std::cerr << "Cannot read file list " << argv[ii] << '\n';
+            return 2;
+         }
+      }
+      else if (indexPath == nullptr)
+      {
+         indexPath = argv[ii];
+      }
+      else
+      {
+         paths.emplace_back(arg);
+      }
+   }
+
+   if ((indexPath == nullptr) || paths.empty())
+   {
+      std::cerr << "Error: index or input arguments missing\n";
+      std::cerr << k_BuildUsage;
+      return 1;
+   }
+
+   const auto startTime = std::chrono::steady_clock::now();
+
+   samx::ThreadPool   pool{threadCount};
+   samx::IncludeCache includes{&pool};
+
+   // each file is indexed on its own, then the segments are merged in input order
+   std::vector<FileResult> results(paths.size());
+   for (size_t ii = 0; ii < paths.size(); ++ii)
+   {
+      pool.submit([&includes, &paths, &results, ii]() {
+         results[ii] = indexFile(paths[ii], includes);
+      });
+   }
+
+   pool.wait();
+
+   samx::TextIndexWriter writer;
+
+   size_t failed    = 0;
+   size_t totalSize = 0;
+   for (size_t ii = 0; ii < paths.size(); ++ii)
+   {
+      auto& result = results[ii];
+      totalSize += result.size;
+
+      if (result.segment)
+      {
+         writer.add(std::move(*result.segment));
+         result.segment.reset();
+      }
+      else
+      {
+         ++failed;
+         std::cerr << paths[ii] << ": error: " << result.error << '\n';
+      }
+   }
+
+   try
+   {
+      samx::FileSink sink{indexPath};
+      writer.write(sink);
+      sink.flush();
+   }
+   catch (const std::exception& ex)
+   {
+      std::cerr << "Cannot write index " << indexPath << ": " << ex.what() << '\n';
+      return 2;
+   }
+
+   const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+
+   const auto megabytes = static_cast<double>(totalSize) / (1024.0 * 1024.0);
+
+   std::cerr << "Indexed " << paths.size() << " files (" << failed << " failed), " << megabytes << " MB: "
+             << writer.getParagraphCount() << " paragraphs, " << writer.getTermCount() << " terms in "
+             << elapsed.count() << " s on " << pool.getThreadCount() << " threads\n";
+
+   return (failed == 0) ? 0 : 3;
+}
+
+int query(int argc, char* argv[])
+{
+   if (argc < 2)
+   {
+      std::cerr << "Error: index or query arguments missing\n";
+      std::cerr << k_QueryUsage;
+      return 1;
+   }
+
+   try
+   {
+      const auto startTime = std::chrono::steady_clock::now();
+
+      const samx::TextIndex index{argv[0]};
+
+      // the arguments form a single query; all words and phrases must match
+      std::string text;
+      for (int ii = 1; ii < argc; ++ii)
+      {
+         text.append(argv[ii]).push_back(' ');
+      }
+
+      const auto matches = index.search(text);
+
+      const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - startTime;
+
+      samx::FileSink output{STDOUT_FILENO};
+      for (const auto id : matches)
+      {
+         const auto& paragraph = index.getParagraph(id);
+         output.write(fmt::format("{}: {}: paragraph {}\n",
+                                  index.getFile(paragraph),
+                                  index.getBlockPath(paragraph),
+                                  paragraph.ordinal + 1));
+      }
+      output.flush();
+
+      std::cerr << matches.size() << " paragraphs matched in " << elapsed.count() << " ms\n";
+
+      return matches.empty() ? 1 : 0;
+   }
+   catch (const std::exception& ex)
+   {
+      std::cerr << "Error: " << ex.what() << '\n';
+      return 2;
+   }
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+   const std::string_view command{(argc > 1) ? argv[1] : ""};
+
+   if (command == "build")
+   {
+      return build(argc - 2, argv + 2);
+   }
+
+   if (command == "query")
+   {
+      return query(argc - 2, argv + 2);
+   }
+
+   std::cerr << "Usage: samx-index build [-j threads] [--files-from list|-] index input...\n"
+                "       samx-index query index query...\n";
+   return 1;
+}
@@ -18,19 +18,31 @@
 
 #include "samx_parser.h"
 
+#include "line_scanner.h"
+#include "normalizer.h"
+#include "thread_pool.h"
+
 #include <tao/pegtl.hpp>
 #include <tao/pegtl/ascii.hpp>
 #include <tao/pegtl/contrib/tracer.hpp>
 
 #include <fmt/core.h>
 
+#include <algorithm>
 #include <iostream>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <vector>
 
 namespace
 {
 
 namespace pegtl = tao::pegtl;
 
+// below this size, splitting the input costs more than it saves
+constexpr size_t k_MinimumChunkSize = 64 * 1024;
+
 using WhiteSpace = pegtl::star<pegtl::one<' '>>;
 
 using NewLine = pegtl::ascii::eol;
@@ -47,7 +59,8 @@ struct BlockEnd : pegtl::seq<pegtl::rep<2, pegtl::one<'}'>>, pegtl::opt<NewLine>
 {
 };
 
-struct Text : pegtl::plus<pegtl::sor<pegtl::ascii::alnum, pegtl::range<0x2b, 0x2f>, pegtl::one<' '>>>
+// a single class, so that each character is examined once
+struct Text : pegtl::plus<pegtl::ranges<'a', 'z', 'A', 'Z', '0', '9', 0x2b, 0x2f, ' '>>
 {
 };
 
@@ -55,13 +68,13 @@ struct ParagraphText: Text
 {
 };
 
-struct Paragraph : pegtl::seq<WhiteSpace, pegtl::plus<pegtl::seq<ParagraphText, WhiteSpace, NewLine>>, NewLine>
+struct Paragraph : pegtl::seq<pegtl::plus<pegtl::seq<WhiteSpace, ParagraphText, NewLine>>, NewLine>
 {
 };
 
-struct Block;
+struct Element;
 
-struct Content : pegtl::star<pegtl::sor<Block, Paragraph>>
+struct Content : pegtl::star<Element>
 {
 };
 
@@ -77,13 +90,16 @@ struct BlockDescription : pegtl::opt<Text>
 {
 };
 
-struct Block : pegtl::seq<WhiteSpace,
-                          BlockIdentifier,
-                          WhiteSpace,
-                          BlockDescription,
-                          WhiteSpace,
-                          pegtl::plus<NewLine>,
-                          pegtl::opt<IndentedBlock>>
+struct BlockHeader : pegtl::seq<WhiteSpace, BlockIdentifier, WhiteSpace, BlockDescription, WhiteSpace>
+{
+};
+
+// once the header line is matched, the block cannot fail
+struct BlockHeaderLine : pegtl::seq<BlockHeader, pegtl::plus<NewLine>>
+{
+};
+
+struct Block : pegtl::seq<BlockHeaderLine, pegtl::opt<IndentedBlock>>
 {
 };
 
@@ -95,10 +111,137 @@ struct BlockInsertion : pegtl::seq<InsertionMarker, ExternalResource>
 {
 };
 
+struct InsertionLine : pegtl::seq<WhiteSpace, BlockInsertion, WhiteSpace, pegtl::plus<NewLine>>
+{
+};
+
+/*
+ * What the text at the start of a line can be, from its first word: the alternatives of
+ * an element are mutually exclusive, as ':' and '<' are not text characters. The type of
+ * a block header is stored if requested, with its ':' like BlockIdentifier.
+ */
+enum class LineKind
+{
+   BlockHeader,
+   Insertion,
+   Text,
+   Other,
+};
+
+LineKind classifyLine(std::string_view line, std::string_view* type = nullptr) noexcept
+{
+   size_t pos = 0;
+   while ((pos < line.size()) && (line[pos] == ' '))
+   {
+      ++pos;
+   }
+
+   if (pos == line.size())
+   {
+      return LineKind::Other;
+   }
+
+   const char first = line[pos];
+   if (first == '<')
+   {
+      return LineKind::Insertion;
+   }
+
+   if (!samx::isIdentifierFirst(first))
+   {
+      return ((first >= '0') && (first <= '9')) || ((first >= 0x2b) && (first <= 0x2f)) ? LineKind::Text
+                                                                                       : LineKind::Other;
+   }
+
+   const size_t typeBegin = pos;
+   while ((pos < line.size()) && samx::isIdentifierOther(line[pos]))
+   {
+      ++pos;
+   }
+
+   if ((pos == line.size()) || (line[pos] != ':'))
+   {
+      return LineKind::Text;
+   }
+
+   if (type != nullptr)
+   {
+      *type = line.substr(typeBegin, pos + 1 - typeBegin);
+   }
+
+   return LineKind::BlockHeader;
+}
+
+/*
+ * One element of Content: the only alternative that can match is selected up front,
+ * instead of matching every paragraph as a block header first.
+ */
+struct Element
+{
+   template <pegtl::apply_mode A,
+             pegtl::rewind_mode M,
+             template <typename...>
+             class Action,
+             template <typename...>
+             class Control,
+             typename Input,
+             typename... States>
+   static bool match(Input& in, States&&... st)
+   {
+      switch (classifyLine(std::string_view(in.current(), in.size())))
+      {
+      case LineKind::BlockHeader:
+         return Control<Block>::template match<A, M, Action, Control>(in, st...);
+
+      case LineKind::Insertion:
+         return Control<InsertionLine>::template match<A, M, Action, Control>(in, st...);
+
+      case LineKind::Text:
+         return Control<Paragraph>::template match<A, M, Action, Control>(in, st...);
+
+      case LineKind::Other:
+         break;
+      }
+
+      return false;
+   }
+};
+
 struct Grammar : pegtl::seq<Content, pegtl::eof>
 {
 };
 
+/*
+ * Line-level rules, used when the structure is provided by the Normalizer instead of
+ * the {{ }} markers
+ */
+// the header of a block after its type, which is found by classifyLine
+struct BlockLineTail : pegtl::seq<WhiteSpace, BlockDescription, WhiteSpace, pegtl::eof>
+{
+};
+
+struct ParagraphLine : pegtl::seq<ParagraphText, pegtl::eof>
+{
+};
+
+struct BlockInsertionLine : pegtl::seq<BlockInsertion, WhiteSpace, pegtl::eof>
+{
+};
+
+/*
+ * Parser state between actions: the handler, the header of the block being recognized
+ * and the text of the paragraph being recognized, as views of the input.
+ */
+struct ParseState
+{
+   samx::DocumentHandler& handler;
+
+   std::string_view              type;
+   std::string_view              description;
+   std::vector<std::string_view> segments;
+   std::string_view              resource;
+};
+
 template <typename Rule>
 struct Action
 {
@@ -108,14 +251,12 @@ template <>
 struct Action<ParagraphText>
 {
    template <typename Input>
-   static void apply(const Input& in, samx::Document& doc)
+   static void apply(const Input& in, ParseState& state)
    {
 #ifdef MANUAL_TRACE
       std::cerr << "Text: " << in.string_view() << '\n';
-#else
-      (void)in;
 #endif
-      doc.pushText(in.string_view());
+      state.segments.push_back(in.string_view());
    }
 };
 
@@ -123,9 +264,17 @@ template <>
 struct Action<Paragraph>
 {
    template <typename Input>
-   static void apply(const Input& /* in */, samx::Document& doc)
+   static void apply(const Input& in, ParseState& state)
    {
-      doc.pushParagraph();
+      // text matched by paragraph attempts that failed earlier is not part of this one
+      const auto stale =
+         std::find_if(state.segments.cbegin(), state.segments.cend(), [&in](const std::string_view& segment) {
+            return segment.data() >= in.begin();
+         });
+      state.segments.erase(state.segments.cbegin(), stale);
+
+      state.handler.onParagraph(state.segments);
+      state.segments.clear();
    }
 };
 
@@ -133,9 +282,9 @@ template <>
 struct Action<BlockIdentifier>
 {
    template <typename Input>
-   static void apply(const Input& in, samx::Document& doc)
+   static void apply(const Input& in, ParseState& state)
    {
-      doc.observeIdentifier(in.string_view());
+      state.type = in.string_view();
    }
 };
 
@@ -143,21 +292,21 @@ template <>
 struct Action<BlockDescription>
 {
    template <typename Input>
-   static void apply(const Input& in, samx::Document& doc)
+   static void apply(const Input& in, ParseState& state)
    {
-      doc.observeDescription(in.string_view());
+      state.description = in.string_view();
    }
 };
 
 template <>
-struct Action<BlockStart>
+struct Action<BlockHeaderLine>
 {
-   static void apply0(samx::Document& doc)
+   static void apply0(ParseState& state)
    {
 #ifdef MANUAL_TRACE
       std::cerr << "BlockStart\n";
 #endif
-      doc.startBlock();
+      state.handler.onBlockStart(state.type, state.description);
    }
 };
 
@@ -165,14 +314,34 @@ template <>
 struct Action<Block>
 {
    template <typename Input>
-   static void apply(const Input& in, samx::Document& doc)
+   static void apply(const Input& in, ParseState& state)
    {
 #ifdef MANUAL_TRACE
       std::cerr << "Block: " << in.size() << '\n';
 #else
       (void)in;
 #endif
-      doc.finishBlock();
+      state.segments.clear();
+      state.handler.onBlockEnd();
+   }
+};
+
+template <>
+struct Action<ExternalResource>
+{
+   template <typename Input>
+   static void apply(const Input& in, ParseState& state)
+   {
+      state.resource = in.string_view();
+   }
+};
+
+template <>
+struct Action<InsertionLine>
+{
+   static void apply0(ParseState& state)
+   {
+      state.handler.onInsertion(state.resource);
    }
 };
 
@@ -180,7 +349,7 @@ template <>
 struct Action<Content>
 {
    template <typename Input>
-   static void apply(const Input& in, samx::Document& /* doc */)
+   static void apply(const Input& in, ParseState& /* state */)
    {
 #ifdef MANUAL_TRACE
       std::cerr << "Content: " << in.size() << '\n';
@@ -190,35 +359,526 @@ struct Action<Content>
    }
 };
 
+template <typename Rule>
+struct LineAction
+{
+};
+
+/*
+ * Translates the events produced by the Normalizer into handler events, following the same
+ * rules as Grammar: a paragraph is terminated by an empty line and an indented block
+ * must follow a block header.
+ */
+class LineParser : public samx::IndentationObserver
+{
+public:
+   /*
+    * Lines are stable if they are views of a source that outlives the parse; otherwise
+    * the paragraph text is joined here, as the lines are transient.
+    */
+   LineParser(samx::DocumentHandler& handler, bool stableLines) : m_handler{handler}, m_stableLines{stableLines}
+   {
+   }
+
+   void indent() override
+   {
+      if (!m_headerPending)
+      {
+         throw std::runtime_error("Failed to parse input: indented content does not follow a block header");
+      }
+
+      // the block started with its header
+      m_headerPending = false;
+   }
+
+   void deindent() override
+   {
+      if (m_paragraphOpen)
+      {
+         throw std::runtime_error("Failed to parse input: paragraph is not followed by an empty line");
+      }
+
+      finishPendingHeader();
+
+      m_handler.onBlockEnd();
+   }
+
+   void line(std::string_view text) override;
+
+   void emptyLine() override
+   {
+      // outside of paragraphs, empty lines only separate elements
+      if (m_paragraphOpen)
+      {
+         if (!m_stableLines)
+         {
+            m_segments.assign(1, m_paragraph);
+         }
+
+         m_handler.onParagraph(m_segments);
+
+         m_segments.clear();
+         m_paragraph.clear();
+         m_paragraphOpen = false;
+      }
+   }
+
+   void finish()
+   {
+      if (m_paragraphOpen)
+      {
+         throw std::runtime_error("Failed to parse input: paragraph is not followed by an empty line");
+      }
+
+      finishPendingHeader();
+   }
+
+   void appendText(std::string_view segment)
+   {
+      if (m_stableLines)
+      {
+         m_segments.push_back(segment);
+         return;
+      }
+
+      if (!m_paragraph.empty())
+      {
+         m_paragraph.push_back(' ');
+      }
+      m_paragraph.append(segment);
+   }
+
+   void observeDescription(std::string_view description) noexcept
+   {
+      m_description = description;
+   }
+
+   void observeResource(std::string_view resource) noexcept
+   {
+      m_resource = resource;
+   }
+
+private:
+   void finishPendingHeader()
+   {
+      // a block without indented content ends at the next line
+      if (m_headerPending)
+      {
+         m_handler.onBlockEnd();
+         m_headerPending = false;
+      }
+   }
+
+   samx::DocumentHandler& m_handler;
+   const bool             m_stableLines;
+
+   // header of the current line
+   std::string_view m_description;
+   std::string_view m_resource;
+
+   std::vector<std::string_view> m_segments;
+   std::string                   m_paragraph;
+
+   bool m_paragraphOpen = false;
+   bool m_headerPending = false;
+};
+
+template <>
+struct LineAction<ParagraphText>
+{
+   template <typename Input>
+   static void apply(const Input& in, LineParser& parser)
+   {
+      parser.appendText(in.string_view());
+   }
+};
+
+template <>
+struct LineAction<BlockDescription>
+{
+   template <typename Input>
+   static void apply(const Input& in, LineParser& parser)
+   {
+      parser.observeDescription(in.string_view());
+   }
+};
+
+template <>
+struct LineAction<ExternalResource>
+{
+   template <typename Input>
+   static void apply(const Input& in, LineParser& parser)
+   {
+      parser.observeResource(in.string_view());
+   }
+};
+
+void LineParser::line(std::string_view text)
+{
+   if (m_paragraphOpen)
+   {
+      pegtl::memory_input in(text.data(), text.size(), "");
+      if (!pegtl::parse<ParagraphLine, LineAction>(in, *this))
+      {
+         throw std::runtime_error(fmt::format("Failed to parse input: invalid paragraph text '{}'", text));
+      }
+
+      return;
+   }
+
+   finishPendingHeader();
+
+   pegtl::memory_input in(text.data(), text.size(), "");
+
+   std::string_view type;
+   switch (classifyLine(text, &type))
+   {
+   case LineKind::BlockHeader:
+   {
+      // the type is not matched again
+      const auto tailOffset = static_cast<size_t>(type.data() - text.data()) + type.size();
+
+      pegtl::memory_input tail(text.data() + tailOffset, text.size() - tailOffset, "");
+      if (pegtl::parse<BlockLineTail, LineAction>(tail, *this))
+      {
+         m_handler.onBlockStart(type, m_description);
+         m_headerPending = true;
+         return;
+      }
+      break;
+   }
+
+   case LineKind::Insertion:
+      if (pegtl::parse<BlockInsertionLine, LineAction>(in, *this))
+      {
+         m_handler.onInsertion(m_resource);
+         return;
+      }
+      break;
+
+   case LineKind::Text:
+      if (pegtl::parse<ParagraphLine, LineAction>(in, *this))
+      {
+         m_paragraphOpen = true;
+         return;
+      }
+      break;
+
+   case LineKind::Other:
+      break;
+   }
+
+   throw std::runtime_error(fmt::format("Failed to parse input: unexpected line '{}'", text));
+}
+
 } // namespace
 
-samx::Document samx::parse(std::string_view input)
+struct samx::EventParser::Impl
 {
-   samx::Document doc;
+   explicit Impl(DocumentHandler& handler) : parser{handler, false}
+   {
+   }
 
-   pegtl::memory_input in(input.data(), input.size(), "");
+   LineParser parser;
+};
 
-   try
+namespace
+{
+
+template <typename Input>
+void normalizeInto(Input&                    input,
+                   samx::DocumentHandler&    handler,
+                   samx::NormalizerCounters* counters    = nullptr,
+                   samx::Diagnostics*        diagnostics = nullptr)
+{
+   // lines are views of in-memory sources
+   LineParser       parser{handler, std::is_same_v<Input, std::string_view>};
+   samx::Normalizer normalizer{parser};
+
+   if (diagnostics != nullptr)
    {
-      auto result = pegtl::parse<Grammar, Action /*, pegtl::tracer */>(in, doc);
-      if (result)
+      normalizer.setDiagnostics(*diagnostics);
+   }
+
+   const auto collect = [&normalizer, counters, diagnostics]() {
+      if (counters != nullptr)
       {
-         std::cerr << "Parse succeeded!\n";
+         *counters = normalizer.getCounters();
       }
-      else
+
+      if (diagnostics == nullptr)
       {
-         std::cerr << "Parse failed\n";
+         normalizer.getDiagnostics().report(std::cerr);
       }
+   };
+
+   try
+   {
+      normalizer.normalize(input);
+      parser.finish();
+   }
+   catch (...)
+   {
+      collect();
+      throw;
+   }
+
+   collect();
+}
+
+template <typename Input>
+samx::Document buildDocument(Input& input, std::shared_ptr<const void> sourceOwner, samx::DocumentArena* arena)
+{
+   samx::Document doc = (arena != nullptr) ? samx::Document{*arena} : samx::Document{};
+   doc.shareSource(std::move(sourceOwner));
+
+   normalizeInto(input, doc);
+
+   return doc;
+}
+
+bool parseElements(std::string_view input, samx::DocumentHandler& handler)
+{
+   pegtl::memory_input in(input.data(), input.size(), "");
+
+   ParseState state{handler, {}, {}, {}, {}};
+
+   try
+   {
+      return pegtl::parse<Grammar, Action /*, pegtl::tracer */>(in, state);
    }
    catch (const tao::pegtl::parse_error& parseError)
    {
       throw std::runtime_error(fmt::format("Failed to parse input: {}", parseError.std::exception::what()));
    }
+   catch (const std::runtime_error& /* re */)
+   {
+      // raised by the handler, for example for an insertion that cannot be resolved
+      throw;
+   }
    catch (...)
    {
       std::cerr << "Unexpected error" << std::endl;
       throw std::runtime_error("Unexpected error");
    }
+}
+
+void parseInto(std::string_view input, samx::Document& doc)
+{
+   if (parseElements(input, doc))
+   {
+      std::cerr << "Parse succeeded!\n";
+   }
+   else
+   {
+      std::cerr << "Parse failed\n";
+   }
+}
+
+bool isBlankLine(std::string_view line) noexcept
+{
+   return line.empty() || (line == "\r");
+}
+
+/*
+ * Splits normalized text into pieces of about chunkSize bytes that can be parsed on their
+ * own. A piece starts at a top level element: a line outside of any {{ }} region, following
+ * an empty line or the end of a top level block. Any other line either continues the
+ * previous element or makes the whole input invalid.
+ */
+std::vector<std::string_view> splitTopLevel(std::string_view input, size_t chunkSize)
+{
+   std::vector<std::string_view> chunks;
+
+   const auto& scanner = samx::getBestLineScanner();
+
+   const char* const inputEnd   = input.data() + input.size();
+   const char*       chunkBegin = input.data();
+   const char*       lineBegin  = input.data();
+
+   size_t depth         = 0;
+   bool   elementCanEnd = false;
+
+   while (lineBegin < inputEnd)
+   {
+      const char* lineEnd = scanner.findNewLine(lineBegin, inputEnd);
+
+      const std::string_view line(lineBegin, static_cast<size_t>(lineEnd - lineBegin));
+
+      if (elementCanEnd && (depth == 0) && !isBlankLine(line) && (line[0] != '{') && (line[0] != '}') &&
+          (static_cast<size_t>(lineBegin - chunkBegin) >= chunkSize))
+      {
+         chunks.emplace_back(chunkBegin, static_cast<size_t>(lineBegin - chunkBegin));
+         chunkBegin = lineBegin;
+      }
+
+      // markers may be repeated on a line, and followed by content
+      std::string_view rest = line;
+      while ((rest.size() >= 2) && (rest.substr(0, 2) == "{{"))
+      {
+         ++depth;
+         rest.remove_prefix(2);
+      }
+
+      bool closed = false;
+      while ((rest.size() >= 2) && (rest.substr(0, 2) == "}}") && (depth > 0))
+      {
+         --depth;
+         rest.remove_prefix(2);
+         closed = true;
+      }
+
+      elementCanEnd = (closed && isBlankLine(rest)) || isBlankLine(line);
+
+      lineBegin = (lineEnd < inputEnd) ? (lineEnd + 1) : inputEnd;
+   }
+
+   chunks.emplace_back(chunkBegin, static_cast<size_t>(inputEnd - chunkBegin));
+
+   return chunks;
+}
+
+samx::Document
+parseParallel(std::string_view input, std::shared_ptr<const void> inputOwner, samx::ThreadPool& pool, samx::DocumentArena* arena)
+{
+   // several pieces per thread, so that the work can be balanced
+   const size_t chunkSize = std::max(k_MinimumChunkSize, input.size() / (pool.getThreadCount() * 4));
+
+   const auto chunks = splitTopLevel(input, chunkSize);
+   if (chunks.size() < 2)
+   {
+      return (inputOwner != nullptr) ? samx::parse(input, std::move(inputOwner), arena) : samx::parse(input, arena);
+   }
+
+   /*
+    * each piece is parsed into a document with its own arena, since arenas are not thread
+    * safe; they all intern their block types in the same table, so they can be joined
+    */
+   const auto symbols = std::make_shared<samx::SymbolTable>();
+
+   std::vector<std::optional<samx::Document>> pieces(chunks.size());
+   std::vector<char>                          succeeded(chunks.size(), 0);
+
+   for (size_t ii = 0; ii < chunks.size(); ++ii)
+   {
+      pool.submit([&chunks, &pieces, &succeeded, &inputOwner, &symbols, ii]() {
+         auto& piece = pieces[ii].emplace(symbols);
+         piece.shareSource(inputOwner);
+
+         succeeded[ii] = parseElements(chunks[ii], piece) ? 1 : 0;
+      });
+   }
+
+   bool failed = false;
+   try
+   {
+      pool.wait();
+   }
+   catch (const std::runtime_error&)
+   {
+      failed = true;
+   }
+
+   if (failed || std::find(succeeded.cbegin(), succeeded.cend(), 0) != succeeded.cend())
+   {
+      pieces.clear();
+      return (inputOwner != nullptr) ? samx::parse(input, std::move(inputOwner), arena) : samx::parse(input, arena);
+   }
+
+   samx::Document doc = (arena != nullptr) ? samx::Document{*arena, symbols} : samx::Document{symbols};
+   doc.shareSource(std::move(inputOwner));
+
+   for (auto& piece : pieces)
+   {
+      doc.append(std::move(*piece));
+   }
+
+   std::cerr << "Parse succeeded!\n";
 
    return doc;
 }
+
+} // namespace
+
+samx::Document samx::parse(std::string_view input, DocumentArena* arena)
+{
+   samx::Document doc = (arena != nullptr) ? samx::Document{*arena} : samx::Document{};
+
+   parseInto(input, doc);
+
+   return doc;
+}
+
+samx::Document samx::parse(std::string_view input, std::shared_ptr<const void> inputOwner, DocumentArena* arena)
+{
+   samx::Document doc = (arena != nullptr) ? samx::Document{*arena} : samx::Document{};
+   doc.shareSource(std::move(inputOwner));
+
+   parseInto(input, doc);
+
+   return doc;
+}
+
+bool samx::parse(std::string_view input, DocumentHandler& handler)
+{
+   return parseElements(input, handler);
+}
+
+samx::Document samx::normalizeAndParse(std::istream& input, DocumentArena* arena)
+{
+   return buildDocument(input, nullptr, arena);
+}
+
+samx::Document samx::normalizeAndParse(std::string_view source, DocumentArena* arena)
+{
+   return buildDocument(source, nullptr, arena);
+}
+
+samx::Document samx::parse(std::string_view input, ThreadPool& pool, DocumentArena* arena)
+{
+   return parseParallel(input, nullptr, pool, arena);
+}
+
+samx::Document
+samx::parse(std::string_view input, std::shared_ptr<const void> inputOwner, ThreadPool& pool, DocumentArena* arena)
+{
+   return parseParallel(input, std::move(inputOwner), pool, arena);
+}
+
+samx::Document
+samx::normalizeAndParse(std::string_view source, std::shared_ptr<const void> sourceOwner, DocumentArena* arena)
+{
+   return buildDocument(source, std::move(sourceOwner), arena);
+}
+
+void samx::normalizeAndParse(std::istream&       input,
+                             DocumentHandler&    handler,
+                             NormalizerCounters* counters,
+                             Diagnostics*        diagnostics)
+{
+   normalizeInto(input, handler, counters, diagnostics);
+}
+
+void samx::normalizeAndParse(std::string_view    source,
+                             DocumentHandler&    handler,
+                             NormalizerCounters* counters,
+                             Diagnostics*        diagnostics)
+{
+   normalizeInto(source, handler, counters, diagnostics);
+}
+
+samx::EventParser::EventParser(DocumentHandler& handler) : m_impl{std::make_unique<Impl>(handler)}
+{
+}
+
+samx::EventParser::~EventParser() = default;
+
+samx::IndentationObserver& samx::EventParser::getObserver() noexcept
+{
+   return m_impl->parser;
+}
+
+void samx::EventParser::finish()
+{
+   m_impl->parser.finish();
+}
@@ -17,9 +17,16 @@
 #ifndef SAMX_PARSER_H_INCLUDED
 #define SAMX_PARSER_H_INCLUDED
 
+#include "document_arena.h"
+#include "document_handler.h"
+#include "symbol_table.h"
+
 #include <algorithm>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <memory_resource>
 #include <ostream>
-#include <stack>
 #include <string>
 #include <string_view>
 #include <variant>
@@ -28,30 +35,124 @@
 namespace samx
 {
 
-class Paragraph;
+class Diagnostics;
+class IndentationObserver;
+class ThreadPool;
+struct NormalizerCounters;
+
+/*
+ * Changes whenever the same source would produce a different document; saved documents
+ * (see ParseCache) are keyed by it.
+ */
+constexpr uint32_t k_GrammarVersion = 1;
+
+/*
+ * Characters of block types and inserted resource names, as matched by the grammar
+ * (pegtl::identifier); for the scans that look ahead of the parser.
+ */
+constexpr bool isIdentifierFirst(char ch) noexcept
+{
+   return ((ch >= 'a') && (ch <= 'z')) || ((ch >= 'A') && (ch <= 'Z')) || (ch == '_');
+}
+
+constexpr bool isIdentifierOther(char ch) noexcept
+{
+   return isIdentifierFirst(ch) || ((ch >= '0') && (ch <= '9'));
+}
+
+class Paragraph
+{
+public:
+   enum class TextStorage
+   {
+      // the segments are joined into a buffer owned by the paragraph
+      Copy,
+
+      // the paragraph keeps views of the segments, which must outlive it
+      Reference,
+   };
+
+   Paragraph(const std::vector<std::string_view>& segments,
+             std::pmr::memory_resource*           resource,
+             TextStorage                          storage = TextStorage::Copy);
+
+   Paragraph(const Paragraph& other) = default;
+   Paragraph(Paragraph&& other)      = default;
+   ~Paragraph()                      = default;
+   Paragraph& operator=(const Paragraph& other) = default;
+   Paragraph& operator=(Paragraph&& other) = default;
+
+   /*
+    * Returns a copy of the text, with the segments joined; the paragraph is not modified,
+    * so documents shared across threads can be read this way. forEachSegment avoids the
+    * copy.
+    */
+   std::string getText() const;
+
+   /*
+    * Visits the text segments, which are to be separated by a single space; no joining
+    * takes place.
+    */
+   template <typename Visitor>
+   void forEachSegment(Visitor visitor) const
+   {
+      if (!m_text.empty())
+      {
+         visitor(std::string_view(m_text.data(), m_text.size() - 1));
+      }
+      else if (m_segments.empty())
+      {
+         visitor(m_view);
+      }
+      else
+      {
+         std::for_each(m_segments.cbegin(), m_segments.cend(), visitor);
+      }
+   }
+
+private:
+   void join(const std::string_view* first, const std::string_view* last);
+
+   // copied text, joined, with a trailing '\0'
+   std::pmr::vector<char> m_text;
+
+   // referenced text: single segments are kept inline
+   std::string_view                   m_view;
+   std::pmr::vector<std::string_view> m_segments;
+};
 
 class Block
 {
 public:
    using Element = std::variant<Block, Paragraph>;
 
-   Block(std::string&& type, std::string&& description, std::vector<Element>&& elements)
+   // the symbol belongs to the document's SymbolTable
+   Block(const Symbol& type, std::pmr::string&& description, std::pmr::vector<Element>&& elements) :
+      m_type{&type}, m_description{std::move(description)}, m_elements{std::move(elements)}
    {
-      std::swap(m_type, type);
-      std::swap(m_description, description);
-      std::swap(m_elements, elements);
    }
 
    void setContents() noexcept
    {
    }
 
-   const std::string& getType() const noexcept
+   std::string_view getType() const noexcept
    {
-      return m_type;
+      return m_type->name;
    }
 
-   const std::string& getDescription() const noexcept
+   // same for the same type, across all the documents sharing a SymbolTable
+   SymbolId getTypeId() const noexcept
+   {
+      return m_type->id;
+   }
+
+   const Symbol& getTypeSymbol() const noexcept
+   {
+      return *m_type;
+   }
+
+   std::string_view getDescription() const noexcept
    {
       return m_description;
    }
@@ -65,58 +166,104 @@ public:
    }
 
 private:
-   std::string          m_type;
-   std::string          m_description;
-   std::vector<Element> m_elements;
+   const Symbol*             m_type;
+   std::pmr::string          m_description;
+   std::pmr::vector<Element> m_elements;
 };
 
-class Paragraph
+/*
+ * Shape and size of a Document; see Document::getCounters.
+ */
+struct DocumentCounters
 {
-public:
-   explicit Paragraph(const std::vector<std::string_view>& segments);
-
-   Paragraph(const Paragraph& other) = default;
-   Paragraph(Paragraph&& other)      = default;
-   ~Paragraph()                      = default;
-   Paragraph& operator=(const Paragraph& other) = default;
-   Paragraph& operator=(Paragraph&& other) = default;
-
-   std::string_view getText() const
-   {
-      return std::string_view(m_text.data(), m_text.size() - 1);
-   }
+   size_t blocks     = 0;
+   size_t paragraphs = 0;
+   size_t maxDepth   = 0;
 
-private:
-   std::vector<char> m_text;
+   // capacity of the arenas owned by the document, including those taken over by append
+   size_t storageBytes = 0;
 };
 
-class Document
+/*
+ * All the nodes of a Document are allocated from a DocumentArena: either its own, or one
+ * provided by the caller and reused across documents (see DocumentArena::reset). Block
+ * types are interned in a SymbolTable: the document's own, or one shared with other
+ * documents.
+ *
+ * A Document is built by the parser through the DocumentHandler interface.
+ */
+class Document : public DocumentHandler
 {
 public:
+   Document();
+
+   // the arena must outlive the document
+   explicit Document(DocumentArena& arena);
+
+   explicit Document(std::shared_ptr<SymbolTable> symbols);
+   Document(DocumentArena& arena, std::shared_ptr<SymbolTable> symbols);
+
+   Document(const Document& other) = delete;
+   Document(Document&& other)      = default;
+   ~Document() override            = default;
+   Document& operator=(const Document& other) = delete;
+   Document& operator=(Document&& other) = delete;
+
    size_t getBlockCount() const noexcept
    {
       return m_elements.size();
    }
 
-   void pushText(std::string_view segment)
+   /*
+    * Keeps the source alive for as long as the document; paragraphs then reference their
+    * text in the source instead of copying it.
+    */
+   void shareSource(std::shared_ptr<const void> source)
    {
-      m_textAccumulator.push_back(segment);
+      m_source = std::move(source);
    }
 
-   void pushParagraph();
+   bool referencesSource() const noexcept
+   {
+      return m_source != nullptr;
+   }
 
-   void observeIdentifier(std::string_view segment)
+   const SymbolTable& getSymbols() const noexcept
    {
-      m_currentIdentifier = segment;
+      return *m_symbols;
    }
 
-   void observeDescription(std::string_view segment)
+   // for documents to be joined with this one; see append
+   const std::shared_ptr<SymbolTable>& shareSymbols() const noexcept
    {
-      m_currentDescription = segment;
+      return m_symbols;
    }
 
-   void startBlock();
-   void finishBlock();
+   /*
+    * Walks the document, so that building it costs nothing extra; the storage of a
+    * caller-provided arena is not included.
+    */
+   DocumentCounters getCounters() const;
+
+   void onBlockStart(std::string_view type, std::string_view description) override;
+   void onBlockEnd() override;
+   void onParagraph(const std::vector<std::string_view>& segments) override;
+   void onInsertedText(std::shared_ptr<const void> owner) override;
+
+   /*
+    * Moves the top level elements of a separately parsed document after the elements of
+    * this one, and takes over its arena. If the other document uses a caller-provided
+    * arena instead, that arena must outlive this document. Documents that reference
+    * their source must reference the same one, and both must use the same SymbolTable.
+    */
+   void append(Document&& other);
+
+   /*
+    * Same as above, for the count top level elements starting at first: they are destroyed
+    * and the elements of the other document take their place. The other elements are moved,
+    * not copied.
+    */
+   void replaceElements(size_t first, size_t count, Document&& other);
 
    template <typename Visitor>
    void forEachElement(Visitor visitor) const
@@ -126,22 +273,155 @@ public:
       });
    }
 
+   // the count top level elements starting at first, which render independently
+   template <typename Visitor>
+   void forEachElement(size_t first, size_t count, Visitor visitor) const
+   {
+      const auto begin = m_elements.cbegin() + static_cast<std::ptrdiff_t>(first);
+      std::for_each(begin, begin + static_cast<std::ptrdiff_t>(count), [&visitor](const Block::Element& elem) {
+         std::visit(visitor, elem);
+      });
+   }
+
 private:
-   std::vector<std::string_view> m_textAccumulator;
+   Document(std::unique_ptr<DocumentArena> ownArena,
+            std::pmr::memory_resource*     resource,
+            std::shared_ptr<SymbolTable>   symbols);
 
-   std::stack<std::string> m_identifierStack;
-   std::string             m_currentIdentifier;
+   // a block whose contents are being parsed, with the contents of its parent so far
+   struct OpenBlock
+   {
+      const Symbol*                    type;
+      std::pmr::string                 description;
+      std::pmr::vector<Block::Element> parentElements;
+   };
 
-   std::stack<std::string> m_descriptionStack;
-   std::string             m_currentDescription;
+   // declared first, so they are destroyed after everything allocated from them
+   std::unique_ptr<DocumentArena>              m_ownArena;
+   std::vector<std::unique_ptr<DocumentArena>> m_appendedArenas;
 
-   std::stack<std::vector<Block::Element>> m_elementStack;
-   std::vector<Block::Element>             m_elements;
+   std::pmr::memory_resource* m_resource;
+
+   std::shared_ptr<const void> m_source;
+
+   // owners of the text of inserted fragments, referenced as well when the source is
+   std::vector<std::shared_ptr<const void>> m_insertedText;
+
+   std::shared_ptr<SymbolTable> m_symbols;
+
+   // siblings tend to share their type, which then needs no lookup
+   const Symbol* m_lastType = nullptr;
+
+   std::pmr::vector<OpenBlock> m_openBlocks;
+
+   // elements of the innermost open block, or top level elements
+   std::pmr::vector<Block::Element> m_elements;
 };
 
-Document parse(std::string_view input);
+/*
+ * Parses normalized text, as produced by the Normalizer. The document allocates from the
+ * given arena if there is one, or from its own otherwise.
+ */
+Document parse(std::string_view input, DocumentArena* arena = nullptr);
+
+/*
+ * Same as above; the document shares ownership of the input and references the paragraph
+ * text in it, instead of copying it.
+ */
+Document parse(std::string_view input, std::shared_ptr<const void> inputOwner, DocumentArena* arena = nullptr);
+
+/*
+ * Parallel versions of the above: the input is split at top level element boundaries and
+ * the pieces are parsed concurrently on the pool, then joined in order. The result is the
+ * same as the sequential parse; on error, the input is parsed again sequentially, so that
+ * errors are reported the same way. Must not be called from one of the pool's workers.
+ */
+Document parse(std::string_view input, ThreadPool& pool, DocumentArena* arena = nullptr);
+
+Document parse(std::string_view            input,
+               std::shared_ptr<const void> inputOwner,
+               ThreadPool&                 pool,
+               DocumentArena*              arena = nullptr);
+
+/*
+ * Parses normalized text, reporting its elements to the handler. Returns false if the
+ * input is not valid; the handler has then received the elements preceding the error.
+ */
+bool parse(std::string_view input, DocumentHandler& handler);
+
+/*
+ * Normalizes and parses the input in a single pass; the parser consumes the indentation
+ * events directly, without materializing the normalized text. Indentation errors are
+ * written to std::cerr.
+ */
+Document normalizeAndParse(std::istream& input, DocumentArena* arena = nullptr);
+
+/*
+ * Same as above, for sources already in memory (for example memory-mapped files);
+ * the source is not copied.
+ */
+Document normalizeAndParse(std::string_view source, DocumentArena* arena = nullptr);
+
+/*
+ * Same as above; the document shares ownership of the source and references the paragraph
+ * text in it, instead of copying it.
+ */
+Document
+normalizeAndParse(std::string_view source, std::shared_ptr<const void> sourceOwner, DocumentArena* arena = nullptr);
+
+/*
+ * Normalizes and parses the input in a single pass, reporting its elements to the handler;
+ * throws std::runtime_error if the input is not valid. The normalizer counters are stored
+ * if requested, also on error. Indentation errors are recorded in the diagnostics if given,
+ * or written to std::cerr otherwise.
+ */
+void normalizeAndParse(std::istream&       input,
+                       DocumentHandler&    handler,
+                       NormalizerCounters* counters    = nullptr,
+                       Diagnostics*        diagnostics = nullptr);
+
+void normalizeAndParse(std::string_view    source,
+                       DocumentHandler&    handler,
+                       NormalizerCounters* counters    = nullptr,
+                       Diagnostics*        diagnostics = nullptr);
+
+/*
+ * The parser used by normalizeAndParse, for indentation events produced elsewhere, for
+ * example by a Normalizer on another thread. The lines are transient, so paragraph text
+ * is copied.
+ */
+class EventParser
+{
+public:
+   explicit EventParser(DocumentHandler& handler);
+
+   EventParser(const EventParser& other) = delete;
+   EventParser(EventParser&& other)      = delete;
+   ~EventParser();
+   EventParser& operator=(const EventParser& other) = delete;
+   EventParser& operator=(EventParser&& other) = delete;
+
+   // receives the events; throws std::runtime_error if the input is not valid
+   IndentationObserver& getObserver() noexcept;
+
+   // after the last event; throws std::runtime_error if the input ends inside an element
+   void finish();
+
+private:
+   struct Impl;
+
+   std::unique_ptr<Impl> m_impl;
+};
 } // namespace samx
 
 std::ostream& operator<<(std::ostream& os, const samx::Document& doc);
 
+namespace samx
+{
+/*
+ * Same as operator<<, returning the number of bytes written.
+ */
+size_t print(std::ostream& os, const Document& doc);
+} // namespace samx
+
 #endif // SAMX_PARSER_H_INCLUDED
@@ -16,21 +16,46 @@
 
 #include "samx_parser.h"
 
+#include "document_printer.h"
+#include "flat_document.h"
+#include "output_sink.h"
+
 #include <algorithm>
 #include <cassert>
+#include <functional>
 #include <iostream>
+#include <iterator>
 #include <numeric>
 #include <string_view>
 
-samx::Paragraph::Paragraph(const std::vector<std::string_view>& segments)
+samx::Paragraph::Paragraph(const std::vector<std::string_view>& segments,
+                           std::pmr::memory_resource*           resource,
+                           TextStorage                          storage) :
+   m_text{resource}, m_segments{resource}
+{
+   if (storage == TextStorage::Copy)
+   {
+      join(segments.data(), segments.data() + segments.size());
+   }
+   else if (segments.size() == 1)
+   {
+      m_view = segments.front();
+   }
+   else
+   {
+      m_segments.assign(segments.cbegin(), segments.cend());
+   }
+}
+
+void samx::Paragraph::join(const std::string_view* first, const std::string_view* last)
 {
-   size_t paragraphLength = std::accumulate(
-      segments.cbegin(), segments.cend(), size_t{0U}, [](size_t partial, const std::string_view& view) {
+   size_t paragraphLength =
+      std::accumulate(first, last, size_t{0U}, [](size_t partial, const std::string_view& view) {
          return partial + view.size();
       });
 
-   m_text.reserve(paragraphLength + segments.size() + 1);
-   std::for_each(segments.cbegin(), segments.cend(), [this](const std::string_view& view) {
+   m_text.reserve(paragraphLength + static_cast<size_t>(last - first) + 1);
+   std::for_each(first, last, [this](const std::string_view& view) {
       m_text.insert(m_text.end(), view.cbegin(), view.cend());
       m_text.push_back(' ');
    });
@@ -38,114 +63,229 @@ samx::Paragraph::Paragraph(const std::vector<std::string_view>& segments)
    m_text.back() = '\0';
 }
 
-void samx::Document::pushParagraph()
+std::string samx::Paragraph::getText() const
 {
-   m_elements.emplace_back(Paragraph{m_textAccumulator});
+   std::string text;
+   bool        first = true;
 
-   m_textAccumulator.clear();
+   forEachSegment([&text, &first](std::string_view segment) {
+      if (!first)
+      {
+         text.push_back(' ');
+      }
+
+      text.append(segment);
+      first = false;
+   });
+
+   return text;
 }
 
-void samx::Document::startBlock()
+samx::Document::Document() : Document{std::make_shared<SymbolTable>()}
 {
-   m_identifierStack.push(std::move(m_currentIdentifier));
-   m_currentIdentifier = std::string();
+}
 
-   m_descriptionStack.push(std::move(m_currentDescription));
-   m_currentDescription = std::string();
+samx::Document::Document(DocumentArena& arena) : Document{arena, std::make_shared<SymbolTable>()}
+{
+}
 
-   m_elementStack.push(std::move(m_elements));
-   m_elements = std::vector<Block::Element>();
+samx::Document::Document(std::shared_ptr<SymbolTable> symbols) :
+   Document{std::make_unique<DocumentArena>(), nullptr, std::move(symbols)}
+{
 }
 
-void samx::Document::finishBlock()
+samx::Document::Document(DocumentArena& arena, std::shared_ptr<SymbolTable> symbols) :
+   Document{nullptr, arena.getResource(), std::move(symbols)}
 {
-   if (!m_identifierStack.empty())
-   {
-      std::swap(m_currentIdentifier, m_identifierStack.top());
-      std::swap(m_currentDescription, m_descriptionStack.top());
-      m_identifierStack.pop();
-      m_descriptionStack.pop();
-   }
-   else
-   {
-      assert(m_elementStack.empty());
-   }
+}
+
+samx::Document::Document(std::unique_ptr<DocumentArena> ownArena,
+                         std::pmr::memory_resource*     resource,
+                         std::shared_ptr<SymbolTable>   symbols) :
+   m_ownArena{std::move(ownArena)},
+   m_resource{m_ownArena ? m_ownArena->getResource() : resource},
+   m_symbols{std::move(symbols)},
+   m_openBlocks{m_resource},
+   m_elements{m_resource}
+{
+}
 
+void samx::Document::onBlockStart(std::string_view type, std::string_view description)
+{
 #ifdef MANUAL_TRACE
-   std::cerr << "-- Block(" << m_currentIdentifier << ", " << m_currentDescription << ")\n";
+   std::cerr << "-- Block(" << type << ", " << description << ")\n";
 #endif
 
-   if (!m_elementStack.empty())
+   if ((m_lastType == nullptr) || (m_lastType->name != type))
    {
-      m_elementStack.top().emplace_back(
-         Block{std::move(m_currentIdentifier), std::move(m_currentDescription), std::move(m_elements)});
-
-      std::swap(m_elements, m_elementStack.top());
-      m_elementStack.pop();
+      m_lastType = &m_symbols->intern(type);
    }
-   else
+
+   m_openBlocks.push_back(OpenBlock{m_lastType, std::pmr::string{description, m_resource}, std::move(m_elements)});
+   m_elements.clear();
+}
+
+void samx::Document::onBlockEnd()
+{
+   assert(!m_openBlocks.empty());
+
+   auto& openBlock = m_openBlocks.back();
+
+   Block block{*openBlock.type, std::move(openBlock.description), std::move(m_elements)};
+
+   m_elements = std::move(openBlock.parentElements);
+   m_openBlocks.pop_back();
+
+   m_elements.emplace_back(std::move(block));
+}
+
+void samx::Document::onParagraph(const std::vector<std::string_view>& segments)
+{
+   m_elements.emplace_back(std::in_place_type<Paragraph>,
+                           segments,
+                           m_resource,
+                           referencesSource() ? Paragraph::TextStorage::Reference : Paragraph::TextStorage::Copy);
+}
+
+void samx::Document::onInsertedText(std::shared_ptr<const void> owner)
+{
+   // a fragment is often inserted several times in a row
+   if (referencesSource() && (m_insertedText.empty() || (m_insertedText.back() != owner)))
    {
-      m_elements.emplace_back(
-         Block{std::move(m_currentIdentifier), std::move(m_currentDescription), std::vector<Block::Element>()});
+      m_insertedText.push_back(std::move(owner));
    }
-
-   m_currentIdentifier  = std::string_view();
-   m_currentDescription = std::string_view();
-   m_textAccumulator.clear();
 }
 
-namespace
+void samx::Document::append(Document&& other)
 {
-class StreamPrinter
+   replaceElements(m_elements.size(), 0, std::move(other));
+}
+
+void samx::Document::replaceElements(size_t first, size_t count, Document&& other)
 {
-public:
-   explicit StreamPrinter(std::ostream& os) : m_os{os}
+   assert(first + count <= m_elements.size());
+   assert(m_symbols == other.m_symbols);
+
+   if (other.m_ownArena)
    {
+      m_appendedArenas.push_back(std::move(other.m_ownArena));
    }
 
-   void increaseLevel() noexcept
+   std::move(other.m_appendedArenas.begin(), other.m_appendedArenas.end(), std::back_inserter(m_appendedArenas));
+   other.m_appendedArenas.clear();
+
+   if (!m_source)
    {
-      ++m_level;
+      m_source = std::move(other.m_source);
    }
 
-   void decreaseLevel() noexcept
+   std::move(other.m_insertedText.begin(), other.m_insertedText.end(), std::back_inserter(m_insertedText));
+   other.m_insertedText.clear();
+
+   /*
+    * The elements keep their allocators when move constructed, so nothing is copied; shifting
+    * them in place would move assign them instead, which copies across different arenas.
+    * Replacing the same number of elements move assigns only the replaced ones.
+    */
+   if (count == other.m_elements.size())
+   {
+      // typical for small edits; only the replaced elements are touched
+      std::move(other.m_elements.begin(),
+                other.m_elements.end(),
+                std::next(m_elements.begin(), static_cast<ptrdiff_t>(first)));
+   }
+   else if ((first == m_elements.size()) && (count == 0))
    {
-      --m_level;
+      m_elements.reserve(m_elements.size() + other.m_elements.size());
+      std::move(other.m_elements.begin(), other.m_elements.end(), std::back_inserter(m_elements));
    }
+   else
+   {
+      const auto prefixEnd = std::next(m_elements.begin(), static_cast<ptrdiff_t>(first));
+      const auto suffix    = std::next(prefixEnd, static_cast<ptrdiff_t>(count));
 
-   void printIndent() const noexcept
+      std::pmr::vector<Block::Element> elements{m_resource};
+      elements.reserve(m_elements.size() - count + other.m_elements.size());
+
+      std::move(m_elements.begin(), prefixEnd, std::back_inserter(elements));
+      std::move(other.m_elements.begin(), other.m_elements.end(), std::back_inserter(elements));
+      std::move(suffix, m_elements.end(), std::back_inserter(elements));
+
+      m_elements = std::move(elements);
+   }
+
+   other.m_elements.clear();
+}
+
+namespace
+{
+class CountingVisitor
+{
+public:
+   explicit CountingVisitor(samx::DocumentCounters& counters) : m_counters{counters}
    {
-      for (int ii = 0; ii < m_level; ++ii)
-      {
-         m_os << "   ";
-      }
    }
 
-   void operator()(const samx::Paragraph& para)
+   void operator()(const samx::Paragraph& /* para */) noexcept
    {
-      printIndent();
-      m_os << para.getText() << "\n\n";
+      ++m_counters.paragraphs;
    }
 
    void operator()(const samx::Block& block)
    {
-      printIndent();
-      m_os << block.getType() << " " << block.getDescription() << "\n\n";
-      increaseLevel();
+      ++m_counters.blocks;
+
+      ++m_depth;
+      m_counters.maxDepth = std::max(m_counters.maxDepth, m_depth);
       block.forEachElement(*this);
-      decreaseLevel();
-      m_os << '\n';
+      --m_depth;
    }
 
 private:
-   std::ostream& m_os;
-   int           m_level = 0;
+   samx::DocumentCounters& m_counters;
+   size_t                  m_depth = 0;
 };
 } // namespace
 
+samx::DocumentCounters samx::Document::getCounters() const
+{
+   DocumentCounters counters;
+
+   forEachElement(CountingVisitor{counters});
+
+   if (m_ownArena)
+   {
+      counters.storageBytes += m_ownArena->getCapacity();
+   }
+
+   for (const auto& arena : m_appendedArenas)
+   {
+      counters.storageBytes += arena->getCapacity();
+   }
+
+   return counters;
+}
+
+size_t samx::print(std::ostream& os, const Document& doc)
+{
+   StreamSink sink{os};
+   return printTo(sink, doc);
+}
+
+size_t samx::print(std::ostream& os, const FlatDocument& doc)
+{
+   StreamSink sink{os};
+   return printTo(sink, doc);
+}
+
 std::ostream& operator<<(std::ostream& os, const samx::Document& doc)
 {
-   StreamPrinter printer(os);
-   doc.forEachElement(printer);
+   samx::print(os, doc);
+   return os;
+}
+
+std::ostream& operator<<(std::ostream& os, const samx::FlatDocument& doc)
+{
+   samx::print(os, doc);
    return os;
 }
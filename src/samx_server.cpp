@@ -0,0 +1,997 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "command_line.h"
+#include "diagnostics.h"
+#include "document_arena.h"
+#include "document_renderer.h"
+#include "include_cache.h"
+#include "mapped_file.h"
+#include "output_sink.h"
+#include "samx_parser.h"
+#include "symbol_table.h"
+#include "thread_pool.h"
+
+#include <fmt/core.h>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+const char* const k_Usage = "Usage: samx-server [-j threads] [--socket path [--connections count]]\n"
+                            "Without a socket, requests are read from the standard input.\n";
+
+// connections served at the same time, by default
+constexpr size_t k_DefaultConnectionCount = 16;
+
+/*
+ * A request is a single line holding a JSON object with string, number, boolean or null
+ * members:
+ *
+ *    {"id": 1, "op": "validate", "path": "doc.sam"}
+ *    {"id": 2, "op": "render", "format": "html", "content": "section: One\n"}
+ *    {"id": 3, "op": "stats"}
+ *
+ * The id, if any, is returned as it was given.
+ */
+struct Request
+{
+   std::string_view id     = "null";
+   std::string      op     = "validate";
+   std::string      format = "text";
+   std::string      path;
+
+   // inline content, used instead of reading the path
+   std::string content;
+   bool        hasContent = false;
+};
+
+/*
+ * Reads the members of a flat JSON object.
+ */
+class RequestReader
+{
+public:
+   explicit RequestReader(std::string_view text) noexcept : m_text{text}
+   {
+   }
+
+   Request read()
+   {
+      Request request;
+
+      expect('{');
+      if (!consume('}'))
+      {
+         do
+         {
+            std::string name;
+            readString(name);
+            expect(':');
+
+            skipSpace();
+            const auto valueStart = m_position;
+
+            if (name == "id")
+            {
+               skipValue();
+               request.id = m_text.substr(valueStart, m_position - valueStart);
+            }
+            else if (name == "op")
+            {
+               readString(request.op);
+            }
+            else if (name == "path")
+            {
+               readString(request.path);
+            }
+            else if (name == "content")
+            {
+               readString(request.content);
+               request.hasContent = true;
+            }
+            else if (name == "format")
+            {
+               readString(request.format);
+            }
+            else
+            {
+               skipValue();
+            }
+         } while (consume(','));
+
+         expect('}');
+      }
+
+      skipSpace();
+      if (m_position != m_text.size())
+      {
+         fail("unexpected text after the request");
+      }
+
+      return request;
+   }
+
+private:
+   void skipSpace() noexcept
+   {
+      while ((m_position < m_text.size()) && ((m_text[m_position] == ' ') || (m_text[m_position] == '\t') ||
+                                              (m_text[m_position] == '\r') || (m_text[m_position] == '\n')))
+      {
+         ++m_position;
+      }
+   }
+
+   bool consume(char ch) noexcept
+   {
+      skipSpace();
+      if ((m_position < m_text.size()) && (m_text[m_position] == ch))
+      {
+         ++m_position;
+         return true;
+      }
+
+      return false;
+   }
+
+   void expect(char ch)
+   {
+      if (!consume(ch))
+      {
+         fail(fmt::format("expected '{}'", ch));
+      }
+   }
+
+   // a string, number, boolean or null, checked as it is echoed when it is the id
+   void skipValue()
+   {
+      skipSpace();
+      if ((m_position < m_text.size()) && (m_text[m_position] == '"'))
+      {
+         std::string ignored;
+         readString(ignored);
+         return;
+      }
+
+      for (const std::string_view literal : {"true", "false", "null"})
+      {
+         if (m_text.substr(m_position, literal.size()) == literal)
+         {
+            m_position += literal.size();
+            return;
+         }
+      }
+
+      skipNumber();
+   }
+
+   // -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+   void skipNumber()
+   {
+      const auto start = m_position;
+
+      consumeChar('-');
+      if (!consumeChar('0'))
+      {
+         if (!isDigitAt(m_position))
+         {
+            m_position = start;
+            fail("expected a string, number, boolean or null");
+         }
+
+         skipDigits();
+      }
+
+      if (consumeChar('.'))
+      {
+         if (!isDigitAt(m_position))
+         {
+            fail("expected a digit after the decimal point");
+         }
+
+         skipDigits();
+      }
+
+      if (consumeChar('e') || consumeChar('E'))
+      {
+         if (!consumeChar('+'))
+         {
+            consumeChar('-');
+         }
+
+         if (!isDigitAt(m_position))
+         {
+            fail("expected a digit in the exponent");
+         }
+
+         skipDigits();
+      }
+   }
+
+   // unlike consume, does not skip white space first
+   bool consumeChar(char ch) noexcept
+   {
+      if ((m_position < m_text.size()) && (m_text[m_position] == ch))
+      {
+         ++m_position;
+         return true;
+      }
+
+      return false;
+   }
+
+   bool isDigitAt(size_t position) const noexcept
+   {
+      return (position < m_text.size()) && (m_text[position] >= '0') && (m_text[position] <= '9');
+   }
+
+   void skipDigits() noexcept
+   {
+      while (isDigitAt(m_position))
+      {
+         ++m_position;
+      }
+   }
+
+   void readString(std::string& value)
+   {
+      expect('"');
+
+      value.clear();
+      for (;;)
+      {
+         if (m_position >= m_text.size())
+         {
+            fail("unterminated string");
+         }
+
+         const char ch = m_text[m_position++];
+         if (ch == '"')
+         {
+            return;
+         }
+
+         if (ch != '\\')
+         {
+            value.push_back(ch);
+            continue;
+         }
+
+         if (m_position >= m_text.size())
+         {
+            fail("unterminated string");
+         }
+
+         const char escaped = m_text[m_position++];
+         switch (escaped)
+         {
+         case 'n':
+            value.push_back('\n');
+            break;
+
+         case 't':
+            value.push_back('\t');
+            break;
+
+         case 'r':
+            value.push_back('\r');
+            break;
+
+         case 'b':
+            value.push_back('\b');
+            break;
+
+         case 'f':
+            value.push_back('\f');
+            break;
+
+         case 'u':
+            appendCodePoint(value, readHex());
+            break;
+
+         default:
+            value.push_back(escaped);
+            break;
+         }
+      }
+   }
+
+   uint32_t readHex()
+   {
+      if (m_text.size() - m_position < 4)
+      {
+         fail("truncated \\u escape");
+      }
+
+      uint32_t value = 0;
+      for (size_t ii = 0; ii < 4; ++ii)
+      {
+         const char ch = m_text[m_position++];
+         value <<= 4;
+         if ((ch >= '0') && (ch <= '9'))
+         {
+            value |= static_cast<uint32_t>(ch - '0');
+         }
+         else if ((ch >= 'a') && (ch <= 'f'))
+         {
+            value |= static_cast<uint32_t>(ch - 'a' + 10);
+         }
+         else if ((ch >= 'A') && (ch <= 'F'))
+         {
+            value |= static_cast<uint32_t>(ch - 'A' + 10);
+         }
+         else
+         {
+            fail("invalid \\u escape");
+         }
+      }
+
+      return value;
+   }
+
+   // UTF-8; a surrogate pair must follow as a second \u escape
+   void appendCodePoint(std::string& value, uint32_t codePoint)
+   {
+      if ((codePoint >= 0xd800) && (codePoint < 0xdc00))
+      {
+         if ((m_text.substr(m_position, 2) != "\\u"))
+         {
+            fail("unpaired surrogate");
+         }
+
+         m_position += 2;
+         const auto low = readHex();
+         if ((low < 0xdc00) || (low >= 0xe000))
+         {
+            fail("unpaired surrogate");
+         }
+
+         codePoint = 0x10000 + ((codePoint - 0xd800) << 10) + (low - 0xdc00);
+      }
+
+      if (codePoint < 0x80)
+      {
+         value.push_back(static_cast<char>(codePoint));
+      }
+      else if (codePoint < 0x800)
+      {
+         value.push_back(static_cast<char>(0xc0 | (codePoint >> 6)));
+         value.push_back(static_cast<char>(0x80 | (codePoint & 0x3f)));
+      }
+      else if (codePoint < 0x10000)
+      {
+         value.push_back(static_cast<char>(0xe0 | (codePoint >> 12)));
+         value.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3f)));
+         value.push_back(static_cast<char>(0x80 | (codePoint & 0x3f)));
+      }
+      else
+      {
+         value.push_back(static_cast<char>(0xf0 | (codePoint >> 18)));
+         value.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3f)));
+         value.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3f)));
+         value.push_back(static_cast<char>(0x80 | (codePoint & 0x3f)));
+      }
+   }
+
+   [[noreturn]] void fail(std::string_view reason) const
+   {
+      throw std::runtime_error(fmt::format("Invalid request at offset {}: {}", m_position, reason));
+   }
+
+   std::string_view m_text;
+   size_t           m_position = 0;
+};
+
+/*
+ * Request latencies, for the stats requests; only the most recent ones are kept.
+ */
+class LatencyLog
+{
+public:
+   static constexpr size_t k_Capacity = 4096;
+
+   void add(uint32_t microseconds)
+   {
+      std::lock_guard<std::mutex> lock{m_mutex};
+
+      if (m_samples.size() < k_Capacity)
+      {
+         m_samples.push_back(microseconds);
+      }
+      else
+      {
+         m_samples[m_count % k_Capacity] = microseconds;
+      }
+
+      ++m_count;
+   }
+
+   // the given percentile of the kept samples, in microseconds
+   uint32_t getPercentile(size_t percentile) const
+   {
+      std::vector<uint32_t> samples;
+      {
+         std::lock_guard<std::mutex> lock{m_mutex};
+         samples = m_samples;
+      }
+
+      if (samples.empty())
+      {
+         return 0;
+      }
+
+      const auto rank = std::min(samples.size() - 1, samples.size() * percentile / 100);
+      std::nth_element(samples.begin(), samples.begin() + static_cast<std::ptrdiff_t>(rank), samples.end());
+      return samples[rank];
+   }
+
+   size_t getCount() const
+   {
+      std::lock_guard<std::mutex> lock{m_mutex};
+      return m_count;
+   }
+
+private:
+   mutable std::mutex    m_mutex;
+   std::vector<uint32_t> m_samples;
+   size_t                m_count = 0;
+};
+
+/*
+ * State kept for the lifetime of the server, shared by all the connections.
+ */
+struct ServerState
+{
+   explicit ServerState(size_t threadCount) :
+      pool{threadCount}, includes{&pool, samx::IncludeCache::Changes::Reloaded}
+   {
+   }
+
+   samx::ThreadPool   pool;
+   samx::IncludeCache includes;
+
+   const std::shared_ptr<samx::SymbolTable> symbols = std::make_shared<samx::SymbolTable>();
+
+   LatencyLog latencies;
+};
+
+/*
+ * Serves requests one at a time: those of a connection, in order, then those of the next
+ * connection. The arena and the buffers grow to fit the largest request so far and are
+ * reused for the next ones; fragments inserted by the documents stay parsed until their
+ * files change.
+ */
+class Session
+{
+public:
+   explicit Session(ServerState& state) : m_state{state}
+   {
+   }
+
+   /*
+    * The response to a request line, as a single line of JSON without the new line. Any
+    * failure, including running out of memory, is answered as an error of the request.
+    */
+   std::string_view handle(std::string_view line)
+   {
+      const auto startTime = std::chrono::steady_clock::now();
+
+      m_response.clear();
+
+      Request request;
+      try
+      {
+         request = RequestReader{line}.read();
+      }
+      catch (const std::exception& ex)
+      {
+         m_response.clear();
+         writeError(request.id, ex.what());
+         return m_response;
+      }
+
+      try
+      {
+         if (request.op == "stats")
+         {
+            writeStats(request.id);
+            return m_response;
+         }
+
+         if ((request.op == "validate") || (request.op == "render"))
+         {
+            const auto format = samx::parseOutputFormat(request.format);
+            if (!format)
+            {
+               writeError(request.id, fmt::format("Unknown output format {}", request.format));
+            }
+            else if (request.path.empty() && !request.hasContent)
+            {
+               writeError(request.id, "Either path or content is required");
+            }
+            else
+            {
+               process(request, (request.op == "render") ? format : std::nullopt);
+            }
+         }
+         else
+         {
+            writeError(request.id, fmt::format("Unknown operation {}", request.op));
+         }
+      }
+      catch (const std::exception& ex)
+      {
+         // the partial response and the document are dropped
+         m_arena.reset();
+         m_response.clear();
+         writeError(request.id, ex.what());
+      }
+
+      const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime);
+      m_state.latencies.add(static_cast<uint32_t>(std::min<int64_t>(elapsed.count(), UINT32_MAX)));
+
+      return m_response;
+   }
+
+private:
+   /*
+    * Files are mapped and inline content is used where it is; either way the document
+    * references its text instead of copying it.
+    */
+   void process(const Request& request, std::optional<samx::OutputFormat> format)
+   {
+      m_diagnostics.clear();
+
+      std::string_view                        status = "valid";
+      std::string                             error;
+      samx::DocumentCounters                  counters;
+      std::unique_ptr<const samx::MappedFile> mappedFile;
+
+      m_rendered.clear();
+
+      try
+      {
+         std::string_view source = request.content;
+         if (!request.hasContent)
+         {
+            if (!samx::MappedFile::isRegularFile(request.path.c_str()))
+            {
+               throw std::system_error(ENOENT, std::generic_category(), fmt::format("Cannot open input file {}", request.path));
+            }
+
+            mappedFile = std::make_unique<const samx::MappedFile>(request.path.c_str());
+            source     = mappedFile->getContents();
+         }
+
+         // inline content inserts fragments relative to its path, if given
+         const auto documentPath = request.path.empty() ? std::string{"."} : request.path;
+         m_state.includes.prefetch(source, samx::getDirectory(documentPath));
+
+         {
+            samx::Document doc{m_arena, m_state.symbols};
+
+            // not owned: the source outlives the document, which ends with the request
+            doc.shareSource(std::shared_ptr<const void>{std::shared_ptr<const void>{}, source.data()});
+
+            samx::InsertionResolver resolver{doc, m_state.includes, documentPath};
+            samx::normalizeAndParse(source, resolver, nullptr, &m_diagnostics);
+
+            counters = doc.getCounters();
+
+            if (format)
+            {
+               samx::BufferSink sink{m_rendered};
+               samx::renderTo(sink, doc, *format);
+            }
+         }
+
+         if (!m_diagnostics.empty())
+         {
+            status = "invalid";
+         }
+      }
+      catch (const std::system_error& se)
+      {
+         status = "error";
+         error  = se.what();
+      }
+      catch (const std::runtime_error& re)
+      {
+         status = "invalid";
+         error  = re.what();
+      }
+
+      m_arena.reset();
+
+      samx::BufferSink                       sink{m_response};
+      samx::RendererOutput<samx::BufferSink> out{sink, samx::k_JsonEscapes};
+
+      out.write(fmt::format("{{\"id\":{},\"status\":\"{}\"", request.id, status));
+      if (!error.empty())
+      {
+         out.write(",\"error\":\"");
+         out.writeEscaped(error);
+         out.put('"');
+      }
+      else
+      {
+         out.write(fmt::format(",\"blocks\":{},\"paragraphs\":{}", counters.blocks, counters.paragraphs));
+      }
+
+      out.write(fmt::format(",\"errors\":{},\"diagnostics\":[", m_diagnostics.getErrorCount()));
+      for (const auto& diagnostic : m_diagnostics.getRecords())
+      {
+         if (&diagnostic != m_diagnostics.getRecords().data())
+         {
+            out.put(',');
+         }
+
+         out.put('"');
+         out.writeEscaped(samx::format(diagnostic));
+         out.put('"');
+      }
+      out.put(']');
+
+      if (format && error.empty())
+      {
+         out.write(",\"output\":\"");
+         out.writeEscaped(m_rendered);
+         out.put('"');
+      }
+
+      out.put('}');
+   }
+
+   void writeError(std::string_view id, std::string_view error)
+   {
+      samx::BufferSink                       sink{m_response};
+      samx::RendererOutput<samx::BufferSink> out{sink, samx::k_JsonEscapes};
+
+      out.write(fmt::format("{{\"id\":{},\"status\":\"error\",\"error\":\"", id));
+      out.writeEscaped(error);
+      out.write("\"}");
+   }
+
+   void writeStats(std::string_view id)
+   {
+      const auto& latencies = m_state.latencies;
+
+      m_response = fmt::format("{{\"id\":{},\"status\":\"ok\",\"requests\":{},\"p50_us\":{},\"p99_us\":{},"
+                               "\"fragments_loaded\":{},\"fragments_reused\":{},\"block_types\":{}}}",
+                               id,
+                               latencies.getCount(),
+                               latencies.getPercentile(50),
+                               latencies.getPercentile(99),
+                               m_state.includes.getLoadCount(),
+                               m_state.includes.getReuseCount(),
+                               m_state.symbols->size());
+   }
+
+   ServerState& m_state;
+
+   samx::DocumentArena m_arena;
+   samx::Diagnostics   m_diagnostics;
+   std::string         m_rendered;
+   std::string         m_response;
+};
+
+/*
+ * Answers the request lines read from input, one response line each, until the end of
+ * the input.
+ */
+void serve(Session& session, int input, int output)
+{
+   samx::FileSink sink{output};
+
+   std::string buffer;
+   size_t      scanned = 0;
+
+   std::vector<char> chunk(samx::FileSink::k_BufferSize);
+   for (;;)
+   {
+      const ssize_t count = read(input, chunk.data(), chunk.size());
+      if (count < 0)
+      {
+         if (errno == EINTR)
+         {
+            continue;
+         }
+
+         throw std::system_error(errno, std::generic_category(), "Cannot read requests");
+      }
+
+      if (count == 0)
+      {
+         break;
+      }
+
+      buffer.append(chunk.data(), static_cast<size_t>(count));
+
+      size_t lineStart = 0;
+      for (auto lineEnd = buffer.find('\n', scanned); lineEnd != std::string::npos;
+           lineEnd      = buffer.find('\n', lineStart))
+      {
+         const auto line = std::string_view(buffer).substr(lineStart, lineEnd - lineStart);
+         if (line.find_first_not_of(" \t\r") != std::string_view::npos)
+         {
+            sink.write(session.handle(line));
+            sink.put('\n');
+         }
+
+         lineStart = lineEnd + 1;
+      }
+
+      // answered before waiting for more requests
+      sink.flush();
+
+      buffer.erase(0, lineStart);
+      scanned = buffer.size();
+   }
+
+   if (buffer.find_first_not_of(" \t\r") != std::string::npos)
+   {
+      sink.write(session.handle(buffer));
+      sink.put('\n');
+      sink.flush();
+   }
+}
+
+/*
+ * Connections accepted and waiting for a connection thread, in order.
+ */
+class ConnectionQueue
+{
+public:
+   void push(int connection)
+   {
+      {
+         const std::lock_guard<std::mutex> lock{m_mutex};
+         m_connections.push_back(connection);
+      }
+
+      m_available.notify_one();
+   }
+
+   int pop()
+   {
+      std::unique_lock<std::mutex> lock{m_mutex};
+      m_available.wait(lock, [this]() {
+         return !m_connections.empty();
+      });
+
+      const int connection = m_connections.front();
+      m_connections.pop_front();
+      return connection;
+   }
+
+private:
+   std::mutex              m_mutex;
+   std::condition_variable m_available;
+   std::deque<int>         m_connections;
+};
+
+/*
+ * Body of a connection thread: its session, with its warm arena and buffers, serves the
+ * connections one after the other.
+ */
+void serveConnections(ServerState& state, ConnectionQueue& connections)
+{
+   Session session{state};
+
+   for (;;)
+   {
+      const int connection = connections.pop();
+
+      // the connection is dropped, the server keeps going
+      try
+      {
+         serve(session, connection, connection);
+      }
+      catch (const std::exception& ex)
+      {
+         std::cerr << ex.what() << '\n';
+      }
+
+      close(connection);
+   }
+}
+
+int listenOn(const char* socketPath)
+{
+   sockaddr_un address = {};
+   address.sun_family  = AF_UNIX;
+   if (std::strlen(socketPath) >= sizeof(address.sun_path))
+   {
+      throw std::runtime_error(fmt::format("Socket path too long: {}", socketPath));
+   }
+
+   std::strcpy(address.sun_path, socketPath);
+
+   // a socket left over by a previous server is replaced, anything else is kept
+   struct stat existing = {};
+   if ((lstat(socketPath, &existing) == 0) && S_ISSOCK(existing.st_mode))
+   {
+      unlink(socketPath);
+   }
+
+   const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+   if (fd < 0)
+   {
+      throw std::system_error(errno, std::generic_category(), "Cannot create socket");
+   }
+
+   if ((bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) || (listen(fd, SOMAXCONN) != 0))
+   {
+      const int error = errno;
+      close(fd);
+      throw std::system_error(error, std::generic_category(), fmt::format("Cannot listen on {}", socketPath));
+   }
+
+   return fd;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+   size_t      threadCount     = 0;
+   size_t      connectionCount = k_DefaultConnectionCount;
+   const char* socketPath      = nullptr;
+
+   for (int ii = 1; ii < argc; ++ii)
+   {
+      const std::string_view arg{argv[ii]};
+
+      if ((arg == "-j") && (ii + 1 < argc))
+      {
+         // loads inserted fragments ahead
+         const auto count = samx::parseCount(argv[++ii]);
+         if (!count)
+         {
+            std::cerr << "Error: invalid thread count " << argv[ii] << '\n' << k_Usage;
+            return 1;
+         }
+
+         threadCount = count.value();
+      }
+      else if ((arg == "--socket") && (ii + 1 < argc))
+      {
+         socketPath = argv[++ii];
+      }
+      else if ((arg == "--connections") && (ii + 1 < argc))
+      {
+         // more clients than that wait for one to disconnect
+         const auto count = samx::parseCount(argv[++ii]);
+         if (!count || (count.value() == 0))
+         {
+            std::cerr << "Error: invalid connection count " << argv[ii] << '\n' << k_Usage;
+            return 1;
+         }
+
+         connectionCount = count.value();
+      }
+      else
+      {
+         std::cerr << k_Usage;
+         return 1;
+      }
+   }
+
+   // clients going away are noticed when writing to them
+   std::signal(SIGPIPE, SIG_IGN);
+
+   ServerState state{threadCount};
+
+   if (socketPath == nullptr)
+   {
+      try
+      {
+         Session session{state};
+         serve(session, STDIN_FILENO, STDOUT_FILENO);
+      }
+      catch (const std::exception& ex)
+      {
+         std::cerr << ex.what() << '\n';
+         return 2;
+      }
+
+      return 0;
+   }
+
+   int listener = -1;
+   try
+   {
+      listener = listenOn(socketPath);
+   }
+   catch (const std::exception& ex)
+   {
+      std::cerr << ex.what() << '\n';
+      return 2;
+   }
+
+   std::cerr << "Listening on " << socketPath << '\n';
+
+   ConnectionQueue connections;
+   for (size_t ii = 0; ii < connectionCount; ++ii)
+   {
+      std::thread(serveConnections, std::ref(state), std::ref(connections)).detach();
+   }
+
+   for (;;)
+   {
+      const int connection = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+      if (connection >= 0)
+      {
+         connections.push(connection);
+         continue;
+      }
+
+      const int error = errno;
+      if (error == EINTR)
+      {
+         continue;
+      }
+
+      std::cerr << std::system_error(error, std::generic_category(), "Cannot accept connection").what() << '\n';
+
+      switch (error)
+      {
+      case EBADF:
+      case EINVAL:
+      case ENOTSOCK:
+      case EOPNOTSUPP:
+         // the listening socket itself is unusable
+         return 2;
+
+      case EMFILE:
+      case ENFILE:
+      case ENOBUFS:
+      case ENOMEM:
+         // out of descriptors or memory until some connections close
+         std::this_thread::sleep_for(std::chrono::milliseconds{100});
+         break;
+
+      default:
+         // the client went away before it was accepted, or a network error on its side
+         break;
+      }
+   }
+}
@@ -0,0 +1,129 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "statistics.h"
+
+#include "normalizer.h"
+#include "samx_parser.h"
+
+#include <fmt/core.h>
+
+#include <sys/resource.h>
+
+double samx::getProcessCpuTime() noexcept
+{
+   timespec now = {};
+   if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now) != 0)
+   {
+      return 0.0;
+   }
+
+   return static_cast<double>(now.tv_sec) + static_cast<double>(now.tv_nsec) * 1e-9;
+}
+
+size_t samx::getPeakResidentSetSize() noexcept
+{
+   rusage usage = {};
+   if (getrusage(RUSAGE_SELF, &usage) != 0)
+   {
+      return 0;
+   }
+
+   // reported in KiB on Linux
+   return static_cast<size_t>(usage.ru_maxrss) * 1024;
+}
+
+samx::Statistics::Phase::Phase(Statistics& statistics, std::string_view name) :
+   m_statistics{statistics},
+   m_name{name},
+   m_wallStart{std::chrono::steady_clock::now()},
+   m_cpuStart{getProcessCpuTime()}
+{
+}
+
+samx::Statistics::Phase::~Phase()
+{
+   const std::chrono::duration<double> wall = std::chrono::steady_clock::now() - m_wallStart;
+
+   m_statistics.m_phases.push_back(PhaseTime{std::string{m_name}, wall.count(), getProcessCpuTime() - m_cpuStart});
+}
+
+void samx::Statistics::addCounter(std::string_view name, size_t value)
+{
+   m_counters.emplace_back(name, value);
+}
+
+void samx::Statistics::addCounters(const NormalizerCounters& counters)
+{
+   addCounter("input_bytes", counters.bytes);
+   addCounter("lines", counters.lines);
+   addCounter("empty_lines", counters.emptyLines);
+   addCounter("indents", counters.indents);
+   addCounter("deindents", counters.deindents);
+}
+
+void samx::Statistics::addCounters(const DocumentCounters& counters)
+{
+   addCounter("blocks", counters.blocks);
+   addCounter("paragraphs", counters.paragraphs);
+   addCounter("max_depth", counters.maxDepth);
+   addCounter("node_storage_bytes", counters.storageBytes);
+}
+
+void samx::Statistics::addPeakMemory()
+{
+   addCounter("peak_rss_bytes", getPeakResidentSetSize());
+}
+
+void samx::Statistics::print(std::ostream& os, Format format) const
+{
+   if (format == Format::Json)
+   {
+      // names are plain identifiers, so they need no escaping
+      os << "{\"phases\": [";
+      for (size_t ii = 0; ii < m_phases.size(); ++ii)
+      {
+         const auto& phase = m_phases[ii];
+         os << fmt::format("{}{{\"name\": \"{}\", \"wall_ms\": {:.3f}, \"cpu_ms\": {:.3f}}}",
+                           (ii > 0) ? ", " : "",
+                           phase.name,
+                           phase.wallSeconds * 1e3,
+                           phase.cpuSeconds * 1e3);
+      }
+
+      os << "], \"counters\": {";
+      for (size_t ii = 0; ii < m_counters.size(); ++ii)
+      {
+         os << fmt::format("{}\"{}\": {}", (ii > 0) ? ", " : "", m_counters[ii].first, m_counters[ii].second);
+      }
+      os << "}}\n";
+
+      return;
+   }
+
+   os << "Statistics:\n";
+   for (const auto& phase : m_phases)
+   {
+      os << fmt::format(
+         "   {:<24} {:>12.3f} ms wall {:>12.3f} ms cpu\n", phase.name, phase.wallSeconds * 1e3, phase.cpuSeconds * 1e3);
+   }
+
+   for (const auto& counter : m_counters)
+   {
+      os << fmt::format("   {:<24} {:>12}\n", counter.first, counter.second);
+   }
+}
@@ -0,0 +1,104 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef SAMX_STATISTICS_H_INCLUDED
+#define SAMX_STATISTICS_H_INCLUDED
+
+#include <chrono>
+#include <cstddef>
+#include <ctime>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace samx
+{
+
+struct NormalizerCounters;
+struct DocumentCounters;
+
+/*
+ * Phase timings and counters reported by the tools with --stats. The library code paths
+ * only keep plain counters; this is where they are collected and formatted.
+ */
+class Statistics
+{
+public:
+   enum class Format
+   {
+      Human,
+      Json,
+   };
+
+   /*
+    * Measures wall and CPU time from construction to destruction. CPU time is for the whole
+    * process, so it includes all threads.
+    */
+   class Phase
+   {
+   public:
+      Phase(Statistics& statistics, std::string_view name);
+
+      Phase(const Phase& other) = delete;
+      Phase(Phase&& other)      = delete;
+      ~Phase();
+      Phase& operator=(const Phase& other) = delete;
+      Phase& operator=(Phase&& other) = delete;
+
+   private:
+      Statistics&                           m_statistics;
+      std::string_view                      m_name;
+      std::chrono::steady_clock::time_point m_wallStart;
+      double                                m_cpuStart;
+   };
+
+   void addCounter(std::string_view name, size_t value);
+
+   void addCounters(const NormalizerCounters& counters);
+   void addCounters(const DocumentCounters& counters);
+
+   // adds the peak resident set size of the process, as of now
+   void addPeakMemory();
+
+   void print(std::ostream& os, Format format) const;
+
+private:
+   struct PhaseTime
+   {
+      std::string name;
+      double      wallSeconds;
+      double      cpuSeconds;
+   };
+
+   std::vector<PhaseTime>                     m_phases;
+   std::vector<std::pair<std::string, size_t>> m_counters;
+};
+
+/*
+ * Process CPU time, in seconds.
+ */
+double getProcessCpuTime() noexcept;
+
+/*
+ * Peak resident set size of the process, in bytes.
+ */
+size_t getPeakResidentSetSize() noexcept;
+
+} // namespace samx
+
+#endif // SAMX_STATISTICS_H_INCLUDED
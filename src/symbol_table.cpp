@@ -0,0 +1,73 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "symbol_table.h"
+
+#include <mutex>
+
+const samx::Symbol& samx::SymbolTable::intern(std::string_view name)
+{
+   {
+      std::shared_lock<std::shared_mutex> lock{m_mutex};
+
+      const auto iter = m_index.find(name);
+      if (iter != m_index.end())
+      {
+         return *iter->second;
+      }
+   }
+
+   std::unique_lock<std::shared_mutex> lock{m_mutex};
+
+   // another thread may have added it in the meantime
+   const auto iter = m_index.find(name);
+   if (iter != m_index.end())
+   {
+      return *iter->second;
+   }
+
+   const auto& stored = m_names.emplace_back(name);
+   m_symbols.push_back(Symbol{stored, static_cast<SymbolId>(m_symbols.size())});
+
+   const Symbol& symbol = m_symbols.back();
+
+   m_index.emplace(symbol.name, &symbol);
+
+   return symbol;
+}
+
+const samx::Symbol* samx::SymbolTable::find(std::string_view name) const
+{
+   std::shared_lock<std::shared_mutex> lock{m_mutex};
+
+   const auto iter = m_index.find(name);
+   return (iter != m_index.end()) ? iter->second : nullptr;
+}
+
+const samx::Symbol& samx::SymbolTable::get(SymbolId id) const
+{
+   std::shared_lock<std::shared_mutex> lock{m_mutex};
+
+   return m_symbols.at(id);
+}
+
+size_t samx::SymbolTable::size() const
+{
+   std::shared_lock<std::shared_mutex> lock{m_mutex};
+
+   return m_symbols.size();
+}
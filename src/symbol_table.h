@@ -0,0 +1,81 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#ifndef SAMX_SYMBOL_TABLE_H_INCLUDED
+#define SAMX_SYMBOL_TABLE_H_INCLUDED
+
+#include <cstdint>
+#include <deque>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace samx
+{
+
+using SymbolId = uint32_t;
+
+/*
+ * An interned block type: the name is stored once per table, and the id numbers the
+ * distinct names in order of first appearance, from 0.
+ */
+struct Symbol
+{
+   std::string_view name;
+   SymbolId         id;
+};
+
+/*
+ * Interns block types, so that blocks refer to a shared Symbol instead of holding a copy
+ * of their type, and compare types as integers. A table can be shared by the documents
+ * of a batch and used from several threads; symbols are never removed, and stay at the
+ * same address for the lifetime of the table.
+ */
+class SymbolTable
+{
+public:
+   SymbolTable() = default;
+
+   SymbolTable(const SymbolTable& other) = delete;
+   SymbolTable(SymbolTable&& other)      = delete;
+   ~SymbolTable()                        = default;
+   SymbolTable& operator=(const SymbolTable& other) = delete;
+   SymbolTable& operator=(SymbolTable&& other) = delete;
+
+   const Symbol& intern(std::string_view name);
+
+   // nullptr if the name was never interned
+   const Symbol* find(std::string_view name) const;
+
+   const Symbol& get(SymbolId id) const;
+
+   size_t size() const;
+
+private:
+   mutable std::shared_mutex m_mutex;
+
+   // deques do not move their elements as they grow
+   std::deque<std::string> m_names;
+   std::deque<Symbol>      m_symbols;
+
+   std::unordered_map<std::string_view, const Symbol*> m_index;
+};
+
+} // namespace samx
+
+#endif // SAMX_SYMBOL_TABLE_H_INCLUDED
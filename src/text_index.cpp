@@ -0,0 +1,646 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "text_index.h"
+
+#include "mapped_file.h"
+#include "output_sink.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <numeric>
+#include <stdexcept>
+#include <type_traits>
+
+namespace
+{
+
+constexpr char     k_Magic[8]    = {'S', 'A', 'M', 'X', 'I', 'D', 'X', '\0'};
+constexpr uint32_t k_ByteOrder   = 0x01020304;
+constexpr size_t   k_Alignment   = 8;
+constexpr uint64_t k_MaxTextSize = UINT32_MAX;
+
+static_assert(std::is_trivially_copyable_v<samx::TextIndex::Header>);
+static_assert(sizeof(samx::TextIndex::Header) % k_Alignment == 0);
+static_assert(sizeof(samx::TextIndex::Term) % k_Alignment == 0);
+
+constexpr uint64_t alignUp(uint64_t offset) noexcept
+{
+   return (offset + k_Alignment - 1) & ~uint64_t{k_Alignment - 1};
+}
+
+/*
+ * Variable length integers: 7 bits per byte, least significant first; the high bit is
+ * set on all bytes but the last.
+ */
+void appendVarint(std::string& bytes, uint32_t value)
+{
+   while (value >= 0x80)
+   {
+      bytes.push_back(static_cast<char>((value & 0x7f) | 0x80));
+      value >>= 7;
+   }
+
+   bytes.push_back(static_cast<char>(value));
+}
+
+bool readVarint(std::string_view bytes, size_t& position, uint32_t& value) noexcept
+{
+   value = 0;
+   for (unsigned shift = 0; (shift < 32) && (position < bytes.size()); shift += 7)
+   {
+      const auto byte = static_cast<uint8_t>(bytes[position++]);
+      value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0)
+      {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+template <typename Record>
+void writeRecord(samx::FileSink& sink, const Record& record)
+{
+   sink.write(std::string_view(reinterpret_cast<const char*>(&record), sizeof(Record)));
+}
+
+void writePadding(samx::FileSink& sink, uint64_t& offset)
+{
+   for (const auto aligned = alignUp(offset); offset < aligned; ++offset)
+   {
+      sink.put('\0');
+   }
+}
+
+std::vector<uint32_t> intersect(const std::vector<uint32_t>& left, const std::vector<uint32_t>& right)
+{
+   std::vector<uint32_t> result;
+   std::set_intersection(left.cbegin(), left.cend(), right.cbegin(), right.cend(), std::back_inserter(result));
+   return result;
+}
+
+} // namespace
+
+samx::TextIndexSegment::TextIndexSegment(std::string path) : m_path{std::move(path)}
+{
+}
+
+void samx::TextIndexSegment::onBlockStart(std::string_view type, std::string_view /* description */)
+{
+   m_blockPathLengths.push_back(m_blockPath.size());
+   if (!m_blockPath.empty())
+   {
+      m_blockPath.push_back('/');
+   }
+
+   // without the ':', as in path queries
+   m_blockPath.append(type.substr(0, type.size() - 1));
+}
+
+void samx::TextIndexSegment::onBlockEnd()
+{
+   m_blockPath.resize(m_blockPathLengths.back());
+   m_blockPathLengths.pop_back();
+}
+
+/*
+ * The segments are tokenized where they are, instead of joining them with getText();
+ * the separating space ends a word either way.
+ */
+void samx::TextIndexSegment::onParagraph(const std::vector<std::string_view>& segments)
+{
+   const auto paragraph = static_cast<uint32_t>(m_paragraphs.size());
+
+   const auto inserted = m_blockPathIds.emplace(m_blockPath, static_cast<uint32_t>(m_blockPaths.size()));
+   if (inserted.second)
+   {
+      m_blockPaths.push_back(m_blockPath);
+   }
+
+   m_paragraphs.push_back(Paragraph{inserted.first->second, paragraph});
+
+   m_words.clear();
+   m_occurrences.clear();
+   for (const auto segment : segments)
+   {
+      forEachWord(segment, m_wordBuffer, [this](std::string_view word) {
+         m_occurrences.emplace_back(static_cast<uint32_t>(m_words.size()), static_cast<uint32_t>(word.size()));
+         m_words.append(word);
+      });
+   }
+
+   const auto getWord = [this](uint32_t occurrence) {
+      return std::string_view(m_words).substr(m_occurrences[occurrence].first, m_occurrences[occurrence].second);
+   };
+
+   // group the occurrences of each word, keeping their positions in order
+   std::vector<uint32_t> order(m_occurrences.size());
+   std::iota(order.begin(), order.end(), 0);
+   std::stable_sort(order.begin(), order.end(), [&getWord](uint32_t left, uint32_t right) {
+      return getWord(left) < getWord(right);
+   });
+
+   for (size_t first = 0; first < order.size();)
+   {
+      const auto word = getWord(order[first]);
+
+      size_t last = first + 1;
+      while ((last < order.size()) && (getWord(order[last]) == word))
+      {
+         ++last;
+      }
+
+      m_key.assign(word);
+      auto& postings = m_terms[m_key];
+
+      appendVarint(postings.bytes, paragraph - postings.lastParagraph);
+      appendVarint(postings.bytes, static_cast<uint32_t>(last - first));
+
+      uint32_t previous = 0;
+      for (size_t ii = first; ii < last; ++ii)
+      {
+         appendVarint(postings.bytes, order[ii] - previous);
+         previous = order[ii];
+      }
+
+      ++postings.paragraphCount;
+      postings.lastParagraph = paragraph;
+
+      first = last;
+   }
+}
+
+void samx::TextIndexWriter::add(TextIndexSegment&& segment)
+{
+   const auto file = static_cast<uint32_t>(m_files.size());
+   const auto base = static_cast<uint32_t>(m_paragraphs.size());
+
+   m_files.push_back(std::move(segment.m_path));
+
+   for (const auto& paragraph : segment.m_paragraphs)
+   {
+      const auto& blockPath = segment.m_blockPaths[paragraph.blockPath];
+      const auto  inserted  = m_blockPathIds.emplace(blockPath, static_cast<uint32_t>(m_blockPaths.size()));
+      if (inserted.second)
+      {
+         m_blockPaths.push_back(blockPath);
+      }
+
+      m_paragraphs.push_back(Paragraph{file, inserted.first->second, paragraph.ordinal});
+   }
+
+   for (const auto& term : segment.m_terms)
+   {
+      const auto& source = term.second;
+      auto&       target = m_terms[term.first];
+
+      // the first entry of the segment list counts from the start of the segment
+      size_t   position = 0;
+      uint32_t first    = 0;
+      readVarint(source.bytes, position, first);
+
+      appendVarint(target.bytes, base + first - target.lastParagraph);
+      target.bytes.append(source.bytes, position, std::string::npos);
+
+      target.paragraphCount += source.paragraphCount;
+      target.lastParagraph = base + source.lastParagraph;
+   }
+}
+
+void samx::TextIndexWriter::write(FileSink& sink) const
+{
+   std::vector<const std::pair<const std::string, Postings>*> terms;
+   terms.reserve(m_terms.size());
+   for (const auto& term : m_terms)
+   {
+      terms.push_back(&term);
+   }
+
+   std::sort(terms.begin(), terms.end(), [](const auto* left, const auto* right) {
+      return left->first < right->first;
+   });
+
+   uint64_t stringsSize  = 0;
+   uint64_t postingsSize = 0;
+   for (const auto& file : m_files)
+   {
+      stringsSize += file.size();
+   }
+   for (const auto& blockPath : m_blockPaths)
+   {
+      stringsSize += blockPath.size();
+   }
+   for (const auto* term : terms)
+   {
+      stringsSize += term->first.size();
+      postingsSize += term->second.bytes.size();
+   }
+
+   if ((stringsSize > k_MaxTextSize) || (m_paragraphs.size() > UINT32_MAX))
+   {
+      throw std::runtime_error(fmt::format("Index too large: {} paragraphs, {} bytes of text", m_paragraphs.size(), stringsSize));
+   }
+
+   TextIndex::Header header = {};
+   std::memcpy(header.magic, k_Magic, sizeof(k_Magic));
+   header.version          = TextIndex::k_Version;
+   header.byteOrder        = k_ByteOrder;
+   header.fileCount        = static_cast<uint32_t>(m_files.size());
+   header.blockPathCount   = static_cast<uint32_t>(m_blockPaths.size());
+   header.paragraphCount   = static_cast<uint32_t>(m_paragraphs.size());
+   header.termCount        = static_cast<uint32_t>(terms.size());
+   header.filesOffset      = sizeof(TextIndex::Header);
+   header.blockPathsOffset = alignUp(header.filesOffset + m_files.size() * sizeof(TextIndex::StringRef));
+   header.paragraphsOffset = alignUp(header.blockPathsOffset + m_blockPaths.size() * sizeof(TextIndex::StringRef));
+   header.termsOffset      = alignUp(header.paragraphsOffset + m_paragraphs.size() * sizeof(TextIndex::Paragraph));
+   header.postingsOffset   = header.termsOffset + terms.size() * sizeof(TextIndex::Term);
+   header.postingsSize     = postingsSize;
+   header.stringsOffset    = header.postingsOffset + postingsSize;
+   header.stringsSize      = stringsSize;
+
+   uint64_t offset = 0;
+   writeRecord(sink, header);
+   offset += sizeof(header);
+
+   uint32_t stringOffset = 0;
+   for (const auto* strings : {&m_files, &m_blockPaths})
+   {
+      for (const auto& text : *strings)
+      {
+         writeRecord(sink, TextIndex::StringRef{stringOffset, static_cast<uint32_t>(text.size())});
+         stringOffset += static_cast<uint32_t>(text.size());
+         offset += sizeof(TextIndex::StringRef);
+      }
+
+      writePadding(sink, offset);
+   }
+
+   for (const auto& paragraph : m_paragraphs)
+   {
+      writeRecord(sink, TextIndex::Paragraph{paragraph.file, paragraph.blockPath, paragraph.ordinal});
+      offset += sizeof(TextIndex::Paragraph);
+   }
+
+   writePadding(sink, offset);
+
+   uint64_t postingsOffset = 0;
+   for (const auto* term : terms)
+   {
+      TextIndex::Term record = {};
+      record.textOffset      = stringOffset;
+      record.textLength      = static_cast<uint32_t>(term->first.size());
+      record.paragraphCount  = term->second.paragraphCount;
+      record.postingsSize    = static_cast<uint32_t>(term->second.bytes.size());
+      record.postingsOffset  = postingsOffset;
+
+      writeRecord(sink, record);
+      stringOffset += record.textLength;
+      postingsOffset += record.postingsSize;
+   }
+
+   for (const auto* term : terms)
+   {
+      sink.write(term->second.bytes);
+   }
+
+   for (const auto* strings : {&m_files, &m_blockPaths})
+   {
+      for (const auto& text : *strings)
+      {
+         sink.write(text);
+      }
+   }
+
+   for (const auto* term : terms)
+   {
+      sink.write(term->first);
+   }
+}
+
+samx::TextIndex::TextIndex(const char* path) : m_file{std::make_shared<const MappedFile>(path)}
+{
+   const auto bytes = m_file->getContents();
+
+   if ((bytes.size() < sizeof(Header)) || (std::memcmp(bytes.data(), k_Magic, sizeof(k_Magic)) != 0))
+   {
+      throw std::runtime_error(fmt::format("{} is not a SAMx text index", path));
+   }
+
+   // mappings are page aligned
+   m_header = reinterpret_cast<const Header*>(bytes.data());
+
+   const auto& header = *m_header;
+   if (header.byteOrder != k_ByteOrder)
+   {
+      throw std::runtime_error("SAMx text index was written with a different byte order");
+   }
+
+   if (header.version != k_Version)
+   {
+      throw std::runtime_error(
+         fmt::format("Unsupported SAMx text index version {}; expected {}", header.version, k_Version));
+   }
+
+   const auto size = bytes.size();
+   const auto fits = [size](uint64_t offset, uint64_t count, uint64_t recordSize, uint64_t alignment) {
+      return (offset % alignment == 0) && (offset <= size) && (count <= (size - offset) / recordSize);
+   };
+
+   if (!fits(header.filesOffset, header.fileCount, sizeof(StringRef), k_Alignment) ||
+       !fits(header.blockPathsOffset, header.blockPathCount, sizeof(StringRef), k_Alignment) ||
+       !fits(header.paragraphsOffset, header.paragraphCount, sizeof(Paragraph), alignof(Paragraph)) ||
+       !fits(header.termsOffset, header.termCount, sizeof(Term), k_Alignment) ||
+       !fits(header.postingsOffset, header.postingsSize, 1, 1) ||
+       !fits(header.stringsOffset, header.stringsSize, 1, 1) || (header.stringsSize > k_MaxTextSize))
+   {
+      throw std::runtime_error("Truncated SAMx text index");
+   }
+
+   const char* const base = bytes.data();
+
+   m_files      = reinterpret_cast<const StringRef*>(base + header.filesOffset);
+   m_blockPaths = reinterpret_cast<const StringRef*>(base + header.blockPathsOffset);
+   m_paragraphs = reinterpret_cast<const Paragraph*>(base + header.paragraphsOffset);
+   m_terms      = reinterpret_cast<const Term*>(base + header.termsOffset);
+   m_postings   = std::string_view(base + header.postingsOffset, header.postingsSize);
+   m_strings    = std::string_view(base + header.stringsOffset, header.stringsSize);
+
+   /*
+    * the tables are checked here; the posting lists are checked as they are decoded
+    */
+   const auto inStrings = [&header](uint64_t offset, uint64_t length) {
+      return (offset <= header.stringsSize) && (length <= header.stringsSize - offset);
+   };
+
+   for (uint32_t ii = 0; ii < header.fileCount; ++ii)
+   {
+      if (!inStrings(m_files[ii].offset, m_files[ii].length))
+      {
+         throw std::runtime_error(fmt::format("Corrupt SAMx text index: file {} out of range", ii));
+      }
+   }
+
+   for (uint32_t ii = 0; ii < header.blockPathCount; ++ii)
+   {
+      if (!inStrings(m_blockPaths[ii].offset, m_blockPaths[ii].length))
+      {
+         throw std::runtime_error(fmt::format("Corrupt SAMx text index: block path {} out of range", ii));
+      }
+   }
+
+   for (uint32_t ii = 0; ii < header.paragraphCount; ++ii)
+   {
+      if ((m_paragraphs[ii].file >= header.fileCount) || (m_paragraphs[ii].blockPath >= header.blockPathCount))
+      {
+         throw std::runtime_error(fmt::format("Corrupt SAMx text index: paragraph {} is not valid", ii));
+      }
+   }
+
+   // terms are looked up by binary search
+   for (uint32_t ii = 0; ii < header.termCount; ++ii)
+   {
+      const auto& term  = m_terms[ii];
+      const bool  valid = inStrings(term.textOffset, term.textLength) && (term.postingsOffset <= header.postingsSize) &&
+                         (term.postingsSize <= header.postingsSize - term.postingsOffset) &&
+                         ((ii == 0) || (getString({m_terms[ii - 1].textOffset, m_terms[ii - 1].textLength}) <
+                                        getString({term.textOffset, term.textLength})));
+      if (!valid)
+      {
+         throw std::runtime_error(fmt::format("Corrupt SAMx text index: term {} is not valid", ii));
+      }
+   }
+}
+
+const samx::TextIndex::Term* samx::TextIndex::findTerm(std::string_view word) const noexcept
+{
+   const auto* const first = m_terms;
+   const auto* const last  = m_terms + m_header->termCount;
+
+   const auto* const term = std::lower_bound(first, last, word, [this](const Term& candidate, std::string_view value) {
+      return getString({candidate.textOffset, candidate.textLength}) < value;
+   });
+
+   if ((term == last) || (getString({term->textOffset, term->textLength}) != word))
+   {
+      return nullptr;
+   }
+
+   return term;
+}
+
+std::vector<samx::TextIndex::Posting> samx::TextIndex::getPostings(std::string_view word) const
+{
+   std::vector<Posting> postings;
+
+   const auto* const term = findTerm(word);
+   if (term == nullptr)
+   {
+      return postings;
+   }
+
+   const auto bytes = m_postings.substr(term->postingsOffset, term->postingsSize);
+
+   const auto corrupt = [word]() {
+      return std::runtime_error(fmt::format("Corrupt SAMx text index: postings of '{}' are not valid", word));
+   };
+
+   postings.reserve(term->paragraphCount);
+
+   size_t   position  = 0;
+   uint64_t paragraph = 0;
+   for (uint32_t ii = 0; ii < term->paragraphCount; ++ii)
+   {
+      uint32_t delta = 0;
+      uint32_t count = 0;
+      if (!readVarint(bytes, position, delta) || !readVarint(bytes, position, count) ||
+          ((ii > 0) && (delta == 0)) || (paragraph + delta >= m_header->paragraphCount) ||
+          (count > bytes.size() - position))
+      {
+         throw corrupt();
+      }
+
+      paragraph += delta;
+
+      Posting posting{static_cast<uint32_t>(paragraph), {}};
+      posting.positions.reserve(count);
+
+      uint64_t wordPosition = 0;
+      for (uint32_t jj = 0; jj < count; ++jj)
+      {
+         if (!readVarint(bytes, position, delta) || ((jj > 0) && (delta == 0)) || (wordPosition + delta > UINT32_MAX))
+         {
+            throw corrupt();
+         }
+
+         wordPosition += delta;
+         posting.positions.push_back(static_cast<uint32_t>(wordPosition));
+      }
+
+      postings.push_back(std::move(posting));
+   }
+
+   if (position != bytes.size())
+   {
+      throw corrupt();
+   }
+
+   return postings;
+}
+
+std::vector<uint32_t> samx::TextIndex::search(std::string_view query) const
+{
+   /*
+    * split the query into phrases; a word outside quotes is a phrase of its own
+    */
+   std::vector<std::vector<std::string>> phrases;
+
+   std::string buffer;
+   const auto  addWords = [&phrases, &buffer](std::string_view text, bool quoted) {
+      if (quoted)
+      {
+         phrases.emplace_back();
+      }
+
+      forEachWord(text, buffer, [&phrases, quoted](std::string_view word) {
+         if (!quoted)
+         {
+            phrases.emplace_back();
+         }
+
+         phrases.back().emplace_back(word);
+      });
+
+      if (quoted && phrases.back().empty())
+      {
+         phrases.pop_back();
+      }
+   };
+
+   for (size_t position = 0; position < query.size();)
+   {
+      const auto quote = query.find('"', position);
+      addWords(query.substr(position, quote - position), false);
+      if (quote == std::string_view::npos)
+      {
+         break;
+      }
+
+      const auto closing = query.find('"', quote + 1);
+      if (closing == std::string_view::npos)
+      {
+         throw std::runtime_error(fmt::format("Invalid query '{}': unterminated phrase", query));
+      }
+
+      addWords(query.substr(quote + 1, closing - quote - 1), true);
+      position = closing + 1;
+   }
+
+   if (phrases.empty())
+   {
+      throw std::runtime_error(fmt::format("Invalid query '{}': no words to search for", query));
+   }
+
+   std::optional<std::vector<uint32_t>> result;
+   for (const auto& phrase : phrases)
+   {
+      std::vector<std::vector<Posting>> lists;
+      for (const auto& word : phrase)
+      {
+         lists.push_back(getPostings(word));
+      }
+
+      /*
+       * walk the lists together; where they meet on a paragraph, look for a position of
+       * the first word followed by the others
+       */
+      std::vector<uint32_t> matches;
+      std::vector<size_t>   cursors(lists.size(), 0);
+      while (true)
+      {
+         uint32_t target = 0;
+         bool     done   = false;
+         for (size_t ii = 0; ii < lists.size(); ++ii)
+         {
+            if (cursors[ii] == lists[ii].size())
+            {
+               done = true;
+               break;
+            }
+
+            target = std::max(target, lists[ii][cursors[ii]].paragraph);
+         }
+
+         if (done)
+         {
+            break;
+         }
+
+         bool aligned = true;
+         for (size_t ii = 0; ii < lists.size(); ++ii)
+         {
+            while ((cursors[ii] < lists[ii].size()) && (lists[ii][cursors[ii]].paragraph < target))
+            {
+               ++cursors[ii];
+            }
+
+            aligned = aligned && (cursors[ii] < lists[ii].size()) && (lists[ii][cursors[ii]].paragraph == target);
+         }
+
+         if (!aligned)
+         {
+            continue;
+         }
+
+         const auto& starts = lists[0][cursors[0]].positions;
+         const bool  found  = std::any_of(starts.cbegin(), starts.cend(), [&lists, &cursors](uint32_t start) {
+            for (size_t ii = 1; ii < lists.size(); ++ii)
+            {
+               const auto& positions = lists[ii][cursors[ii]].positions;
+               if (!std::binary_search(positions.cbegin(), positions.cend(), start + ii))
+               {
+                  return false;
+               }
+            }
+
+            return true;
+         });
+
+         if (found)
+         {
+            matches.push_back(target);
+         }
+
+         for (auto& cursor : cursors)
+         {
+            ++cursor;
+         }
+      }
+
+      result = result ? intersect(*result, matches) : std::move(matches);
+      if (result->empty())
+      {
+         break;
+      }
+   }
+
+   return std::move(*result);
+}
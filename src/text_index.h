@@ -0,0 +1,305 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#ifndef SAMX_TEXT_INDEX_H_INCLUDED
+#define SAMX_TEXT_INDEX_H_INCLUDED
+
+#include "document_handler.h"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace samx
+{
+
+class FileSink;
+class MappedFile;
+
+/*
+ * Calls visitor(word) for each word of the text, lower cased; words are runs of ASCII
+ * letters and digits, anything else separates them. The word is only valid for the
+ * duration of the call.
+ */
+template <typename Visitor>
+void forEachWord(std::string_view text, std::string& buffer, Visitor visitor)
+{
+   buffer.clear();
+   for (const char ch : text)
+   {
+      if (((ch >= 'a') && (ch <= 'z')) || ((ch >= '0') && (ch <= '9')))
+      {
+         buffer.push_back(ch);
+      }
+      else if ((ch >= 'A') && (ch <= 'Z'))
+      {
+         buffer.push_back(static_cast<char>(ch - 'A' + 'a'));
+      }
+      else if (!buffer.empty())
+      {
+         visitor(std::string_view(buffer));
+         buffer.clear();
+      }
+   }
+
+   if (!buffer.empty())
+   {
+      visitor(std::string_view(buffer));
+      buffer.clear();
+   }
+}
+
+/*
+ * Inverted index of the paragraphs of one file, built while the file is parsed: no
+ * document is kept. Each paragraph is identified by its block path (the types of the
+ * enclosing blocks, as in "section/subsection") and its position in the file.
+ *
+ * Posting lists are kept compressed: for each paragraph containing the word, the
+ * distance from the previous paragraph, the number of occurrences and the distances
+ * between the word positions, all as variable length integers.
+ */
+class TextIndexSegment : public DocumentHandler
+{
+public:
+   explicit TextIndexSegment(std::string path);
+
+   void onBlockStart(std::string_view type, std::string_view description) override;
+   void onBlockEnd() override;
+   void onParagraph(const std::vector<std::string_view>& segments) override;
+
+   const std::string& getPath() const noexcept
+   {
+      return m_path;
+   }
+
+   size_t getParagraphCount() const noexcept
+   {
+      return m_paragraphs.size();
+   }
+
+private:
+   friend class TextIndexWriter;
+
+   struct Paragraph
+   {
+      uint32_t blockPath;
+      uint32_t ordinal;
+   };
+
+   struct Postings
+   {
+      std::string bytes;
+      uint32_t    paragraphCount = 0;
+      uint32_t    lastParagraph  = 0;
+   };
+
+   std::string m_path;
+
+   // distinct block paths, and the path of the innermost open block
+   std::vector<std::string>                  m_blockPaths;
+   std::unordered_map<std::string, uint32_t> m_blockPathIds;
+   std::string                               m_blockPath;
+   std::vector<size_t>                       m_blockPathLengths;
+
+   std::vector<Paragraph>                    m_paragraphs;
+   std::unordered_map<std::string, Postings> m_terms;
+
+   // words of the current paragraph, as ranges of m_words, in order of appearance
+   std::string                                m_words;
+   std::vector<std::pair<uint32_t, uint32_t>> m_occurrences;
+   std::string                                m_wordBuffer;
+   std::string                                m_key;
+};
+
+/*
+ * Merges the segments of several files, in order, and writes the index. Paragraph
+ * numbers of later segments are shifted past the earlier ones, which only changes the
+ * first entry of each of their posting lists: the rest of the bytes are copied.
+ */
+class TextIndexWriter
+{
+public:
+   void add(TextIndexSegment&& segment);
+
+   size_t getTermCount() const noexcept
+   {
+      return m_terms.size();
+   }
+
+   size_t getParagraphCount() const noexcept
+   {
+      return m_paragraphs.size();
+   }
+
+   // throws std::system_error if writing fails, std::runtime_error if the index is too large
+   void write(FileSink& sink) const;
+
+private:
+   using Postings = TextIndexSegment::Postings;
+
+   struct Paragraph
+   {
+      uint32_t file;
+      uint32_t blockPath;
+      uint32_t ordinal;
+   };
+
+   std::vector<std::string>                  m_files;
+   std::vector<std::string>                  m_blockPaths;
+   std::unordered_map<std::string, uint32_t> m_blockPathIds;
+   std::vector<Paragraph>                    m_paragraphs;
+   std::unordered_map<std::string, Postings> m_terms;
+};
+
+/*
+ * Read-only index, used in place from a memory-mapped file.
+ *
+ * Layout, in native byte order:
+ *
+ *    Header
+ *    StringRef[fileCount]        input files
+ *    StringRef[blockPathCount]   distinct block paths
+ *    Paragraph[paragraphCount]   in file order, then document order
+ *    Term[termCount]             sorted by their text
+ *    postings                    compressed posting lists
+ *    strings                     text of the file names, block paths and terms
+ *
+ * The tables start at multiples of 8 bytes.
+ */
+class TextIndex
+{
+public:
+   static constexpr uint32_t k_Version = 1;
+
+   struct Header
+   {
+      char     magic[8];
+      uint32_t version;
+      uint32_t byteOrder;
+      uint32_t fileCount;
+      uint32_t blockPathCount;
+      uint32_t paragraphCount;
+      uint32_t termCount;
+      uint64_t filesOffset;
+      uint64_t blockPathsOffset;
+      uint64_t paragraphsOffset;
+      uint64_t termsOffset;
+      uint64_t postingsOffset;
+      uint64_t postingsSize;
+      uint64_t stringsOffset;
+      uint64_t stringsSize;
+   };
+
+   struct StringRef
+   {
+      uint32_t offset;
+      uint32_t length;
+   };
+
+   struct Paragraph
+   {
+      uint32_t file;
+      uint32_t blockPath;
+
+      // position of the paragraph in the file, from 0
+      uint32_t ordinal;
+   };
+
+   struct Term
+   {
+      uint32_t textOffset;
+      uint32_t textLength;
+      uint32_t paragraphCount;
+      uint32_t postingsSize;
+      uint64_t postingsOffset;
+   };
+
+   // a paragraph containing a word, and the positions of the word in it
+   struct Posting
+   {
+      uint32_t              paragraph;
+      std::vector<uint32_t> positions;
+   };
+
+   // maps and validates the file; throws std::system_error or std::runtime_error
+   explicit TextIndex(const char* path);
+
+   size_t getFileCount() const noexcept
+   {
+      return m_header->fileCount;
+   }
+
+   size_t getParagraphCount() const noexcept
+   {
+      return m_header->paragraphCount;
+   }
+
+   size_t getTermCount() const noexcept
+   {
+      return m_header->termCount;
+   }
+
+   const Paragraph& getParagraph(uint32_t id) const noexcept
+   {
+      return m_paragraphs[id];
+   }
+
+   std::string_view getFile(const Paragraph& paragraph) const noexcept
+   {
+      return getString(m_files[paragraph.file]);
+   }
+
+   std::string_view getBlockPath(const Paragraph& paragraph) const noexcept
+   {
+      return getString(m_blockPaths[paragraph.blockPath]);
+   }
+
+   // the posting list of a word, which must be lower case; throws std::runtime_error if corrupt
+   std::vector<Posting> getPostings(std::string_view word) const;
+
+   /*
+    * Paragraphs containing all the words and phrases of the query, in index order.
+    * Phrases are enclosed in double quotes; their words must appear consecutively.
+    */
+   std::vector<uint32_t> search(std::string_view query) const;
+
+private:
+   const Term* findTerm(std::string_view word) const noexcept;
+
+   std::string_view getString(const StringRef& ref) const noexcept
+   {
+      return m_strings.substr(ref.offset, ref.length);
+   }
+
+   std::shared_ptr<const MappedFile> m_file;
+
+   const Header*    m_header     = nullptr;
+   const StringRef* m_files      = nullptr;
+   const StringRef* m_blockPaths = nullptr;
+   const Paragraph* m_paragraphs = nullptr;
+   const Term*      m_terms      = nullptr;
+   std::string_view m_postings;
+   std::string_view m_strings;
+};
+
+} // namespace samx
+
+#endif // SAMX_TEXT_INDEX_H_INCLUDED
@@ -0,0 +1,195 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+
+// identifies the pool and the queue of the current worker thread
+thread_local const samx::ThreadPool* t_pool        = nullptr;
+thread_local size_t                  t_workerIndex = 0;
+
+} // namespace
+
+samx::ThreadPool::ThreadPool(size_t threadCount)
+{
+   if (threadCount == 0)
+   {
+      threadCount = std::max(1U, std::thread::hardware_concurrency());
+   }
+
+   m_queues.reserve(threadCount);
+   for (size_t ii = 0; ii < threadCount; ++ii)
+   {
+      m_queues.push_back(std::make_unique<WorkQueue>());
+   }
+
+   m_threads.reserve(threadCount);
+   for (size_t ii = 0; ii < threadCount; ++ii)
+   {
+      m_threads.emplace_back([this, ii]() {
+         run(ii);
+      });
+   }
+}
+
+samx::ThreadPool::~ThreadPool()
+{
+   {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stopping = true;
+   }
+   m_wakeup.notify_all();
+
+   for (auto& thread : m_threads)
+   {
+      thread.join();
+   }
+}
+
+size_t samx::ThreadPool::getWorkerIndex() const noexcept
+{
+   return (t_pool == this) ? t_workerIndex : m_threads.size();
+}
+
+void samx::ThreadPool::submit(Task task)
+{
+   size_t index = getWorkerIndex();
+
+   {
+      std::lock_guard<std::mutex> lock(m_mutex);
+
+      if (index == m_threads.size())
+      {
+         // external submissions are spread round-robin
+         index       = m_nextQueue;
+         m_nextQueue = (m_nextQueue + 1) % m_queues.size();
+      }
+
+      // the task becomes visible together with the count, so woken workers always find it
+      {
+         std::lock_guard<std::mutex> queueLock(m_queues[index]->mutex);
+         m_queues[index]->tasks.push_back(std::move(task));
+      }
+
+      ++m_queued;
+      ++m_pending;
+   }
+
+   m_wakeup.notify_one();
+}
+
+void samx::ThreadPool::wait()
+{
+   std::unique_lock<std::mutex> lock(m_mutex);
+   m_idle.wait(lock, [this]() {
+      return m_pending == 0;
+   });
+
+   if (m_error)
+   {
+      auto error = std::exchange(m_error, nullptr);
+      std::rethrow_exception(error);
+   }
+}
+
+bool samx::ThreadPool::tryPop(size_t index, Task& task)
+{
+   {
+      // own queue: newest first, while its data is still warm
+      std::lock_guard<std::mutex> lock(m_queues[index]->mutex);
+      if (!m_queues[index]->tasks.empty())
+      {
+         task = std::move(m_queues[index]->tasks.back());
+         m_queues[index]->tasks.pop_back();
+         return true;
+      }
+   }
+
+   // steal the oldest task from the other queues
+   for (size_t offset = 1; offset < m_queues.size(); ++offset)
+   {
+      auto& victim = *m_queues[(index + offset) % m_queues.size()];
+
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (!victim.tasks.empty())
+      {
+         task = std::move(victim.tasks.front());
+         victim.tasks.pop_front();
+         return true;
+      }
+   }
+
+   return false;
+}
+
+void samx::ThreadPool::run(size_t index)
+{
+   t_pool        = this;
+   t_workerIndex = index;
+
+   while (true)
+   {
+      Task task;
+
+      if (tryPop(index, task))
+      {
+         {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            --m_queued;
+         }
+
+         std::exception_ptr error;
+         try
+         {
+            task();
+         }
+         catch (...)
+         {
+            error = std::current_exception();
+         }
+
+         std::lock_guard<std::mutex> lock(m_mutex);
+         if (error && !m_error)
+         {
+            m_error = error;
+         }
+
+         --m_pending;
+         if (m_pending == 0)
+         {
+            m_idle.notify_all();
+         }
+
+         continue;
+      }
+
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_wakeup.wait(lock, [this]() {
+         return m_stopping || (m_queued > 0);
+      });
+
+      if (m_stopping && (m_queued == 0))
+      {
+         return;
+      }
+   }
+}
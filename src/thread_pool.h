@@ -0,0 +1,93 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#ifndef SAMX_THREAD_POOL_H_INCLUDED
+#define SAMX_THREAD_POOL_H_INCLUDED
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace samx
+{
+
+/*
+ * Fixed-size pool of worker threads. Each worker has its own queue; tasks submitted by a
+ * worker go to its own queue, and idle workers steal from the others.
+ */
+class ThreadPool
+{
+public:
+   using Task = std::function<void()>;
+
+   // zero means one thread per hardware thread
+   explicit ThreadPool(size_t threadCount = 0);
+
+   ThreadPool(const ThreadPool& other) = delete;
+   ThreadPool(ThreadPool&& other)      = delete;
+   ~ThreadPool();
+   ThreadPool& operator=(const ThreadPool& other) = delete;
+   ThreadPool& operator=(ThreadPool&& other) = delete;
+
+   void submit(Task task);
+
+   /*
+    * Blocks until all submitted tasks have completed; rethrows the first exception thrown
+    * by a task. Must not be called from a worker.
+    */
+   void wait();
+
+   size_t getThreadCount() const noexcept
+   {
+      return m_threads.size();
+   }
+
+   // index of the calling worker in [0, getThreadCount()), or getThreadCount() for other threads
+   size_t getWorkerIndex() const noexcept;
+
+private:
+   struct WorkQueue
+   {
+      std::mutex       mutex;
+      std::deque<Task> tasks;
+   };
+
+   void run(size_t index);
+   bool tryPop(size_t index, Task& task);
+
+   std::vector<std::unique_ptr<WorkQueue>> m_queues;
+   std::vector<std::thread>                m_threads;
+
+   std::mutex              m_mutex;
+   std::condition_variable m_wakeup;
+   std::condition_variable m_idle;
+   size_t                  m_queued    = 0; // in a queue, not yet picked up
+   size_t                  m_pending   = 0; // submitted, not yet completed
+   size_t                  m_nextQueue = 0;
+   bool                    m_stopping  = false;
+   std::exception_ptr      m_error;
+};
+
+} // namespace samx
+
+#endif // SAMX_THREAD_POOL_H_INCLUDED
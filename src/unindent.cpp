@@ -14,7 +14,14 @@
    limitations under the License.
 */
 
+#include "command_line.h"
+#include "diagnostics.h"
+#include "mapped_file.h"
 #include "normalizer.h"
+#include "output_sink.h"
+#include "statistics.h"
+
+#include <unistd.h>
 
 #include <algorithm>
 #include <array>
@@ -24,38 +31,171 @@
 #include <iostream>
 #include <iterator>
 #include <memory>
+#include <optional>
 #include <sstream>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace
+{
+
+const char* const k_Usage =
+   "Usage: unindent [--scan=scalar|sse2|avx2] [--max-errors N] [--stats[=json]] input|- [output]\n";
+
+std::optional<samx::ScanKernel> parseScanKernel(std::string_view name)
+{
+   for (const auto kernel : {samx::ScanKernel::Scalar, samx::ScanKernel::SSE2, samx::ScanKernel::AVX2})
+   {
+      if (name == samx::getKernelName(kernel))
+      {
+         return kernel;
+      }
+   }
+
+   return std::nullopt;
+}
+
+} // namespace
 
 int main(int argc, char* argv[])
 {
-   if (argc < 1)
+   std::optional<samx::ScanKernel> scanKernel;
+
+   std::optional<samx::Statistics::Format> statsFormat;
+
+   size_t errorLimit = samx::Diagnostics::k_DefaultErrorLimit;
+
+   std::vector<const char*> arguments;
+   for (int ii = 1; ii < argc; ++ii)
+   {
+      const std::string_view arg{argv[ii]};
+      if (arg.substr(0, 7) == "--scan=")
+      {
+         scanKernel = parseScanKernel(arg.substr(7));
+         if (!scanKernel)
+         {
+            std::cerr << "Error: unknown scan kernel " << arg.substr(7) << '\n';
+            return 1;
+         }
+      }
+      else if ((arg == "--max-errors") && (ii + 1 < argc))
+      {
+         const auto limit = samx::parseCount(argv[++ii]);
+         if (!limit)
+         {
+            std::cerr << "Error: invalid error limit " << argv[ii] << '\n' << k_Usage;
+            return 1;
+         }
+
+         errorLimit = limit.value();
+      }
+      else if (arg == "--stats")
+      {
+         statsFormat = samx::Statistics::Format::Human;
+      }
+      else if (arg == "--stats=json")
+      {
+         statsFormat = samx::Statistics::Format::Json;
+      }
+      else
+      {
+         arguments.push_back(argv[ii]);
+      }
+   }
+
+   if (arguments.empty())
    {
       std::cerr << "Error: input argument missing\n";
+      std::cerr << k_Usage;
       return 1;
    }
 
-   std::ostream* output = &std::cerr;
+   std::unique_ptr<samx::FileSink> output;
 
-   std::unique_ptr<std::ofstream> fileOutput;
+   try
+   {
+      output = (arguments.size() > 1) ? std::make_unique<samx::FileSink>(arguments[1])
+                                      : std::make_unique<samx::FileSink>(STDERR_FILENO);
+   }
+   catch (const std::system_error& se)
+   {
+      std::cerr << se.what() << '\n';
+      return 2;
+   }
+
+   samx::Diagnostics diagnostics{errorLimit};
 
-   if (argc > 2)
+   samx::MarkerWriter<samx::FileSink> writer{*output};
+
+   samx::Normalizer normalizer{writer};
+   normalizer.setDiagnostics(diagnostics);
+
+   if (scanKernel)
    {
-      fileOutput = std::make_unique<std::ofstream>(argv[2]);
-      output     = fileOutput.get();
+      normalizer.setScanKernel(scanKernel.value());
    }
 
-   samx::Normalizer normalizer{*output};
+   /*
+    * regular files are mapped; pipes and standard input ('-') are read as streams
+    */
+   const std::string_view inputPath{arguments[0]};
+
+   size_t size = 0;
+
+   samx::Statistics stats;
 
-   std::ifstream input(argv[1]);
-   if (!input)
+   try
    {
-      std::cerr << "Cannot open input file " << argv[1] << '\n';
+      if ((inputPath != "-") && samx::MappedFile::isRegularFile(arguments[0]))
+      {
+         std::optional<samx::MappedFile> input;
+         {
+            const samx::Statistics::Phase phase{stats, "read"};
+            input.emplace(arguments[0]);
+         }
+
+         const samx::Statistics::Phase phase{stats, "normalize"};
+         size = normalizer.normalize(input->getContents());
+      }
+      else if (inputPath == "-")
+      {
+         const samx::Statistics::Phase phase{stats, "normalize"};
+         size = normalizer.normalize(std::cin);
+      }
+      else
+      {
+         std::ifstream input(arguments[0]);
+         if (!input)
+         {
+            std::cerr << "Cannot open input file " << arguments[0] << '\n';
+            return 2;
+         }
+
+         const samx::Statistics::Phase phase{stats, "normalize"};
+         size = normalizer.normalize(input);
+      }
+
+      output->flush();
+   }
+   catch (const std::system_error& se)
+   {
+      std::cerr << se.what() << '\n';
       return 2;
    }
 
-   const auto size = normalizer.normalize(input);
+   diagnostics.report(std::cerr);
+
    std::cerr << "-----\n";
    std::cerr << "Processed " << size << " bytes\n";
 
-   return 0;
+   if (statsFormat)
+   {
+      stats.addCounters(normalizer.getCounters());
+      stats.addCounter("errors", diagnostics.getErrorCount());
+      stats.addPeakMemory();
+      stats.print(std::cerr, statsFormat.value());
+   }
+
+   return diagnostics.empty() ? 0 : 3;
 }
@@ -14,57 +14,748 @@
    limitations under the License.
 */
 
+#include "binary_document.h"
+#include "block_index.h"
+#include "command_line.h"
+#include "diagnostics.h"
+#include "document_renderer.h"
+#include "flat_document.h"
+#include "include_cache.h"
+#include "mapped_file.h"
 #include "normalizer.h"
+#include "output_sink.h"
+#include "parse_cache.h"
+#include "path_query.h"
 #include "samx_parser.h"
+#include "statistics.h"
+#include "thread_pool.h"
 
+#include <fmt/core.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <optional>
 #include <sstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+namespace
+{
+
+const char* const k_Usage = "Usage: validate [--two-stage] [-j threads] [--flat | --count] [--save-binary path]\n"
+                            "                [--format text|html|xml|json] [--query selector]\n"
+                            "                [--cache directory [--cache-size MiB]] [--max-errors N]\n"
+                            "                [--stats[=json] [--stats-file path]] input|- [output]\n";
+
+/*
+ * Block insertions are resolved relative to the input document.
+ */
+struct Insertions
+{
+   samx::IncludeCache& cache;
+   std::string_view    documentPath;
+
+   // insertions found in the input
+   size_t count = 0;
+};
+
+/*
+ * Debug mode: materializes the normalized text, then parses it; in parallel if there is
+ * a pool, and no insertion to resolve.
+ */
+template <typename Input>
+samx::Document parseTwoStage(Input&             input,
+                             samx::ThreadPool*  pool,
+                             Insertions&        insertions,
+                             samx::Diagnostics& diagnostics,
+                             samx::Statistics&  stats)
+{
+   std::ostringstream dedentStream;
+
+   samx::Normalizer normalizer{dedentStream};
+   normalizer.setDiagnostics(diagnostics);
+
+   {
+      const samx::Statistics::Phase phase{stats, "normalize"};
+      normalizer.normalize(input);
+   }
+
+   stats.addCounters(normalizer.getCounters());
+
+   auto normalized = std::make_shared<const std::string>(dedentStream.str());
+
+   const samx::Statistics::Phase phase{stats, "parse"};
+
+   if ((pool == nullptr) || (normalized->find("<<<") != std::string::npos))
+   {
+      samx::Document doc;
+      doc.shareSource(normalized);
+
+      samx::InsertionResolver resolver{doc, insertions.cache, insertions.documentPath};
+      std::cerr << (samx::parse(*normalized, resolver) ? "Parse succeeded!\n" : "Parse failed\n");
+
+      insertions.count = resolver.getInsertionCount();
+      return doc;
+   }
+
+   const auto startTime = std::chrono::steady_clock::now();
+
+   auto doc = samx::parse(*normalized, normalized, *pool);
+
+   const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - startTime;
+   std::cerr << "Parsed in " << elapsed.count() << " ms on " << pool->getThreadCount() << " threads\n";
+
+   return doc;
+}
+
+/*
+ * Normal mode: the parser consumes the indentation events directly. The document
+ * references the paragraph text in the source, if it has an owner.
+ */
+template <typename Input>
+samx::Document parseSinglePass(Input&                      input,
+                               std::shared_ptr<const void> sourceOwner,
+                               Insertions&                 insertions,
+                               samx::Diagnostics&          diagnostics,
+                               samx::Statistics&           stats)
+{
+   samx::Document doc;
+   doc.shareSource(std::move(sourceOwner));
+
+   samx::NormalizerCounters normalizerCounters;
+
+   {
+      const samx::Statistics::Phase phase{stats, "normalize+parse"};
+
+      samx::InsertionResolver resolver{doc, insertions.cache, insertions.documentPath};
+      samx::normalizeAndParse(input, resolver, &normalizerCounters, &diagnostics);
+
+      insertions.count = resolver.getInsertionCount();
+   }
+
+   stats.addCounters(normalizerCounters);
+
+   return doc;
+}
+
+/*
+ * Query mode: the parser events build the flat document and its block index directly,
+ * in a single pass, without a Document in between.
+ */
+template <typename Input>
+void parseIndexed(Input&              input,
+                  samx::FlatDocument& flatDoc,
+                  samx::BlockIndex&   index,
+                  Insertions&         insertions,
+                  samx::Diagnostics&  diagnostics,
+                  samx::Statistics&   stats)
+{
+   samx::NormalizerCounters normalizerCounters;
+
+   {
+      const samx::Statistics::Phase phase{stats, "normalize+parse+index"};
+
+      samx::IndexingHandler   indexer{flatDoc, index};
+      samx::InsertionResolver resolver{indexer, insertions.cache, insertions.documentPath};
+      samx::normalizeAndParse(input, resolver, &normalizerCounters, &diagnostics);
+      indexer.finish();
+
+      insertions.count = resolver.getInsertionCount();
+   }
+
+   stats.addCounters(normalizerCounters);
+}
+
+/*
+ * Writes the document in the requested format, returning the number of bytes written;
+ * the text layout ends with an empty line. The top level elements of parsed documents
+ * are rendered on the pool, if there is one.
+ */
+template <typename AnyDocument>
+size_t render(samx::FileSink&    output,
+              const AnyDocument& doc,
+              samx::OutputFormat format,
+              samx::ThreadPool*  pool = nullptr)
+{
+   size_t outputSize = 0;
+   if constexpr (std::is_same_v<AnyDocument, samx::Document>)
+   {
+      outputSize = (pool != nullptr) ? samx::renderParallel(output, doc, format, *pool)
+                                     : samx::renderTo(output, doc, format);
+   }
+   else
+   {
+      outputSize = samx::renderTo(output, doc, format);
+   }
+
+   if (format == samx::OutputFormat::Text)
+   {
+      output.put('\n');
+      ++outputSize;
+   }
+
+   output.flush();
+   return outputSize;
+}
+
+/*
+ * Writes one line per block selected by a query: its node id, type and description.
+ */
+template <typename AnyDocument>
+size_t printMatches(samx::FileSink& output, const AnyDocument& doc, const std::vector<uint32_t>& matches)
+{
+   std::cerr << "Query matched " << matches.size() << " blocks\n";
+
+   size_t outputSize = 0;
+   for (const auto id : matches)
+   {
+      const auto& node = doc.getNode(id);
+      const auto  line = fmt::format("{}\t{} {}\n", id, doc.getType(node), doc.getDescription(node));
+
+      output.write(line);
+      outputSize += line.size();
+   }
+
+   output.flush();
+   return outputSize;
+}
+
+/*
+ * Prints a saved document, the same as the document parsed from its source, or the
+ * blocks selected by the query, using the saved block index.
+ */
+void printBinary(const samx::BinaryDocument& doc,
+                 samx::FileSink&             output,
+                 samx::OutputFormat          format,
+                 const samx::PathQuery*      query,
+                 samx::Statistics&           stats)
+{
+   std::cerr << "Found " << doc.getBlockCount() << " top level blocks\n";
+
+   size_t outputSize = 0;
+   if (query != nullptr)
+   {
+      std::vector<uint32_t> matches;
+      {
+         const samx::Statistics::Phase phase{stats, "query"};
+         matches = query->evaluate(doc);
+      }
+
+      outputSize = printMatches(output, doc, matches);
+   }
+   else
+   {
+      const samx::Statistics::Phase phase{stats, "render"};
+      outputSize = render(output, doc, format);
+   }
+
+   stats.addCounter("nodes", doc.getNodeCount());
+   stats.addCounter("output_bytes", outputSize);
+}
+
+/*
+ * Counts the elements of a document without building it.
+ */
+class CountingHandler : public samx::DocumentHandler
+{
+public:
+   void onBlockStart(std::string_view /* type */, std::string_view /* description */) override
+   {
+      if (m_depth == 0)
+      {
+         ++m_topLevelCount;
+      }
+
+      ++m_blockCount;
+      ++m_depth;
+      m_maxDepth = std::max(m_maxDepth, m_depth);
+   }
+
+   void onBlockEnd() override
+   {
+      --m_depth;
+   }
+
+   void onParagraph(const std::vector<std::string_view>& /* segments */) override
+   {
+      if (m_depth == 0)
+      {
+         ++m_topLevelCount;
+      }
+
+      ++m_paragraphCount;
+   }
+
+   samx::DocumentCounters getCounters() const noexcept
+   {
+      samx::DocumentCounters counters;
+      counters.blocks     = m_blockCount;
+      counters.paragraphs = m_paragraphCount;
+      counters.maxDepth   = m_maxDepth;
+      return counters;
+   }
+
+   template <typename Sink>
+   void report(Sink& sink) const
+   {
+      sink.write(fmt::format("Found {} top level blocks\n", m_topLevelCount));
+      sink.write(fmt::format(
+         "Counted {} blocks, {} paragraphs, maximum depth {}\n", m_blockCount, m_paragraphCount, m_maxDepth));
+   }
+
+private:
+   size_t m_topLevelCount  = 0;
+   size_t m_blockCount     = 0;
+   size_t m_paragraphCount = 0;
+   size_t m_depth          = 0;
+   size_t m_maxDepth       = 0;
+};
+
+} // namespace
 
 int main(int argc, char* argv[])
 {
-   if (argc < 2)
+   bool   twoStage    = false;
+   bool   flat        = false;
+   bool   count       = false;
+   size_t threadCount = 0;
+   size_t errorLimit  = samx::Diagnostics::k_DefaultErrorLimit;
+
+   samx::OutputFormat format = samx::OutputFormat::Text;
+
+   const char* binaryPath = nullptr;
+
+   std::optional<samx::PathQuery> query;
+
+   const char* cacheDirectory = nullptr;
+   uint64_t    cacheSize      = samx::ParseCache::k_DefaultMaxSize;
+
+   std::optional<samx::Statistics::Format> statsFormat;
+
+   // the statistics go to the standard error, after the diagnostics, unless written apart
+   const char* statsPath = nullptr;
+
+   std::vector<const char*> arguments;
+   for (int ii = 1; ii < argc; ++ii)
+   {
+      const std::string_view arg{argv[ii]};
+      if (arg == "--two-stage")
+      {
+         twoStage = true;
+      }
+      else if (arg == "--flat")
+      {
+         flat = true;
+      }
+      else if (arg == "--count")
+      {
+         // streaming mode: no document is built
+         count = true;
+      }
+      else if (arg == "--stats")
+      {
+         statsFormat = samx::Statistics::Format::Human;
+      }
+      else if (arg == "--stats=json")
+      {
+         statsFormat = samx::Statistics::Format::Json;
+      }
+      else if ((arg == "--stats-file") && (ii + 1 < argc))
+      {
+         statsPath = argv[++ii];
+      }
+      else if ((arg == "--format") && (ii + 1 < argc))
+      {
+         const auto requested = samx::parseOutputFormat(argv[++ii]);
+         if (!requested)
+         {
+            std::cerr << "Error: unknown output format " << argv[ii] << '\n';
+            return 1;
+         }
+
+         format = requested.value();
+      }
+      else if ((arg == "--query") && (ii + 1 < argc))
+      {
+         try
+         {
+            query.emplace(argv[++ii]);
+         }
+         catch (const std::runtime_error& re)
+         {
+            std::cerr << "Error: " << re.what() << '\n';
+            return 1;
+         }
+      }
+      else if ((arg == "--save-binary") && (ii + 1 < argc))
+      {
+         binaryPath = argv[++ii];
+      }
+      else if ((arg == "--cache") && (ii + 1 < argc))
+      {
+         cacheDirectory = argv[++ii];
+      }
+      else if ((arg == "--cache-size") && (ii + 1 < argc))
+      {
+         // in MiB
+         const auto size = samx::parseCount(argv[++ii]);
+         if (!size || (size.value() > UINT64_MAX / (1024 * 1024)))
+         {
+            std::cerr << "Error: invalid cache size " << argv[ii] << '\n' << k_Usage;
+            return 1;
+         }
+
+         cacheSize = uint64_t{size.value()} * 1024 * 1024;
+      }
+      else if ((arg == "--max-errors") && (ii + 1 < argc))
+      {
+         const auto limit = samx::parseCount(argv[++ii]);
+         if (!limit)
+         {
+            std::cerr << "Error: invalid error limit " << argv[ii] << '\n' << k_Usage;
+            return 1;
+         }
+
+         errorLimit = limit.value();
+      }
+      else if ((arg == "-j") && (ii + 1 < argc))
+      {
+         // parsing is split across threads, after normalizing the whole input
+         const auto count = samx::parseCount(argv[++ii]);
+         if (!count)
+         {
+            std::cerr << "Error: invalid thread count " << argv[ii] << '\n' << k_Usage;
+            return 1;
+         }
+
+         threadCount = count.value();
+         twoStage    = true;
+      }
+      else
+      {
+         arguments.push_back(argv[ii]);
+      }
+   }
+
+   if (arguments.empty())
    {
       std::cerr << "Error: input / output arguments missing\n";
+      std::cerr << k_Usage;
       return 1;
    }
 
-   std::ifstream input{argv[1]};
-   if (!input)
+   /*
+    * regular files are mapped; pipes and standard input ('-') are read as streams
+    */
+   const std::string_view inputPath{arguments[0]};
+
+   /*
+    * indentation errors do not stop the parse; they are reported once it completes, and
+    * make the exit status non-zero, like parse errors
+    */
+   samx::Diagnostics diagnostics{errorLimit};
+   bool              failed = false;
+
+   samx::Statistics stats;
+
+   // timings are always taken, they only cost a few clock reads
+   std::unique_ptr<samx::ParseCache> cache;
+
+   std::unique_ptr<samx::ThreadPool> pool;
+   if (threadCount > 0)
    {
-      std::cerr << "Cannot open input file " << argv[1] << '\n';
+      pool = std::make_unique<samx::ThreadPool>(threadCount);
+   }
+
+   samx::IncludeCache includes{pool.get()};
+   Insertions         insertions{includes, inputPath};
+
+   const auto reportStats = [&stats, &statsFormat, statsPath, &diagnostics, &cache, &includes]() {
+      if (statsFormat)
+      {
+         stats.addCounter("errors", diagnostics.getErrorCount());
+         if (cache)
+         {
+            stats.addCounter("cache_hits", cache->getHits());
+            stats.addCounter("cache_misses", cache->getMisses());
+            stats.addCounter("cache_evictions", cache->getEvictions());
+         }
+         if (includes.getLoadCount() > 0)
+         {
+            stats.addCounter("fragments_loaded", includes.getLoadCount());
+            stats.addCounter("fragments_reused", includes.getReuseCount());
+         }
+         stats.addPeakMemory();
+
+         if (statsPath == nullptr)
+         {
+            stats.print(std::cerr, statsFormat.value());
+            return;
+         }
+
+         std::ofstream statsOutput{statsPath};
+         stats.print(statsOutput, statsFormat.value());
+         statsOutput.close();
+         if (!statsOutput)
+         {
+            std::cerr << "Warning: cannot write the statistics to " << statsPath << '\n';
+         }
+      }
+   };
+
+   std::shared_ptr<samx::MappedFile> mappedInput;
+   std::ifstream                     streamInput;
+
+   try
+   {
+      const samx::Statistics::Phase phase{stats, "read"};
+      if ((inputPath != "-") && samx::MappedFile::isRegularFile(arguments[0]))
+      {
+         mappedInput = std::make_shared<samx::MappedFile>(arguments[0]);
+      }
+   }
+   catch (const std::system_error& se)
+   {
+      std::cerr << se.what() << '\n';
       return 2;
    }
 
-   std::ostringstream dedentStream;
+   if (!mappedInput && (inputPath != "-"))
+   {
+      streamInput.open(arguments[0]);
+      if (!streamInput)
+      {
+         std::cerr << "Cannot open input file " << arguments[0] << '\n';
+         return 2;
+      }
+   }
 
-   samx::Normalizer normalizer{dedentStream};
+   if (mappedInput)
+   {
+      includes.prefetch(mappedInput->getContents(), samx::getDirectory(inputPath));
+   }
+
+   std::istream& input = (inputPath == "-") ? std::cin : streamInput;
+
+   std::unique_ptr<samx::FileSink> output;
+
+   try
+   {
+      output = (arguments.size() > 1) ? std::make_unique<samx::FileSink>(arguments[1])
+                                      : std::make_unique<samx::FileSink>(STDOUT_FILENO);
+   }
+   catch (const std::system_error& se)
+   {
+      std::cerr << se.what() << '\n';
+      return 2;
+   }
+
+   /*
+    * documents saved with --save-binary, or found in the cache, are used in place
+    */
+   std::optional<samx::BinaryDocument> binaryDoc;
+   std::string                         cacheKey;
 
-   normalizer.normalize(input);
+   if (mappedInput && (cacheDirectory != nullptr) && !count)
+   {
+      try
+      {
+         cache = std::make_unique<samx::ParseCache>(cacheDirectory, cacheSize);
+      }
+      catch (const std::system_error& se)
+      {
+         std::cerr << "Warning: parse cache disabled: " << se.what() << '\n';
+      }
+   }
+
+   try
+   {
+      if (mappedInput && samx::BinaryDocument::hasSignature(mappedInput->getContents()))
+      {
+         const samx::Statistics::Phase phase{stats, "load"};
+         binaryDoc.emplace(mappedInput->getContents());
+      }
+      else if (cache)
+      {
+         const samx::Statistics::Phase phase{stats, "cache lookup"};
+         cacheKey  = samx::ParseCache::makeKey(mappedInput->getContents());
+         binaryDoc = cache->find(cacheKey);
+
+         std::cerr << (binaryDoc ? "Parse cache hit\n" : "Parse cache miss\n");
+      }
+
+      if (binaryDoc)
+      {
+         printBinary(*binaryDoc, *output, format, query ? &*query : nullptr, stats);
+      }
+   }
+   catch (const std::runtime_error& re)
+   {
+      std::cerr << "Exception: " << re.what() << std::endl;
+      failed = true;
+   }
 
-   std::ostream* output = &std::cout;
+   if (binaryDoc || failed)
+   {
+      reportStats();
 
-   std::unique_ptr<std::ofstream> fileOutput;
+      return failed ? 3 : 0;
+   }
 
-   if (argc > 2)
+   if (count)
    {
-      fileOutput = std::make_unique<std::ofstream>(argv[2]);
-      output     = fileOutput.get();
+      CountingHandler          counter;
+      samx::InsertionResolver  resolver{counter, includes, inputPath};
+      samx::NormalizerCounters normalizerCounters;
+
+      try
+      {
+         const samx::Statistics::Phase phase{stats, "normalize+parse"};
+         if (mappedInput)
+         {
+            samx::normalizeAndParse(mappedInput->getContents(), resolver, &normalizerCounters, &diagnostics);
+         }
+         else
+         {
+            samx::normalizeAndParse(input, resolver, &normalizerCounters, &diagnostics);
+         }
+
+         diagnostics.report(std::cerr);
+         counter.report(*output);
+         output->flush();
+      }
+      catch (const std::runtime_error& re)
+      {
+         diagnostics.report(std::cerr);
+         std::cerr << "Exception: " << re.what() << std::endl;
+         failed = true;
+      }
+
+      stats.addCounters(normalizerCounters);
+      stats.addCounters(counter.getCounters());
+      reportStats();
+
+      return (failed || !diagnostics.empty()) ? 3 : 0;
    }
 
    try
    {
-      const auto doc = samx::parse(dedentStream.str());
+      auto contents = mappedInput ? mappedInput->getContents() : std::string_view();
+
+      // a query needs no Document, unless the two stages are requested
+      std::optional<samx::Document>     doc;
+      std::optional<samx::FlatDocument> flatDoc;
+      std::optional<samx::BlockIndex>   index;
+
+      if (query && !twoStage)
+      {
+         flatDoc.emplace();
+         index.emplace();
+
+         if (mappedInput)
+         {
+            parseIndexed(contents, *flatDoc, *index, insertions, diagnostics, stats);
+         }
+         else
+         {
+            parseIndexed(input, *flatDoc, *index, insertions, diagnostics, stats);
+         }
+      }
+      else
+      {
+         doc.emplace(twoStage ? (mappedInput ? parseTwoStage(contents, pool.get(), insertions, diagnostics, stats)
+                                             : parseTwoStage(input, pool.get(), insertions, diagnostics, stats))
+                              : (mappedInput ? parseSinglePass(contents, mappedInput, insertions, diagnostics, stats)
+                                             : parseSinglePass(input, nullptr, insertions, diagnostics, stats)));
+      }
+
+      diagnostics.report(std::cerr);
+
+      std::cerr << "Found " << (doc ? doc->getBlockCount() : flatDoc->getBlockCount()) << " top level blocks\n";
 
-      std::cerr << "Found " << doc.getBlockCount() << " top level blocks\n";
+      if (statsFormat && doc)
+      {
+         stats.addCounters(doc->getCounters());
+      }
 
-      *output << doc << "\n";
+      size_t outputSize = 0;
+
+      /*
+       * documents with indentation errors are not cached, so that the errors are reported
+       * again; neither are documents with insertions, whose fragments may change
+       */
+      const bool cacheable = cache && diagnostics.empty() && (insertions.count == 0);
+
+      if (!flatDoc && (flat || query || (binaryPath != nullptr) || cacheable))
+      {
+         const samx::Statistics::Phase phase{stats, "flatten"};
+         flatDoc.emplace(*doc);
+      }
+
+      if (cacheable)
+      {
+         const samx::Statistics::Phase phase{stats, "cache store"};
+         cache->store(cacheKey, *flatDoc);
+      }
+
+      if (binaryPath != nullptr)
+      {
+         const samx::Statistics::Phase phase{stats, "save"};
+
+         samx::FileSink binaryOutput{binaryPath};
+         samx::writeBinary(binaryOutput, *flatDoc);
+         binaryOutput.flush();
+      }
+
+      if (query)
+      {
+         if (!index)
+         {
+            const samx::Statistics::Phase phase{stats, "index"};
+            index.emplace(*flatDoc);
+         }
+
+         std::vector<uint32_t> matches;
+         {
+            const samx::Statistics::Phase phase{stats, "query"};
+            matches = query->evaluate(*flatDoc, *index);
+         }
+
+         outputSize = printMatches(*output, *flatDoc, matches);
+      }
+      else if (flat)
+      {
+         std::cerr << "Flat document: " << flatDoc->getNodeCount() << " nodes, " << flatDoc->getStorageSize()
+                   << " bytes\n";
+
+         const samx::Statistics::Phase phase{stats, "render"};
+         outputSize = render(*output, *flatDoc, format);
+      }
+      else
+      {
+         const samx::Statistics::Phase phase{stats, "render"};
+         outputSize = render(*output, *doc, format, pool.get());
+      }
+
+      stats.addCounter("output_bytes", outputSize);
    }
    catch (const std::runtime_error& re)
    {
+      diagnostics.report(std::cerr);
       std::cerr << "Exception: " << re.what() << std::endl;
+      failed = true;
    }
 
-   return 0;
+   reportStats();
+
+   return (failed || !diagnostics.empty()) ? 3 : 0;
 }
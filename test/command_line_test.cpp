@@ -0,0 +1,40 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "command_line.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+
+TEST(CommandLineTest, ParsesDecimalCounts)
+{
+   EXPECT_EQ(0U, samx::parseCount("0"));
+   EXPECT_EQ(16U, samx::parseCount("16"));
+   EXPECT_EQ(SIZE_MAX, samx::parseCount("18446744073709551615"));
+}
+
+TEST(CommandLineTest, RejectsAnythingElse)
+{
+   EXPECT_FALSE(samx::parseCount(""));
+   EXPECT_FALSE(samx::parseCount("x"));
+   EXPECT_FALSE(samx::parseCount("4x"));
+   EXPECT_FALSE(samx::parseCount(" 4"));
+   EXPECT_FALSE(samx::parseCount("-1"));
+   EXPECT_FALSE(samx::parseCount("+1"));
+   EXPECT_FALSE(samx::parseCount("18446744073709551616"));
+}
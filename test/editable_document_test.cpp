@@ -0,0 +1,215 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "editable_document.h"
+
+#include "corpus_generator.h"
+#include "diagnostics.h"
+#include "samx_parser.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+namespace
+{
+
+struct ParseResult
+{
+   std::string text;
+   std::string error;
+
+   // all of them, to be searched for those reported after an edit
+   samx::Diagnostics diagnostics{std::numeric_limits<size_t>::max()};
+};
+
+ParseResult parseFull(std::string_view source)
+{
+   ParseResult result;
+
+   try
+   {
+      samx::Document doc;
+      samx::normalizeAndParse(source, doc, nullptr, &result.diagnostics);
+
+      std::ostringstream os;
+      os << doc;
+      result.text = os.str();
+   }
+   catch (const std::runtime_error& re)
+   {
+      result.error = re.what();
+   }
+
+   return result;
+}
+
+std::string render(const samx::Document& doc)
+{
+   std::ostringstream os;
+   os << doc;
+   return os.str();
+}
+
+// the edit only reports the errors in the sections it parsed, but numbers them the same
+void expectDiagnosticsFound(const samx::Diagnostics& partial, const samx::Diagnostics& full)
+{
+   for (const auto& diagnostic : partial.getRecords())
+   {
+      const auto& records = full.getRecords();
+      const auto  found   = std::find_if(records.cbegin(), records.cend(), [&diagnostic](const samx::Diagnostic& other) {
+         return (other.line == diagnostic.line) && (samx::format(other) == samx::format(diagnostic));
+      });
+
+      EXPECT_NE(records.cend(), found) << "line " << diagnostic.line << ": " << samx::format(diagnostic);
+   }
+}
+
+/*
+ * Applies random edits, mostly within words so that the document tends to stay valid, and
+ * compares the result of each one with a full parse of the edited source.
+ */
+void checkRandomEdits(const samx::CorpusOptions& options, unsigned seed, size_t editCount)
+{
+   samx::EditableDocument doc{samx::generateCorpus(options)};
+
+   std::mt19937 random{seed};
+
+   const std::array<std::string_view, 11> anyText{
+      "x", " ", "\n", "\n\n", "note: a\n", "  ", "foo bar\n\n", "a:", "    item: b\n\n", "\n    p q\n\n", ""};
+   const std::array<std::string_view, 6> wordText{"x", " y", "zz", "", "\n\nnew para\n\n", "\n\ntop: level\n\n"};
+
+   const auto isLetter = [](char ch) {
+      return std::isalpha(static_cast<unsigned char>(ch)) != 0;
+   };
+
+   for (size_t edit = 0; edit < editCount; ++edit)
+   {
+      const std::string source{doc.getSource()};
+
+      size_t           offset = (random() % (source.size() + 1));
+      size_t           length = (random() % 3 == 0) ? random() % std::min<size_t>(20, source.size() - offset + 1) : 0;
+      std::string_view replacement = anyText[random() % anyText.size()];
+
+      if ((random() % 10 < 7) && (source.size() > 1))
+      {
+         for (size_t tries = 0; tries < 50; ++tries)
+         {
+            offset = 1 + random() % (source.size() - 1);
+            if (isLetter(source[offset - 1]) && isLetter(source[offset]))
+            {
+               break;
+            }
+         }
+
+         length      = ((random() % 2 == 0) && isLetter(source[offset])) ? 1 : 0;
+         replacement = wordText[random() % wordText.size()];
+      }
+
+      std::string edited{source};
+      edited.replace(offset, length, replacement);
+
+      const auto expected = parseFull(edited);
+
+      std::string error;
+      try
+      {
+         doc.applyEdit(offset, length, replacement);
+      }
+      catch (const std::runtime_error& re)
+      {
+         error = re.what();
+      }
+
+      ASSERT_EQ(edited, doc.getSource()) << "edit " << edit;
+      ASSERT_EQ(expected.error, error) << "edit " << edit << " at " << offset;
+
+      if (error.empty())
+      {
+         ASSERT_EQ(expected.text, render(doc.getDocument())) << "edit " << edit << " at " << offset;
+         expectDiagnosticsFound(doc.getDiagnostics(), expected.diagnostics);
+      }
+      else
+      {
+         // undo, so that most edits start from a valid document
+         doc.applyEdit(offset, replacement.size(), std::string_view(source).substr(offset, length));
+      }
+   }
+}
+
+} // namespace
+
+TEST(EditableDocumentTest, RandomEditsMatchFullParse)
+{
+   samx::CorpusOptions options;
+   options.targetSize = 16 * 1024;
+
+   checkRandomEdits(options, 1, 1000);
+}
+
+TEST(EditableDocumentTest, RandomEditsMatchFullParseOfDeepDocument)
+{
+   samx::CorpusOptions options;
+   options.targetSize = 16 * 1024;
+   options.maxDepth   = 12;
+   options.fanOut     = 2;
+   options.seed       = 2;
+
+   checkRandomEdits(options, 2, 1000);
+}
+
+TEST(EditableDocumentTest, RandomEditsMatchFullParseOfLongParagraphs)
+{
+   samx::CorpusOptions options;
+   options.targetSize     = 16 * 1024;
+   options.maxDepth       = 2;
+   options.paragraphLines = 24;
+   options.seed           = 3;
+
+   checkRandomEdits(options, 3, 1000);
+}
+
+TEST(EditableDocumentTest, DiagnosticsAreNumberedFromTheStartOfTheSource)
+{
+   samx::EditableDocument doc{"first: one\n\n  para\n\nsecond: two\n    text\n  more\n\nthird: x\n"};
+
+   ASSERT_EQ(1U, doc.getDiagnostics().getErrorCount());
+   EXPECT_EQ(7U, doc.getDiagnostics().getRecords().front().line);
+
+   // only the second section is parsed again
+   doc.applyEdit(doc.getSource().find("two"), 0, "longer ");
+
+   ASSERT_EQ(1U, doc.getDiagnostics().getErrorCount());
+   EXPECT_EQ(7U, doc.getDiagnostics().getRecords().front().line);
+
+   // the first section is parsed again, and the second one moves down
+   doc.applyEdit(0, 0, "zero: block\n\n");
+   EXPECT_TRUE(doc.getDiagnostics().empty());
+
+   doc.applyEdit(doc.getSource().find("two"), 0, "x");
+
+   ASSERT_EQ(1U, doc.getDiagnostics().getErrorCount());
+   EXPECT_EQ(9U, doc.getDiagnostics().getRecords().front().line);
+   EXPECT_EQ(9U, parseFull(doc.getSource()).diagnostics.getRecords().front().line);
+}
@@ -0,0 +1,43 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "flat_document.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <stdexcept>
+
+TEST(FlatDocumentTest, NestingBeyondTheDepthLimitIsRejected)
+{
+   samx::FlatDocument doc;
+   for (uint32_t ii = 0; ii <= UINT16_MAX; ++ii)
+   {
+      doc.beginBlock("section:", "");
+   }
+
+   EXPECT_EQ(UINT16_MAX, doc.getNode(UINT16_MAX).depth);
+
+   EXPECT_THROW(doc.beginBlock("section:", ""), std::runtime_error);
+   EXPECT_THROW(doc.addParagraph("text"), std::runtime_error);
+   EXPECT_EQ(size_t{UINT16_MAX} + 1, doc.getNodeCount());
+
+   // the document is still usable above the limit
+   doc.endBlock();
+   doc.addParagraph("text");
+   EXPECT_EQ(UINT16_MAX, doc.getNode(UINT16_MAX + 1).depth);
+}
@@ -0,0 +1,139 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "include_cache.h"
+
+#include "samx_parser.h"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace
+{
+
+const std::string_view k_Source = "section: Doc\n\n   <<<fragment\n";
+
+class IncludeCacheTest : public ::testing::Test
+{
+protected:
+   IncludeCacheTest() : m_directory{::testing::TempDir() + "include_cache_test"}
+   {
+      std::filesystem::remove_all(m_directory);
+      std::filesystem::create_directories(m_directory);
+   }
+
+   ~IncludeCacheTest() override
+   {
+      std::filesystem::remove_all(m_directory);
+   }
+
+   // different lengths, so that a rewrite is noticed even within the timestamp resolution
+   void writeFragment(std::string_view text) const
+   {
+      std::ofstream output{m_directory + "/fragment.sam", std::ios::trunc};
+      output << text;
+   }
+
+   // a document referencing its text, rather than copying it
+   std::unique_ptr<samx::Document> parse(samx::IncludeCache& cache) const
+   {
+      auto doc = std::make_unique<samx::Document>();
+      doc->shareSource(std::make_shared<const std::string>(k_Source));
+
+      samx::InsertionResolver resolver{*doc, cache, m_directory + "/doc.sam"};
+      samx::normalizeAndParse(k_Source, resolver);
+
+      return doc;
+   }
+
+   static std::string print(const samx::Document& doc)
+   {
+      std::ostringstream os;
+      os << doc;
+      return os.str();
+   }
+
+   std::string m_directory;
+};
+
+} // anonymous namespace
+
+TEST_F(IncludeCacheTest, ChangesAreIgnoredByDefault)
+{
+   writeFragment("First.\n");
+
+   samx::IncludeCache cache;
+   const auto         first = print(*parse(cache));
+
+   writeFragment("Second version.\n");
+   EXPECT_EQ(first, print(*parse(cache)));
+
+   EXPECT_EQ(1U, cache.getLoadCount());
+   EXPECT_EQ(1U, cache.getReuseCount());
+}
+
+TEST_F(IncludeCacheTest, ChangedFragmentsAreReloaded)
+{
+   writeFragment("First.\n");
+
+   auto cache = std::make_unique<samx::IncludeCache>(nullptr, samx::IncludeCache::Changes::Reloaded);
+
+   const auto first     = parse(*cache);
+   const auto firstText = print(*first);
+   EXPECT_NE(std::string::npos, firstText.find("First."));
+
+   EXPECT_EQ(firstText, print(*parse(*cache)));
+   EXPECT_EQ(1U, cache->getLoadCount());
+
+   writeFragment("Second version.\n");
+   EXPECT_NE(std::string::npos, print(*parse(*cache)).find("Second version."));
+   EXPECT_EQ(2U, cache->getLoadCount());
+
+   // the first document still owns the version it references
+   cache.reset();
+   EXPECT_EQ(firstText, print(*first));
+}
+
+TEST_F(IncludeCacheTest, FailuresAreKeptUntilTheFilesChange)
+{
+   writeFragment("bad:\n  x\n   y\n");
+
+   samx::IncludeCache cache{nullptr, samx::IncludeCache::Changes::Reloaded};
+
+   EXPECT_THROW(parse(cache), std::runtime_error);
+   EXPECT_THROW(parse(cache), std::runtime_error);
+   EXPECT_EQ(1U, cache.getLoadCount());
+
+   writeFragment("Fixed.\n\n<<<missing\n");
+   EXPECT_THROW(parse(cache), std::runtime_error);
+
+   {
+      std::ofstream output{m_directory + "/missing.sam"};
+      output << "Found.\n";
+   }
+
+   const auto text = print(*parse(cache));
+   EXPECT_NE(std::string::npos, text.find("Fixed."));
+   EXPECT_NE(std::string::npos, text.find("Found."));
+}
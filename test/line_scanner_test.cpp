@@ -0,0 +1,120 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "line_scanner.h"
+#include "normalizer.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+std::vector<std::filesystem::path> getTestFiles()
+{
+   std::vector<std::filesystem::path> paths;
+   for (const auto& entry : std::filesystem::directory_iterator{SAMX_TEST_DATA_DIR})
+   {
+      if (entry.path().extension() == ".sam")
+      {
+         paths.push_back(entry.path());
+      }
+   }
+
+   std::sort(paths.begin(), paths.end());
+   return paths;
+}
+
+// the normalized text, followed by the indentation errors
+std::string normalize(const std::filesystem::path& path, samx::ScanKernel kernel)
+{
+   std::ifstream input{path};
+   EXPECT_TRUE(input) << path;
+
+   std::ostringstream output;
+   {
+      samx::Normalizer normalizer{output};
+      normalizer.setScanKernel(kernel);
+      normalizer.normalize(input);
+      normalizer.getDiagnostics().report(output);
+   }
+
+   return output.str();
+}
+
+void checkMatchesScalar(samx::ScanKernel kernel)
+{
+   const auto paths = getTestFiles();
+   ASSERT_FALSE(paths.empty());
+
+   for (const auto& path : paths)
+   {
+      EXPECT_EQ(normalize(path, samx::ScanKernel::Scalar), normalize(path, kernel)) << path;
+   }
+}
+
+} // namespace
+
+TEST(LineScannerTest, SSE2MatchesScalarOnTestData)
+{
+   ASSERT_EQ(samx::ScanKernel::SSE2, samx::getLineScanner(samx::ScanKernel::SSE2).kernel);
+
+   checkMatchesScalar(samx::ScanKernel::SSE2);
+}
+
+TEST(LineScannerTest, AVX2MatchesScalarOnTestData)
+{
+   if (samx::getLineScanner(samx::ScanKernel::AVX2).kernel != samx::ScanKernel::AVX2)
+   {
+      GTEST_SKIP() << "AVX2 is not supported by this CPU";
+   }
+
+   checkMatchesScalar(samx::ScanKernel::AVX2);
+}
+
+TEST(LineScannerTest, KernelsAgreeAtEveryOffset)
+{
+   // longer than two AVX2 blocks, so that every kernel runs its vector loop and its tail
+   std::string text(80, ' ');
+   text[70] = '\n';
+
+   const auto& scalar = samx::getLineScanner(samx::ScanKernel::Scalar);
+
+   for (const auto kernel : {samx::ScanKernel::SSE2, samx::ScanKernel::AVX2})
+   {
+      const auto& scanner = samx::getLineScanner(kernel);
+
+      for (size_t begin = 0; begin < text.size(); ++begin)
+      {
+         for (size_t end = begin; end <= text.size(); ++end)
+         {
+            const char* const first = text.data() + begin;
+            const char* const last  = text.data() + end;
+
+            ASSERT_EQ(scalar.findNewLine(first, last), scanner.findNewLine(first, last)) << begin << ' ' << end;
+            ASSERT_EQ(scalar.countLeadingSpaces(first, last), scanner.countLeadingSpaces(first, last))
+               << begin << ' ' << end;
+         }
+      }
+   }
+}
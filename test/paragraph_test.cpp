@@ -0,0 +1,51 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "samx_parser.h"
+
+#include <gtest/gtest.h>
+
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+TEST(ParagraphTest, TextIsTheSameForCopiedAndReferencedSegments)
+{
+   const std::string source{"first line\nsecond\nthird"};
+
+   const std::vector<std::string_view> segments{std::string_view(source).substr(0, 10),
+                                                std::string_view(source).substr(11, 6),
+                                                std::string_view(source).substr(18)};
+
+   const samx::Paragraph copied{segments, std::pmr::get_default_resource(), samx::Paragraph::TextStorage::Copy};
+   const samx::Paragraph referenced{
+      segments, std::pmr::get_default_resource(), samx::Paragraph::TextStorage::Reference};
+
+   EXPECT_EQ("first line second third", copied.getText());
+   EXPECT_EQ("first line second third", referenced.getText());
+}
+
+TEST(ParagraphTest, SingleReferencedSegmentIsReturnedWhole)
+{
+   const std::string source{"only line"};
+
+   const samx::Paragraph paragraph{
+      {std::string_view(source)}, std::pmr::get_default_resource(), samx::Paragraph::TextStorage::Reference};
+
+   EXPECT_EQ(source, paragraph.getText());
+}
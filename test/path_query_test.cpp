@@ -0,0 +1,183 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "path_query.h"
+
+#include "binary_document.h"
+#include "block_index.h"
+#include "flat_document.h"
+#include "samx_parser.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+
+const char* const k_Source = R"(section: One
+
+   Introduction.
+
+   subsection: Alpha
+
+      Text.
+
+   subsection: Beta Two
+
+      Text.
+
+section: Two
+
+   note: Plain
+
+      subsection: Gamma
+
+         Text.
+
+   note: Say hi
+
+      Text.
+
+subsection: Top
+
+   Text.
+)";
+
+class PathQueryTest : public ::testing::Test
+{
+protected:
+   PathQueryTest()
+   {
+      samx::IndexingHandler indexer{m_flatDoc, m_index};
+      samx::normalizeAndParse(k_Source, indexer);
+      indexer.finish();
+
+      m_bytes = samx::toBinary(m_flatDoc);
+   }
+
+   // descriptions of the matching blocks, which must be the same for both representations
+   std::vector<std::string> select(std::string_view text) const
+   {
+      const samx::PathQuery query{text};
+      EXPECT_EQ(text, query.getText());
+
+      const samx::BinaryDocument binary{m_bytes};
+
+      const auto ids = query.evaluate(m_flatDoc, m_index);
+      EXPECT_EQ(ids, query.evaluate(binary)) << text;
+
+      std::vector<std::string> descriptions;
+      for (const auto id : ids)
+      {
+         descriptions.emplace_back(m_flatDoc.getDescription(m_flatDoc.getNode(id)));
+      }
+      return descriptions;
+   }
+
+   samx::FlatDocument m_flatDoc;
+   samx::BlockIndex   m_index;
+   std::string        m_bytes;
+};
+
+using Descriptions = std::vector<std::string>;
+
+} // anonymous namespace
+
+TEST_F(PathQueryTest, TypeMatchesAtAnyDepth)
+{
+   EXPECT_EQ((Descriptions{"Alpha", "Beta Two", "Gamma", "Top"}), select("subsection"));
+   EXPECT_EQ((Descriptions{"Alpha", "Beta Two", "Gamma", "Top"}), select("//subsection"));
+   EXPECT_EQ((Descriptions{"Plain", "Say hi"}), select("note"));
+   EXPECT_TRUE(select("chapter").empty());
+}
+
+TEST_F(PathQueryTest, LeadingSlashSelectsTopLevelBlocks)
+{
+   EXPECT_EQ((Descriptions{"Top"}), select("/subsection"));
+   EXPECT_EQ((Descriptions{"One", "Two", "Top"}), select("/*"));
+   EXPECT_TRUE(select("/note").empty());
+}
+
+TEST_F(PathQueryTest, ChildAndDescendantSteps)
+{
+   EXPECT_EQ((Descriptions{"Alpha", "Beta Two"}), select("section/subsection"));
+   EXPECT_EQ((Descriptions{"Alpha", "Beta Two", "Gamma"}), select("section//subsection"));
+   EXPECT_EQ((Descriptions{"Gamma"}), select("/section/note/subsection"));
+   EXPECT_EQ((Descriptions{"Alpha", "Beta Two", "Plain", "Say hi"}), select("section/*"));
+   EXPECT_EQ((Descriptions{"Gamma"}), select("*/*/subsection"));
+   EXPECT_TRUE(select("subsection/subsection").empty());
+   EXPECT_TRUE(select("chapter/subsection").empty());
+}
+
+TEST_F(PathQueryTest, DescriptionPredicates)
+{
+   EXPECT_EQ((Descriptions{"Beta Two"}), select(R"(subsection[description="Beta Two"])"));
+   EXPECT_TRUE(select(R"(subsection[description="Beta"])").empty());
+   EXPECT_EQ((Descriptions{"Beta Two"}), select(R"(subsection[description~="Two"])"));
+   EXPECT_EQ((Descriptions{"Beta Two", "Two"}), select(R"(*[description~="Two"])"));
+   EXPECT_EQ((Descriptions{"Gamma"}), select(R"(section[description="Two"]//subsection)"));
+   EXPECT_EQ((Descriptions{"Say hi"}), select(R"(note[description="Say \h\i"])"));
+   EXPECT_TRUE(select(R"(note[description~="\"hi\""])").empty());
+}
+
+TEST(PathQuerySyntaxTest, InvalidQueriesAreRejected)
+{
+   const std::vector<std::string_view> invalid{
+      "",
+      "/",
+      "///section",
+      "section/",
+      "section//",
+      "section subsection",
+      "1section",
+      "section[",
+      "section[]",
+      R"(section[title="One"])",
+      R"(section[description])",
+      R"(section[description=One])",
+      R"(section[description="One)",
+      R"(section[description="One\)",
+      R"(section[description="One")",
+      R"(section[description="One"]])",
+   };
+
+   for (const auto text : invalid)
+   {
+      EXPECT_THROW(samx::PathQuery{text}, std::runtime_error) << text;
+   }
+}
+
+TEST(PathQuerySymbolsTest, TypesOfOtherDocumentsSharingTheTableMatchNothing)
+{
+   const auto symbols = std::make_shared<samx::SymbolTable>();
+   symbols->intern("chapter:");
+
+   samx::Document doc{symbols};
+   samx::normalizeAndParse(k_Source, doc);
+
+   const samx::FlatDocument flatDoc{doc};
+   const samx::BlockIndex   index{flatDoc};
+
+   EXPECT_EQ(symbols, flatDoc.shareSymbols());
+   EXPECT_TRUE(samx::PathQuery{"chapter"}.evaluate(flatDoc, index).empty());
+   EXPECT_EQ(4U, samx::PathQuery{"subsection"}.evaluate(flatDoc, index).size());
+}
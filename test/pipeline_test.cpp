@@ -0,0 +1,167 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "pipeline.h"
+
+#include "diagnostics.h"
+#include "mapped_file.h"
+#include "samx_parser.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+/*
+ * Keeps the text of each document, or its error.
+ */
+class CollectingConsumer : public samx::PipelineConsumer
+{
+public:
+   explicit CollectingConsumer(size_t fileCount) : m_results(fileCount)
+   {
+   }
+
+   samx::DocumentHandler& beginFile(size_t /* index */) override
+   {
+      m_doc.emplace();
+      return *m_doc;
+   }
+
+   void endFile(size_t index, const samx::Diagnostics& diagnostics, std::string_view error) override
+   {
+      std::ostringstream os;
+      if (error.empty())
+      {
+         os << *m_doc;
+      }
+      else
+      {
+         os << "error\n";
+      }
+      os << diagnostics.getErrorCount() << '\n';
+
+      m_results[index] = os.str();
+      m_doc.reset();
+   }
+
+   const std::vector<std::string>& getResults() const noexcept
+   {
+      return m_results;
+   }
+
+private:
+   std::optional<samx::Document> m_doc;
+   std::vector<std::string>      m_results;
+};
+
+std::string parseDirectly(const std::string& path)
+{
+   const auto file = samx::loadFile(path.c_str());
+
+   samx::Diagnostics diagnostics;
+   samx::Document    doc;
+
+   std::ostringstream os;
+   try
+   {
+      samx::normalizeAndParse(file.contents, doc, nullptr, &diagnostics);
+      os << doc;
+   }
+   catch (const std::runtime_error& /* re */)
+   {
+      os << "error\n";
+   }
+   os << diagnostics.getErrorCount() << '\n';
+
+   return os.str();
+}
+
+} // anonymous namespace
+
+TEST(BoundedQueueTest, ItemsArriveInOrderWhenBothEndsBlock)
+{
+   constexpr size_t k_ItemCount = 200'000;
+
+   samx::BoundedQueue<size_t> queue{2};
+
+   // each end pauses now and then, so that the other one finds the queue full or empty and sleeps
+   std::thread producer{[&queue]() {
+      samx::BoundedQueue<size_t>::Duration waited{};
+      for (size_t ii = 0; ii < k_ItemCount; ++ii)
+      {
+         if (ii % 20'000 == 0)
+         {
+            std::this_thread::sleep_for(std::chrono::milliseconds{2});
+         }
+
+         queue.push(size_t{ii}, waited);
+      }
+   }};
+
+   samx::BoundedQueue<size_t>::Duration waited{};
+   for (size_t ii = 0; ii < k_ItemCount; ++ii)
+   {
+      if (ii % 20'000 == 10'000)
+      {
+         std::this_thread::sleep_for(std::chrono::milliseconds{2});
+      }
+
+      ASSERT_EQ(ii, queue.pop(waited));
+   }
+
+   producer.join();
+
+   EXPECT_GT(waited.count(), 0);
+}
+
+TEST(PipelineTest, DocumentsMatchTheSinglePassParser)
+{
+   std::vector<std::string> paths;
+   for (const auto& entry : std::filesystem::directory_iterator{SAMX_TEST_DATA_DIR})
+   {
+      if (entry.path().extension() == ".sam")
+      {
+         paths.push_back(entry.path().string());
+      }
+   }
+
+   std::sort(paths.begin(), paths.end());
+   ASSERT_FALSE(paths.empty());
+
+   CollectingConsumer consumer{paths.size()};
+   const auto         stats = samx::runPipeline(paths, consumer);
+
+   size_t bytes = 0;
+   for (size_t ii = 0; ii < paths.size(); ++ii)
+   {
+      EXPECT_EQ(parseDirectly(paths[ii]), consumer.getResults()[ii]) << paths[ii];
+      bytes += std::filesystem::file_size(paths[ii]);
+   }
+
+   EXPECT_EQ(bytes, stats.bytes);
+}
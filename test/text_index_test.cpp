@@ -0,0 +1,169 @@
+/*
+   Copyright 2020 Florin Iucha
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "text_index.h"
+
+#include "mapped_file.h"
+#include "output_sink.h"
+#include "samx_parser.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+samx::TextIndexSegment indexSource(std::string path, std::string_view source)
+{
+   samx::TextIndexSegment segment{std::move(path)};
+   samx::normalizeAndParse(source, segment);
+   return segment;
+}
+
+std::string writeIndex(samx::TextIndexWriter& writer, const char* name)
+{
+   const auto path = ::testing::TempDir() + name;
+
+   samx::FileSink sink{path.c_str()};
+   writer.write(sink);
+   sink.flush();
+
+   return path;
+}
+
+void writeBytes(const std::string& path, const std::string& bytes)
+{
+   std::ofstream output{path, std::ios::binary | std::ios::trunc};
+   output.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+}
+
+std::vector<uint32_t> getParagraphs(const std::vector<samx::TextIndex::Posting>& postings)
+{
+   std::vector<uint32_t> paragraphs;
+   for (const auto& posting : postings)
+   {
+      paragraphs.push_back(posting.paragraph);
+   }
+   return paragraphs;
+}
+
+} // anonymous namespace
+
+TEST(TextIndexTest, LaterSegmentsAreNumberedAfterTheEarlierOnes)
+{
+   samx::TextIndexWriter writer;
+   writer.add(indexSource("a.sam", "alpha beta\n\ngamma\n\nalpha alpha\n"));
+   writer.add(indexSource("b.sam", "gamma\n"));
+   writer.add(indexSource("c.sam", "section: S\n\n   beta\n\n   alpha gamma\n"));
+
+   ASSERT_EQ(6U, writer.getParagraphCount());
+
+   const auto             path = writeIndex(writer, "rebased.samx-index");
+   const samx::TextIndex index{path.c_str()};
+
+   ASSERT_EQ(3U, index.getFileCount());
+   ASSERT_EQ(6U, index.getParagraphCount());
+
+   const auto alpha = index.getPostings("alpha");
+   EXPECT_EQ((std::vector<uint32_t>{0, 2, 5}), getParagraphs(alpha));
+   ASSERT_EQ(3U, alpha.size());
+   EXPECT_EQ((std::vector<uint32_t>{0}), alpha[0].positions);
+   EXPECT_EQ((std::vector<uint32_t>{0, 1}), alpha[1].positions);
+   EXPECT_EQ((std::vector<uint32_t>{0}), alpha[2].positions);
+
+   // first seen in the first segment, then only in later ones
+   const auto gamma = index.getPostings("gamma");
+   EXPECT_EQ((std::vector<uint32_t>{1, 3, 5}), getParagraphs(gamma));
+   ASSERT_EQ(3U, gamma.size());
+   EXPECT_EQ((std::vector<uint32_t>{1}), gamma[2].positions);
+
+   EXPECT_EQ((std::vector<uint32_t>{0, 4}), getParagraphs(index.getPostings("beta")));
+   EXPECT_TRUE(index.getPostings("delta").empty());
+
+   const auto& last = index.getParagraph(5);
+   EXPECT_EQ("c.sam", index.getFile(last));
+   EXPECT_EQ("section", index.getBlockPath(last));
+   EXPECT_EQ(1U, last.ordinal);
+}
+
+TEST(TextIndexTest, SearchMatchesAllWordsAndPhrases)
+{
+   samx::TextIndexWriter writer;
+   writer.add(indexSource("a.sam", "alpha beta\n\ngamma\n\nalpha alpha\n"));
+   writer.add(indexSource("b.sam", "Gamma, then Alpha.\n"));
+
+   const auto             path = writeIndex(writer, "search.samx-index");
+   const samx::TextIndex index{path.c_str()};
+
+   EXPECT_EQ((std::vector<uint32_t>{0, 2, 3}), index.search("alpha"));
+   EXPECT_EQ((std::vector<uint32_t>{3}), index.search("alpha gamma"));
+   EXPECT_EQ((std::vector<uint32_t>{2}), index.search("\"alpha alpha\""));
+   EXPECT_EQ((std::vector<uint32_t>{3}), index.search("\"gamma then\""));
+   EXPECT_TRUE(index.search("\"beta alpha\"").empty());
+   EXPECT_TRUE(index.search("delta").empty());
+}
+
+TEST(TextIndexTest, CorruptPostingsAreRejected)
+{
+   samx::TextIndexWriter writer;
+   writer.add(indexSource("a.sam", "x\n"));
+
+   const auto path     = writeIndex(writer, "corrupt.samx-index");
+   const auto original = std::string{samx::loadFile(path.c_str()).contents};
+
+   samx::TextIndex::Header header{};
+   std::memcpy(&header, original.data(), sizeof(header));
+   ASSERT_EQ(1U, header.termCount);
+
+   samx::TextIndex::Term term{};
+   std::memcpy(&term, original.data() + header.termsOffset, sizeof(term));
+
+   // paragraph distance, number of occurrences, word position
+   const auto postings = header.postingsOffset + term.postingsOffset;
+   ASSERT_EQ(3U, term.postingsSize);
+   ASSERT_EQ(std::string("\x00\x01\x00", 3), original.substr(postings, 3));
+
+   {
+      const samx::TextIndex index{path.c_str()};
+      ASSERT_EQ(1U, index.getPostings("x").size());
+   }
+
+   const std::vector<std::pair<size_t, char>> corruptions{
+      {0, '\x01'}, // past the last paragraph
+      {1, '\x02'}, // more positions than bytes left
+      {1, '\x00'}, // trailing bytes
+      {2, '\x80'}, // unterminated position
+   };
+
+   for (const auto& [offset, value] : corruptions)
+   {
+      auto bytes               = original;
+      bytes[postings + offset] = value;
+      writeBytes(path, bytes);
+
+      const samx::TextIndex index{path.c_str()};
+      EXPECT_THROW(index.getPostings("x"), std::runtime_error) << "byte " << offset;
+      EXPECT_THROW(index.search("x"), std::runtime_error) << "byte " << offset;
+   }
+}